@@ -0,0 +1,178 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+/*
+ * Data set arena.
+ *
+ * fann_create_train() allocates the input and output values in two blocks and
+ * fann_shuffle_train_data() swaps the values of the samples, so shuffling
+ * every epoch rewrites the whole data set. Here the row pointer arrays and
+ * the values share a single block, the values are aligned to cache lines,
+ * and shuffling only permutes the row pointers: 2 pointers per sample
+ * instead of all their values.
+ *
+ * The price is that an epoch over shuffled samples visits rows scattered in
+ * the arena instead of consecutive ones, though the values of each row are
+ * still contiguous. In file order, samples are read sequentially.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fann.h>
+#include <fann_internal.h>
+#include "arena.h"
+
+/** Round a size up to a multiple of ARENA_ALIGN */
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+
+/**
+ * Allocate an arena for a data set. Its samples are in file order and their values are undefined
+ * @param numData Number of samples
+ * @param numInput Number of inputs
+ * @param numOutput Number of outputs
+ * @return Arena (release with arena_destroy()), or NULL if out of memory
+ */
+struct arena_data *arena_create(unsigned int numData, unsigned int numInput, unsigned int numOutput)
+{
+    size_t pointers = ARENA_ROUND(sizeof(fann_type *) * 2 * (size_t) numData);
+    size_t inputs = ARENA_ROUND(sizeof(fann_type) * (size_t) numData * numInput);
+    size_t outputs = ARENA_ROUND(sizeof(fann_type) * (size_t) numData * numOutput);
+    struct arena_data *arena = (struct arena_data *) calloc(1, sizeof(struct arena_data));
+    void *block = NULL;
+
+    if (arena == NULL || posix_memalign(&block, ARENA_ALIGN, pointers + inputs + outputs) != 0) {
+        free(arena);
+        return NULL;
+    }
+
+    arena->block = block;
+    arena->size = pointers + inputs + outputs;
+    arena->data.num_data = numData;
+    arena->data.num_input = numInput;
+    arena->data.num_output = numOutput;
+    arena->data.input = (fann_type **) block;
+    arena->data.output = arena->data.input + numData;
+    arena->inputs = (fann_type *) ((char *) block + pointers);
+    arena->outputs = (fann_type *) ((char *) block + pointers + inputs);
+    arena_reset(arena);
+    return arena;
+}
+
+/**
+ * Release an arena
+ * @param arena Arena, or NULL
+ */
+void arena_destroy(struct arena_data *arena)
+{
+    if (arena == NULL) return;
+    free(arena->block);
+    free(arena);
+}
+
+/**
+ * Position of a sample in the file
+ * @param arena Arena
+ * @param row Position of the sample in the current order
+ * @return Position of the sample in file order
+ */
+unsigned int arena_index(const struct arena_data *arena, unsigned int row)
+{
+    if (arena->data.num_output > 0) {
+        return (unsigned int) ((size_t) (arena->data.output[row] - arena->outputs) / arena->data.num_output);
+    }
+    return (arena->data.num_input > 0) ? (unsigned int) ((size_t) (arena->data.input[row] - arena->inputs) / arena->data.num_input) : row;
+}
+
+/**
+ * Shuffle the samples of an arena, by permuting their row pointers.
+ * Uses rand(), as FANN does
+ * @param arena Arena
+ */
+void arena_shuffle(struct arena_data *arena)
+{
+    fann_type **input = arena->data.input, **output = arena->data.output;
+
+    for (unsigned int i = arena->data.num_data; i > 1; i--) {
+        unsigned int j = (unsigned int) (((double) rand() / ((double) RAND_MAX + 1)) * i);
+        fann_type *t = input[i - 1];
+        input[i - 1] = input[j];
+        input[j] = t;
+        t = output[i - 1];
+        output[i - 1] = output[j];
+        output[j] = t;
+    }
+}
+
+/**
+ * Put the samples of an arena back in file order
+ * @param arena Arena
+ */
+void arena_reset(struct arena_data *arena)
+{
+    for (unsigned int i = 0; i < arena->data.num_data; i++) {
+        arena->data.input[i] = arena->inputs + (size_t) i * arena->data.num_input;
+        arena->data.output[i] = arena->outputs + (size_t) i * arena->data.num_output;
+    }
+}
+
+/**
+ * Memory used by an arena
+ * @param arena Arena
+ * @return Bytes allocated for the arena, including row pointers and alignment padding
+ */
+size_t arena_memory(const struct arena_data *arena)
+{
+    return sizeof(struct arena_data) + arena->size;
+}
+
+/**
+ * Train a network on an arena, as fann_train_on_data() does, optionally
+ * shuffling the samples before every epoch. Reports go to the network's
+ * callback, or to STDOUT if it has none
+ * @param ann ANN
+ * @param arena Training data
+ * @param maxEpochs Maximum number of epochs
+ * @param epochsBetweenReports Epochs between reports, or 0 for none
+ * @param desiredError Error to stop at
+ * @param shuffle Non-zero to shuffle the samples before every epoch
+ */
+void arena_train(struct fann *ann, struct arena_data *arena, unsigned int maxEpochs, unsigned int epochsBetweenReports,
+        float desiredError, int shuffle)
+{
+    if (!shuffle) {
+        fann_train_on_data(ann, &arena->data, maxEpochs, epochsBetweenReports, desiredError);
+        return;
+    }
+
+    if (epochsBetweenReports && ann->callback == NULL) {
+        printf("Max epochs %8d. Desired error: %.10f.\n", maxEpochs, desiredError);
+    }
+    for (unsigned int i = 1; i <= maxEpochs; i++) {
+        arena_shuffle(arena);
+        float error = fann_train_epoch(ann, &arena->data);
+        int desiredErrorReached = fann_desired_error_reached(ann, desiredError);
+        if (epochsBetweenReports && (i % epochsBetweenReports == 0 || i == maxEpochs || i == 1 || desiredErrorReached == 0)) {
+            if (ann->callback == NULL) {
+                printf("Epochs     %8d. Current error: %.10f. Bit fail %d.\n", i, error, ann->num_bit_fail);
+            } else if ((*ann->callback)(ann, &arena->data, maxEpochs, epochsBetweenReports, desiredError, i) == -1) {
+                break;
+            }
+        }
+        if (desiredErrorReached == 0) break;
+    }
+}
@@ -0,0 +1,60 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef ARENA_H
+#define	ARENA_H
+
+#include <stddef.h>
+#include <fann.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/** Alignment of the blocks of an arena, in bytes: a cache line */
+#define ARENA_ALIGN 64
+
+/**
+ * Data set held in a single memory block (the arena).
+ * The block holds the row pointer arrays of data, then the inputs of all
+ * samples and then their outputs, each set of values row-major and starting
+ * ARENA_ALIGN aligned. data is a view that can be handed to any FANN function
+ * taking training data. Its row pointers are the sample order: shuffling
+ * permutes them, the values are never moved.
+ */
+struct arena_data {
+    struct fann_train_data data;    /**< View of the samples in their current order */
+    fann_type *inputs;              /**< Inputs, numData x numInput, in file order */
+    fann_type *outputs;             /**< Outputs, numData x numOutput, in file order */
+    size_t size;                    /**< Size of the block in bytes */
+    void *block;                    /**< The block */
+};
+
+struct arena_data *arena_create(unsigned int numData, unsigned int numInput, unsigned int numOutput);
+void arena_destroy(struct arena_data *arena);
+unsigned int arena_index(const struct arena_data *arena, unsigned int row);
+void arena_shuffle(struct arena_data *arena);
+void arena_reset(struct arena_data *arena);
+size_t arena_memory(const struct arena_data *arena);
+void arena_train(struct fann *ann, struct arena_data *arena, unsigned int maxEpochs, unsigned int epochsBetweenReports,
+        float desiredError, int shuffle);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* ARENA_H */
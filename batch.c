@@ -0,0 +1,179 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+/*
+ * Batched execution of network images.
+ *
+ * A batch of rows is split into as many consecutive slices as threads, and
+ * every slice is run by its own thread with its own neuron values buffer.
+ * Threads are started for each batch (see threads_run()), so batches must be
+ * large enough to pay for them; the autotune command finds out how large.
+ *
+ * When testing, every slice accumulates its own errors, which are added up in
+ * slice order. The MSE therefore does not depend on thread scheduling, but it
+ * may differ in the last digits from the one of a sequential run.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "batch.h"
+#include "threads.h"
+
+/** Shared state of a batch */
+struct batch_job {
+    struct batch_runner *runner;
+    unsigned int rows;          /**< Rows in the batch */
+    unsigned int nSlices;       /**< Number of slices */
+    fann_type *inputs;          /**< batch_run(): inputs, rows x numInput */
+    fann_type *outputs;         /**< batch_run(): outputs, rows x numOutput */
+    fann_type **inputRows;      /**< batch_test(): input rows */
+    fann_type **desiredRows;    /**< batch_test(): desired output rows */
+    struct net_mse *mse;        /**< batch_test(): errors of each slice */
+};
+
+/** First row of a slice */
+#define SLICE_START(job, slice) ((unsigned int) ((unsigned long long) (job)->rows * (slice) / (job)->nSlices))
+
+/**
+ * Prepare a runner
+ * @param runner Runner. Release with batch_free()
+ * @param img Image
+ * @param mode Activation mode
+ * @param nThreads Threads sharing each batch (0: one per processor)
+ * @return 0 on success, -1 if out of memory
+ */
+int batch_init(struct batch_runner *runner, const struct net_image *img, enum net_activation_mode mode, unsigned int nThreads)
+{
+    if (nThreads == 0) nThreads = threads_available();
+    runner->img = img;
+    runner->mode = mode;
+    runner->nThreads = nThreads;
+    runner->values = (fann_type *) malloc(sizeof(fann_type) * img->totalNeurons * nThreads);
+    return (runner->values == NULL) ? -1 : 0;
+}
+
+/**
+ * Release a runner
+ * @param runner Runner
+ */
+void batch_free(struct batch_runner *runner)
+{
+    free(runner->values);
+    runner->values = NULL;
+}
+
+/** Number of slices of a batch */
+static unsigned int batch_slices(const struct batch_runner *runner, unsigned int rows)
+{
+    return (rows < runner->nThreads) ? rows : runner->nThreads;
+}
+
+static void run_task(unsigned int slice, void *arg)
+{
+    struct batch_job *job = (struct batch_job *) arg;
+    const struct net_image *img = job->runner->img;
+    fann_type *values = job->runner->values + (size_t) img->totalNeurons * slice;
+    unsigned int i, last = SLICE_START(job, slice + 1);
+
+    for (i = SLICE_START(job, slice); i < last; i++) {
+        fann_type *input = job->inputs + (size_t) img->numInput * i;
+        fann_type *output = job->outputs + (size_t) img->numOutput * i;
+        net_scale_input(img, input);
+        memcpy(output, net_run(img, input, values, job->runner->mode), sizeof(fann_type) * img->numOutput);
+        net_descale_output(img, output);
+    }
+}
+
+/**
+ * Run a batch of rows. Inputs and outputs are scaled with the image's scaling parameters, if it has any
+ * @param runner Runner
+ * @param inputs Input values (rows x numInput), scaled in place
+ * @param rows Number of rows
+ * @param outputs Output values (rows x numOutput)
+ */
+void batch_run(struct batch_runner *runner, fann_type *inputs, unsigned int rows, fann_type *outputs)
+{
+    struct batch_job job;
+
+    memset(&job, 0, sizeof(job));
+    job.runner = runner;
+    job.rows = rows;
+    job.nSlices = batch_slices(runner, rows);
+    job.inputs = inputs;
+    job.outputs = outputs;
+    if (job.nSlices > 0) threads_run(job.nSlices, job.nSlices, run_task, &job);
+}
+
+static void test_task(unsigned int slice, void *arg)
+{
+    struct batch_job *job = (struct batch_job *) arg;
+    const struct net_image *img = job->runner->img;
+    fann_type *values = job->runner->values + (size_t) img->totalNeurons * slice;
+    unsigned int i, last = SLICE_START(job, slice + 1);
+
+    for (i = SLICE_START(job, slice); i < last; i++) {
+        net_scale_input(img, job->inputRows[i]);
+        net_scale_output(img, job->desiredRows[i]);
+        net_test(img, job->inputRows[i], job->desiredRows[i], values, job->runner->mode, &job->mse[slice]);
+    }
+}
+
+/**
+ * Test a batch of rows, adding their errors to an accumulator. Inputs and
+ * desired outputs are scaled with the image's scaling parameters, if it has any
+ * @param runner Runner
+ * @param inputs Input rows, scaled in place
+ * @param desired Desired output rows, scaled in place
+ * @param rows Number of rows
+ * @param mse Error accumulator
+ */
+void batch_test(struct batch_runner *runner, fann_type **inputs, fann_type **desired, unsigned int rows, struct net_mse *mse)
+{
+    struct batch_job job;
+    unsigned int i;
+
+    if (runner->nThreads <= 1) {
+        for (i = 0; i < rows; i++) {
+            net_scale_input(runner->img, inputs[i]);
+            net_scale_output(runner->img, desired[i]);
+            net_test(runner->img, inputs[i], desired[i], runner->values, runner->mode, mse);
+        }
+        return;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.runner = runner;
+    job.rows = rows;
+    job.nSlices = batch_slices(runner, rows);
+    job.inputRows = inputs;
+    job.desiredRows = desired;
+    job.mse = (struct net_mse *) calloc(job.nSlices, sizeof(struct net_mse));
+    if (job.mse == NULL) {
+        //Out of memory: test sequentially
+        struct batch_runner single = *runner;
+        single.nThreads = 1;
+        batch_test(&single, inputs, desired, rows, mse);
+        return;
+    }
+    if (job.nSlices > 0) threads_run(job.nSlices, job.nSlices, test_task, &job);
+    for (i = 0; i < job.nSlices; i++) {
+        mse->value += job.mse[i].value;
+        mse->count += job.mse[i].count;
+        mse->bitFail += job.mse[i].bitFail;
+    }
+    free(job.mse);
+}
@@ -0,0 +1,45 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef BATCH_H
+#define	BATCH_H
+
+#include "net.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/** Runs a network image over batches of rows, each batch shared by several threads */
+struct batch_runner {
+    const struct net_image *img;    /**< Image */
+    enum net_activation_mode mode;  /**< Activation mode */
+    unsigned int nThreads;          /**< Threads sharing each batch */
+    fann_type *values;              /**< Neuron values scratch buffer of each thread */
+};
+
+int batch_init(struct batch_runner *runner, const struct net_image *img, enum net_activation_mode mode, unsigned int nThreads);
+void batch_free(struct batch_runner *runner);
+void batch_run(struct batch_runner *runner, fann_type *inputs, unsigned int rows, fann_type *outputs);
+void batch_test(struct batch_runner *runner, fann_type **inputs, fann_type **desired, unsigned int rows, struct net_mse *mse);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* BATCH_H */
+
@@ -0,0 +1,137 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+/*
+ * Epoch time and memory of training data held by FANN against an arena.
+ *
+ * Usage: bench_data_layout [SAMPLES] [INPUTS] [HIDDEN] [OUTPUTS] [EPOCHS]
+ *
+ * Random samples are held either by fann_create_train(), shuffled with
+ * fann_shuffle_train_data(), or by an arena (see arena.h), shuffled with
+ * arena_shuffle(). Copies of the same network are trained for EPOCHS epochs
+ * on each, in file order and shuffling before every epoch, and the average
+ * time per epoch of shuffling and training is printed. Memory is the bytes
+ * allocated for the samples; overhead is the part not holding values.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fann.h>
+#include "arena.h"
+#include "metrics.h"
+
+/** Data held by either layout */
+struct layout {
+    const char *name;
+    struct fann_train_data *data;   /**< View trained on */
+    struct fann_train_data *fann;   /**< FANN layout, or NULL */
+    struct arena_data *arena;       /**< Arena layout, or NULL */
+    size_t memory;                  /**< Bytes allocated for the samples */
+};
+
+/** Shuffle the samples of a layout */
+static void shuffle(struct layout *l)
+{
+    if (l->arena != NULL) {
+        arena_shuffle(l->arena);
+    } else {
+        fann_shuffle_train_data(l->fann);
+    }
+}
+
+/**
+ * Train a copy of a network on a layout and print the time per epoch
+ * @param ann Initial network
+ * @param l Layout
+ * @param epochs Number of epochs
+ * @param shuffled Non-zero to shuffle the samples before every epoch
+ */
+static void run(struct fann *ann, struct layout *l, unsigned int epochs, int shuffled)
+{
+    struct fann *copy = fann_copy(ann);
+    uint64_t shuffleTime = 0, trainTime = 0;
+
+    srand(1);
+    for (unsigned int i = 0; i < epochs; i++) {
+        uint64_t t = metrics_now();
+        if (shuffled) shuffle(l);
+        uint64_t u = metrics_now();
+        fann_train_epoch(copy, l->data);
+        trainTime += metrics_now() - u;
+        shuffleTime += u - t;
+    }
+    fann_destroy(copy);
+
+    size_t values = sizeof(fann_type) * (size_t) l->data->num_data * (l->data->num_input + l->data->num_output);
+    printf("%-8s %-8s %12.1f %13.1f %12.3f %12.3f\n", l->name, shuffled ? "shuffled" : "file",
+            l->memory / 1048576.0, (l->memory - values) / 1048576.0,
+            shuffleTime / 1e6 / epochs, trainTime / 1e6 / epochs);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int numData = (argc > 1) ? (unsigned int) atoi(argv[1]) : 1000000;
+    unsigned int numInput = (argc > 2) ? (unsigned int) atoi(argv[2]) : 32;
+    unsigned int numHidden = (argc > 3) ? (unsigned int) atoi(argv[3]) : 16;
+    unsigned int numOutput = (argc > 4) ? (unsigned int) atoi(argv[4]) : 4;
+    unsigned int epochs = (argc > 5) ? (unsigned int) atoi(argv[5]) : 5;
+    unsigned int i, j;
+
+    if (numData == 0 || numInput == 0 || numHidden == 0 || numOutput == 0 || epochs == 0) {
+        fprintf(stderr, "Usage: %s [SAMPLES] [INPUTS] [HIDDEN] [OUTPUTS] [EPOCHS]\n", argv[0]);
+        return 1;
+    }
+
+    unsigned int layers[3] = {numInput, numHidden, numOutput};
+    struct fann *ann = fann_create_standard_array(3, layers);
+    struct layout fann = {"fann", NULL, fann_create_train(numData, numInput, numOutput), NULL, 0};
+    struct layout arena = {"arena", NULL, NULL, arena_create(numData, numInput, numOutput), 0};
+    if (ann == NULL || fann.fann == NULL || arena.arena == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        return 1;
+    }
+    fann_randomize_weights(ann, -0.1f, 0.1f);
+
+    //fann_create_train() allocates the structure, two row pointer arrays and a block of inputs and one of outputs
+    fann.data = fann.fann;
+    fann.memory = sizeof(struct fann_train_data) + sizeof(fann_type *) * 2 * (size_t) numData
+            + sizeof(fann_type) * (size_t) numData * (numInput + numOutput);
+    arena.data = &arena.arena->data;
+    arena.memory = arena_memory(arena.arena);
+
+    srand(1);
+    for (i = 0; i < numData; i++) {
+        for (j = 0; j < numInput; j++) {
+            fann.fann->input[i][j] = arena.arena->inputs[(size_t) i * numInput + j] = (fann_type) rand() / RAND_MAX * 2 - 1;
+        }
+        for (j = 0; j < numOutput; j++) {
+            fann.fann->output[i][j] = arena.arena->outputs[(size_t) i * numOutput + j] = (fann_type) rand() / RAND_MAX * 2 - 1;
+        }
+    }
+
+    printf("%u samples, %u-%u-%u network, %u epochs\n", numData, numInput, numHidden, numOutput, epochs);
+    printf("%-8s %-8s %12s %13s %12s %12s\n", "Layout", "Order", "Memory(MB)", "Overhead(MB)", "Shuffle(ms)", "Epoch(ms)");
+    run(ann, &fann, epochs, 0);
+    run(ann, &arena, epochs, 0);
+    run(ann, &fann, epochs, 1);
+    run(ann, &arena, epochs, 1);
+
+    fann_destroy_train(fann.fann);
+    arena_destroy(arena.arena);
+    fann_destroy(ann);
+    return 0;
+}
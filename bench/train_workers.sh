@@ -0,0 +1,49 @@
+#!/bin/sh
+#
+# fannc
+# Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 3.0 of the License, or (at your option) any later version.
+#
+# Epoch time of distributed training against the number of local workers.
+#
+# Usage: bench/train_workers.sh ANN DATA [MAX_WORKERS] [EPOCHS]
+#
+# The row for 0 workers is plain single process training; the others train
+# with local workers, averaging parameters after every epoch. Every row is
+# the whole run time divided by the number of epochs, so it includes loading
+# the data and, with workers, starting them.
+#
+
+FANNC=${FANNC:-fannc}
+ANN=$1
+DATA=$2
+MAX_WORKERS=${3:-$(getconf _NPROCESSORS_ONLN)}
+EPOCHS=${4:-20}
+
+if [ -z "$ANN" ] || [ -z "$DATA" ]; then
+    echo "Usage: $0 ANN DATA [MAX_WORKERS] [EPOCHS]" >&2
+    exit 1
+fi
+
+# Wall time of a training run divided by the number of epochs
+# @param $@ Extra train options
+epoch_time() {
+    START=$(date +%s.%N)
+    "$FANNC" train --ann="$ANN" --training-data="$DATA" --max-epochs="$EPOCHS" --target-error=0 "$@" > /dev/null || exit 1
+    END=$(date +%s.%N)
+    echo "($END - $START) / $EPOCHS" | bc -l
+}
+
+printf "%-8s %s\n" "workers" "epoch time (s)"
+T=$(epoch_time) || exit 1
+printf "%-8s %s\n" 0 "$T"
+
+W=1
+while [ "$W" -le "$MAX_WORKERS" ]; do
+    T=$(epoch_time --workers="$W") || exit 1
+    printf "%-8s %s\n" "$W" "$T"
+    W=$((W + 1))
+done
@@ -0,0 +1,595 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+/*
+ * Network image cache.
+ *
+ * Every cached network is stored in its own file inside the cache directory,
+ * named after a hash of the network's canonical path. The file holds a header
+ * describing the source file (size, modification time, inode and a hash of
+ * its contents) followed by the compiled image, which is mapped read-only and
+ * used in place.
+ *
+ * An entry is valid while the source file's size, modification time and inode
+ * are unchanged. When they change, the contents are hashed: if the hash still
+ * matches, the entry is rewritten with the new metadata; otherwise the network
+ * is compiled again. Entries are always written to a temporary file and
+ * renamed over the old one, so concurrent readers either see the old or the
+ * new entry, never a partial one.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "cache.h"
+#include "compress.h"
+#include "tune.h"
+
+#define CACHE_MAGIC     "FNNCACHE"
+#define CACHE_VERSION   1u
+#define CACHE_SUFFIX    ".img"
+#define TEMP_SUFFIX     ".tmp"
+
+/** Age after which a temporary file is taken for the leftover of a crashed writer, in seconds */
+#define TEMP_MAX_AGE    3600
+
+/** Cache file header. Followed by the source path and, at imageOffset, the image */
+struct cache_header {
+    char magic[8];          /**< CACHE_MAGIC */
+    uint32_t version;       /**< CACHE_VERSION */
+    uint32_t pathLen;       /**< Length of the source path, without terminator */
+    uint64_t fileSize;      /**< Source file size */
+    int64_t mtimeSec;       /**< Source file modification time */
+    int64_t mtimeNsec;
+    uint64_t dev;           /**< Source file device and inode */
+    uint64_t ino;
+    uint64_t contentHash;   /**< FNV-1a hash of the source file contents */
+    uint64_t imageOffset;   /**< Offset of the image (64-byte aligned) */
+    uint64_t imageSize;     /**< Size of the image */
+};
+
+/**
+ * 64-bit FNV-1a hash
+ * @param data Data
+ * @param len Data length
+ * @param h Initial value (chain calls by passing the previous result)
+ * @return Hash
+ */
+static uint64_t fnv1a(const void *data, size_t len, uint64_t h)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    while (len-- > 0) {
+        h ^= *p++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+#define FNV_INIT 0xcbf29ce484222325ULL
+
+/**
+ * Get the cache directory.
+ * Taken from FANNC_CACHE_DIR, or $XDG_CACHE_HOME/fannc, or $HOME/.cache/fannc.
+ * @return Directory path
+ */
+const char *cache_dir(void)
+{
+    static char dir[PATH_MAX];
+    const char *env;
+
+    if (dir[0] != '\0') return dir;
+
+    if ((env = getenv(CACHE_DIR_ENV)) != NULL && *env != '\0') {
+        snprintf(dir, sizeof(dir), "%s", env);
+    } else if ((env = getenv("XDG_CACHE_HOME")) != NULL && *env != '\0') {
+        snprintf(dir, sizeof(dir), "%s/fannc", env);
+    } else if ((env = getenv("HOME")) != NULL && *env != '\0') {
+        snprintf(dir, sizeof(dir), "%s/.cache/fannc", env);
+    } else {
+        snprintf(dir, sizeof(dir), "/tmp/fannc-%lu", (unsigned long) getuid());
+    }
+    return dir;
+}
+
+/**
+ * Create a directory and its parents
+ * @param path Directory path
+ * @return 0 on success, -1 on error
+ */
+static int make_dirs(const char *path)
+{
+    char tmp[PATH_MAX];
+    char *p;
+
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (p = tmp + 1; *p != '\0'; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(tmp, 0755) != 0 && errno != EEXIST) return -1;
+            *p = '/';
+        }
+    }
+    if (mkdir(tmp, 0755) != 0 && errno != EEXIST) return -1;
+    return 0;
+}
+
+/**
+ * Build the path of a file of the cache directory kept for a network
+ * @param canonPath Canonical network path
+ * @param suffix File name suffix
+ * @param out Output buffer (PATH_MAX)
+ */
+static void entry_path(const char *canonPath, const char *suffix, char *out)
+{
+    snprintf(out, PATH_MAX, "%s/%016llx%s", cache_dir(), (unsigned long long) fnv1a(canonPath, strlen(canonPath), FNV_INIT), suffix);
+}
+
+/**
+ * Build the path of a file kept in the cache directory on behalf of a
+ * network other than its image, such as its tuning profile (see tune.h)
+ * @param annPath Path to the network file
+ * @param suffix File name suffix
+ * @param out Output buffer (PATH_MAX)
+ * @param canonPath Output canonical network path (PATH_MAX)
+ * @return 0 on success, -1 if the network file does not exist
+ */
+int cache_file_path(const char *annPath, const char *suffix, char *out, char *canonPath)
+{
+    if (realpath(annPath, canonPath) == NULL) return -1;
+    entry_path(canonPath, suffix, out);
+    return 0;
+}
+
+/**
+ * Create the cache directory if it does not exist
+ * @return 0 on success, -1 on error
+ */
+int cache_make_dir(void)
+{
+    return make_dirs(cache_dir());
+}
+
+/**
+ * Create a temporary file next to a cache file, to be renamed over it once
+ * written. Its name is unique among all the threads of all the processes
+ * @param path Cache file path
+ * @param tmpPath Output temporary file path (PATH_MAX)
+ * @return Open file descriptor, or -1 on error
+ */
+int cache_temp_file(const char *path, char *tmpPath)
+{
+    if (snprintf(tmpPath, PATH_MAX, "%s.XXXXXX%s", path, TEMP_SUFFIX) >= PATH_MAX) return -1;
+    int fd = mkstemps(tmpPath, (int) strlen(TEMP_SUFFIX));
+    if (fd < 0) return -1;
+    if (fchmod(fd, 0644) != 0) {
+        close(fd);
+        unlink(tmpPath);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Hash the contents of an open file, from its start
+ * @param fd File
+ * @param hash Output hash
+ * @return 0 on success, -1 on error
+ */
+static int hash_fd(int fd, uint64_t *hash)
+{
+    char buf[65536];
+    ssize_t n;
+    off_t off = 0;
+    uint64_t h = FNV_INIT;
+
+    while ((n = pread(fd, buf, sizeof(buf), off)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        h = fnv1a(buf, (size_t) n, h);
+        off += n;
+    }
+    *hash = h;
+    return 0;
+}
+
+/**
+ * Check whether a header describes the current state of the source file
+ * @param hdr Header
+ * @param st Source file status
+ * @return Non-zero if metadata matches
+ */
+static int same_metadata(const struct cache_header *hdr, const struct stat *st)
+{
+    return hdr->fileSize == (uint64_t) st->st_size
+        && hdr->mtimeSec == (int64_t) st->st_mtim.tv_sec
+        && hdr->mtimeNsec == (int64_t) st->st_mtim.tv_nsec
+        && hdr->dev == (uint64_t) st->st_dev
+        && hdr->ino == (uint64_t) st->st_ino;
+}
+
+/**
+ * Map a cache file and check it is well formed
+ * @param path Cache file path
+ * @param map Output mapping
+ * @param mapSize Output mapping size
+ * @return Header inside the mapping, or NULL if missing or invalid
+ */
+static const struct cache_header *map_entry(const char *path, void **map, size_t *mapSize)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(struct cache_header)) {
+        close(fd);
+        return NULL;
+    }
+
+    void *p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+
+    const struct cache_header *hdr = (const struct cache_header *) p;
+    if (memcmp(hdr->magic, CACHE_MAGIC, sizeof(hdr->magic)) != 0 || hdr->version != CACHE_VERSION
+            || sizeof(struct cache_header) + (uint64_t) hdr->pathLen > hdr->imageOffset
+            || (hdr->imageOffset & 63) != 0
+            || hdr->imageOffset + hdr->imageSize != (uint64_t) st.st_size) {
+        munmap(p, (size_t) st.st_size);
+        return NULL;
+    }
+
+    *map = p;
+    *mapSize = (size_t) st.st_size;
+    return hdr;
+}
+
+/**
+ * Write a cache file atomically
+ * @param path Cache file path
+ * @param canonPath Canonical network path
+ * @param st Network file status
+ * @param contentHash Hash of the network file contents
+ * @param img Image
+ * @return 0 on success, -1 on error
+ */
+static int write_entry(const char *path, const char *canonPath, const struct stat *st, uint64_t contentHash, const struct net_image *img)
+{
+    char tmpPath[PATH_MAX];
+    struct cache_header hdr;
+    static const char zeros[64];
+    size_t pathLen = strlen(canonPath);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic));
+    hdr.version = CACHE_VERSION;
+    hdr.pathLen = (uint32_t) pathLen;
+    hdr.fileSize = (uint64_t) st->st_size;
+    hdr.mtimeSec = (int64_t) st->st_mtim.tv_sec;
+    hdr.mtimeNsec = (int64_t) st->st_mtim.tv_nsec;
+    hdr.dev = (uint64_t) st->st_dev;
+    hdr.ino = (uint64_t) st->st_ino;
+    hdr.contentHash = contentHash;
+    hdr.imageOffset = (sizeof(hdr) + pathLen + 63) & ~((uint64_t) 63);
+    hdr.imageSize = img->size;
+
+    if (make_dirs(cache_dir()) != 0) return -1;
+
+    int fd = cache_temp_file(path, tmpPath);
+    if (fd < 0) return -1;
+
+    size_t pad = (size_t) hdr.imageOffset - sizeof(hdr) - pathLen;
+    int ok = write(fd, &hdr, sizeof(hdr)) == (ssize_t) sizeof(hdr)
+          && write(fd, canonPath, pathLen) == (ssize_t) pathLen
+          && write(fd, zeros, pad) == (ssize_t) pad
+          && write(fd, img, (size_t) img->size) == (ssize_t) img->size;
+
+    if (close(fd) != 0) ok = 0;
+    if (!ok || rename(tmpPath, path) != 0) {
+        unlink(tmpPath);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Map a network image file, such as the snapshots published by the learn command
+ * @param path File path
+ * @param entry Output entry. Release with cache_release()
+ * @return 1 if the file holds a valid image, 0 if it is not an image, -1 if it could not be read or is corrupt (reported)
+ */
+int cache_map_image(const char *path, struct cache_entry *entry)
+{
+    struct stat st;
+    uint32_t magic;
+    int fd = open(path, O_RDONLY);
+
+    memset(entry, 0, sizeof(*entry));
+    if (fd < 0) {
+        fprintf(stderr, "%s: could not open file\n", path);
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (size_t) st.st_size < sizeof(struct net_image)
+            || pread(fd, &magic, sizeof(magic), 0) != (ssize_t) sizeof(magic) || magic != NET_IMAGE_MAGIC) {
+        close(fd);
+        return 0;
+    }
+
+    void *p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "%s: could not map file\n", path);
+        return -1;
+    }
+    if (net_validate((const struct net_image *) p, (size_t) st.st_size) != 0) {
+        fprintf(stderr, "%s: corrupt network image\n", path);
+        munmap(p, (size_t) st.st_size);
+        return -1;
+    }
+
+    entry->map = p;
+    entry->mapSize = (size_t) st.st_size;
+    entry->image = (const struct net_image *) p;
+    return 1;
+}
+
+/**
+ * Tell whether an open file is unchanged since it was examined
+ * @param fd File
+ * @param st Metadata obtained when it was opened
+ * @return Non-zero if unchanged
+ */
+static int unchanged(int fd, const struct stat *st)
+{
+    struct stat now;
+
+    return fstat(fd, &now) == 0 && now.st_size == st->st_size && now.st_ino == st->st_ino
+        && now.st_mtim.tv_sec == st->st_mtim.tv_sec && now.st_mtim.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/**
+ * Get the image of a network, compiling and caching it if needed.
+ * Image files are mapped as they are.
+ * @param annPath Path to the network file
+ * @param entry Output entry. Release with cache_release()
+ * @return 0 on success, -1 if the network could not be loaded
+ */
+int cache_load(const char *annPath, struct cache_entry *entry)
+{
+    char canonPath[PATH_MAX], path[PATH_MAX];
+    struct stat st;
+    const struct cache_header *hdr;
+    uint64_t contentHash = 0;
+    int hashed = 0;
+
+    memset(entry, 0, sizeof(*entry));
+
+    int isImage = cache_map_image(annPath, entry);
+    if (isImage != 0) return (isImage > 0) ? 0 : -1;
+
+    //The metadata, hash and image all come from one descriptor, so that a file
+    //replaced meanwhile cannot have its image cached under another version's hash
+    if (realpath(annPath, canonPath) == NULL) return -1;
+    int fd = open(canonPath, O_RDONLY);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    entry_path(canonPath, CACHE_SUFFIX, path);
+
+    hdr = map_entry(path, &entry->map, &entry->mapSize);
+    if (hdr != NULL) {
+        const char *entryPath = (const char *) (hdr + 1);
+        const struct net_image *img = (const struct net_image *) ((const char *) entry->map + hdr->imageOffset);
+        int valid = hdr->pathLen == strlen(canonPath) && memcmp(entryPath, canonPath, hdr->pathLen) == 0
+                 && net_validate(img, (size_t) hdr->imageSize) == 0;
+
+        if (valid && same_metadata(hdr, &st)) {
+            close(fd);
+            entry->image = img;
+            return 0;
+        }
+
+        if (valid && hdr->fileSize == (uint64_t) st.st_size && hash_fd(fd, &contentHash) == 0) {
+            hashed = 1;
+            if (contentHash == hdr->contentHash) {
+                //Touched but unchanged: refresh metadata and keep using the mapped image
+                if (unchanged(fd, &st)) write_entry(path, canonPath, &st, contentHash, img);
+                close(fd);
+                entry->image = img;
+                return 0;
+            }
+        }
+
+        munmap(entry->map, entry->mapSize);
+        entry->map = NULL;
+        entry->mapSize = 0;
+    }
+
+    //Miss or stale entry: compile the network
+    struct fann *ann = compress_load_ann_fd(fd, canonPath);
+    if (ann == NULL) {
+        close(fd);
+        return -1;
+    }
+    entry->owned = net_compile(ann);
+    fann_destroy(ann);
+    if (entry->owned == NULL) {
+        close(fd);
+        return -1;
+    }
+    entry->image = entry->owned;
+
+    //Only cache the image if the file was not rewritten in place while being read
+    if ((hashed || hash_fd(fd, &contentHash) == 0) && unchanged(fd, &st)) {
+        write_entry(path, canonPath, &st, contentHash, entry->owned);
+    }
+    close(fd);
+    return 0;
+}
+
+/**
+ * Release an entry obtained with cache_load()
+ * @param entry Entry
+ */
+void cache_release(struct cache_entry *entry)
+{
+    if (entry->map != NULL) munmap(entry->map, entry->mapSize);
+    free(entry->owned);
+    memset(entry, 0, sizeof(*entry));
+}
+
+/** Tell whether a file name ends with a suffix */
+static int has_suffix(const char *name, const char *suffix)
+{
+    size_t len = strlen(name), suffixLen = strlen(suffix);
+    return len > suffixLen && strcmp(name + len - suffixLen, suffix) == 0;
+}
+
+/** Tell whether a temporary file was left behind by a writer that died */
+static int is_leftover(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && time(NULL) - st.st_mtime > TEMP_MAX_AGE;
+}
+
+/** A file of the cache directory, as seen by visit_entries() */
+struct cache_file {
+    const char *path;               /**< File path */
+    const char *status;             /**< "valid", "stale", "missing" or "invalid" */
+    const char *annPath;            /**< Network the file was made for, or NULL if unknown */
+    const struct cache_header *hdr; /**< Header of an image entry, or NULL */
+    int isProfile;                  /**< Non-zero for tuning profiles (see tune.h) */
+    int isTemp;                     /**< Non-zero for temporary files left behind */
+};
+
+/**
+ * Tell whether an entry is still valid
+ * @param hdr Header, or NULL for unreadable entries
+ * @return "valid", "stale", "missing" or "invalid"
+ */
+static const char *entry_status(const struct cache_header *hdr)
+{
+    char srcPath[PATH_MAX];
+    struct stat st;
+
+    if (hdr == NULL || hdr->pathLen >= PATH_MAX) return "invalid";
+    memcpy(srcPath, hdr + 1, hdr->pathLen);
+    srcPath[hdr->pathLen] = '\0';
+    if (stat(srcPath, &st) != 0) return "missing";
+    return same_metadata(hdr, &st) ? "valid" : "stale";
+}
+
+/**
+ * Visit the image entries and tuning profiles of the cache directory.
+ * Temporary files are only visited once they are old enough to have been
+ * left behind by a writer that died
+ * @param visit Callback receiving each file
+ * @param arg Callback argument
+ * @return Number of visited files, or -1 if the cache directory could not be read
+ */
+static int visit_entries(void (*visit)(const struct cache_file *, void *), void *arg)
+{
+    char path[PATH_MAX], annPath[PATH_MAX];
+    struct dirent *de;
+    int count = 0;
+    DIR *dir = opendir(cache_dir());
+
+    if (dir == NULL) return (errno == ENOENT) ? 0 : -1;
+    while ((de = readdir(dir)) != NULL) {
+        struct cache_file file = {path, "invalid", NULL, NULL, 0, 0};
+        int isEntry = has_suffix(de->d_name, CACHE_SUFFIX);
+        file.isProfile = has_suffix(de->d_name, TUNE_SUFFIX);
+        file.isTemp = has_suffix(de->d_name, TEMP_SUFFIX);
+        if (!isEntry && !file.isProfile && !file.isTemp) continue;
+
+        void *map = NULL;
+        size_t mapSize = 0;
+        snprintf(path, sizeof(path), "%s/%s", cache_dir(), de->d_name);
+        //Temporary files are being written by someone else, unless they were left behind long ago
+        if (file.isTemp && !is_leftover(path)) continue;
+        if (isEntry) {
+            file.hdr = map_entry(path, &map, &mapSize);
+            file.status = entry_status(file.hdr);
+            if (file.hdr != NULL) file.annPath = (const char *) (file.hdr + 1);
+        } else if (file.isProfile) {
+            file.status = tune_profile_status(path, annPath);
+            if (annPath[0] != '\0') file.annPath = annPath;
+        }
+        visit(&file, arg);
+        if (map != NULL) munmap(map, mapSize);
+        count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+static void list_visitor(const struct cache_file *file, void *arg)
+{
+    FILE *fp = (FILE *) arg;
+    if (file->hdr != NULL) {
+        fprintf(fp, "%-8s %12llu  %.*s\n", file->status, (unsigned long long) file->hdr->imageSize, (int) file->hdr->pathLen, file->annPath);
+    } else {
+        fprintf(fp, "%-8s %12s  %s\n", file->status, file->isProfile ? "profile" : "-", (file->annPath != NULL) ? file->annPath : file->path);
+    }
+}
+
+/**
+ * Print the cache contents: status, image size (or "profile" for tuning
+ * profiles) and network path of each file
+ * @param fp Output stream
+ * @return 0 on success, -1 on error
+ */
+int cache_list(FILE *fp)
+{
+    fprintf(fp, "# %s\n", cache_dir());
+    return visit_entries(list_visitor, fp) < 0 ? -1 : 0;
+}
+
+struct clear_args {
+    int staleOnly;
+    int errors;
+};
+
+static void clear_visitor(const struct cache_file *file, void *arg)
+{
+    struct clear_args *args = (struct clear_args *) arg;
+    //Pruning only removes entries and profiles, not even leftover temporary files
+    if (args->staleOnly && (file->isTemp || strcmp(file->status, "valid") == 0)) return;
+    if (unlink(file->path) != 0) args->errors++;
+}
+
+/**
+ * Remove cache entries and tuning profiles
+ * @param staleOnly If non-zero, only remove those whose network changed or vanished
+ * @return 0 on success, -1 on error
+ */
+int cache_clear(int staleOnly)
+{
+    struct clear_args args = {staleOnly, 0};
+    if (visit_entries(clear_visitor, &args) < 0) return -1;
+    return (args.errors > 0) ? -1 : 0;
+}
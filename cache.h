@@ -0,0 +1,54 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef CACHE_H
+#define	CACHE_H
+
+#include <stdio.h>
+#include "net.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/** Environment variable overriding the cache directory */
+#define CACHE_DIR_ENV "FANNC_CACHE_DIR"
+
+/** A network image obtained from the cache */
+struct cache_entry {
+    const struct net_image *image;  /**< Ready to run image */
+    void *map;                      /**< Mapped cache file, or NULL */
+    size_t mapSize;                 /**< Size of the mapping */
+    struct net_image *owned;        /**< Image compiled in memory when it could not be stored */
+};
+
+const char *cache_dir(void);
+int cache_file_path(const char *annPath, const char *suffix, char *out, char *canonPath);
+int cache_make_dir(void);
+int cache_temp_file(const char *path, char *tmpPath);
+int cache_map_image(const char *path, struct cache_entry *entry);
+int cache_load(const char *annPath, struct cache_entry *entry);
+void cache_release(struct cache_entry *entry);
+int cache_list(FILE *fp);
+int cache_clear(int staleOnly);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* CACHE_H */
+
@@ -0,0 +1,225 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+/*
+ * Cascade-correlation training with the candidate pool trained in parallel.
+ *
+ * Follows fann_cascadetrain_on_data() step by step, except for candidate
+ * training. Before each neuron is added, the pool is split into shares by
+ * activation function (and by steepness when there are more threads than
+ * functions). Every share is trained on its own copy of the network, all of
+ * them reading the same training data. The copy holding the best scoring
+ * candidate installs it and becomes the network for the next step.
+ *
+ * Candidate weights are initialized one share after another on the calling
+ * thread and ties go to the share that comes first in FANN's candidate
+ * order, so results do not depend on thread scheduling.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fann.h>
+#include <fann_internal.h>
+#include "cascade.h"
+#include "threads.h"
+
+/** A share of the candidate pool, trained on its own copy of the network */
+struct cascade_share {
+    struct fann *ann;           /**< Network copy holding the share's candidates */
+    unsigned int epochs;        /**< Epochs spent training the candidates */
+    fann_type score;            /**< Score of the best candidate of the share */
+};
+
+/** Argument of train_share() */
+struct cascade_job {
+    struct cascade_share *shares;
+    struct fann_train_data *data;
+};
+
+/** Train the candidates of a share and record its best score */
+static void train_share(unsigned int index, void *arg)
+{
+    struct cascade_job *job = (struct cascade_job *) arg;
+    struct cascade_share *share = &job->shares[index];
+    struct fann *ann = share->ann;
+
+    share->epochs = fann_train_candidates(ann, job->data);
+    share->score = ann->cascade_candidate_scores[ann->cascade_best_candidate - ann->total_neurons - 1];
+}
+
+/**
+ * Print or report the progress of cascade training, as fann_cascadetrain_on_data() does
+ * @return -1 if the callback asked to stop training, 0 otherwise
+ */
+static int report(struct fann *ann, struct fann_train_data *data, unsigned int neurons, unsigned int maxNeurons,
+        unsigned int neuronsBetweenReports, float desiredError, unsigned int totalEpochs)
+{
+    if (ann->callback != NULL) {
+        return ((*ann->callback)(ann, data, maxNeurons, neuronsBetweenReports, desiredError, totalEpochs) == -1) ? -1 : 0;
+    }
+
+    printf("Neurons     %3d. Current error: %.6f. Total error:%8.4f. Epochs %5d. Bit fail %3d",
+            neurons - 1, fann_get_MSE(ann), ann->MSE_value, totalEpochs, ann->num_bit_fail);
+    if ((ann->last_layer - 2) != ann->first_layer) {
+        printf(". candidate steepness %.2f. function %s",
+                (ann->last_layer - 2)->first_neuron->activation_steepness,
+                FANN_ACTIVATIONFUNC_NAMES[(ann->last_layer - 2)->first_neuron->activation_function]);
+    }
+    printf("\n");
+    return 0;
+}
+
+/**
+ * Train the whole candidate pool of a step on a single network, as FANN does
+ * @return Epochs spent, or -1 if there was no room for the candidates
+ */
+static int train_pool(struct fann *ann, struct fann_train_data *data)
+{
+    if (fann_initialize_candidates(ann) == -1) return -1;
+    int epochs = fann_train_candidates(ann, data);
+    fann_install_candidate(ann);
+    return epochs;
+}
+
+/**
+ * Cascade train an ANN, training the candidates of every step concurrently.
+ * Parameters have the same meaning as in fann_cascadetrain_on_data(), which is
+ * called as is when a single thread is requested.
+ * @param ann ANN
+ * @param data Training data
+ * @param maxNeurons Maximum number of neurons to add
+ * @param neuronsBetweenReports Neurons added between reports, or 0 for no reports
+ * @param desiredError Desired error
+ * @param nThreads Number of threads, or 0 for one per processor
+ * @return Trained ANN. When it is not the given one, the given one has been destroyed
+ */
+struct fann *cascade_train_on_data(struct fann *ann, struct fann_train_data *data, unsigned int maxNeurons,
+        unsigned int neuronsBetweenReports, float desiredError, unsigned int nThreads)
+{
+    if (nThreads == 0) nThreads = threads_available();
+    if (nThreads <= 1) {
+        fann_cascadetrain_on_data(ann, data, maxNeurons, neuronsBetweenReports, desiredError);
+        return ann;
+    }
+
+    unsigned int nFunctions = fann_get_cascade_activation_functions_count(ann);
+    unsigned int nSteepnesses = fann_get_cascade_activation_steepnesses_count(ann);
+    enum fann_activationfunc_enum *functions = (enum fann_activationfunc_enum *) malloc(sizeof(enum fann_activationfunc_enum) * (nFunctions + 1));
+    fann_type *steepnesses = (fann_type *) malloc(sizeof(fann_type) * (nSteepnesses + 1));
+    
+    //Split by function, and also by steepness if there are not enough functions to keep every thread busy
+    int bySteepness = (nFunctions < nThreads && nSteepnesses > 1);
+    unsigned int nShares = bySteepness ? nFunctions * nSteepnesses : nFunctions;
+    struct cascade_share *shares = (struct cascade_share *) calloc(nShares + 1, sizeof(struct cascade_share));
+
+    if (functions == NULL || steepnesses == NULL || shares == NULL || nShares <= 1) {
+        free(functions);
+        free(steepnesses);
+        free(shares);
+        fann_cascadetrain_on_data(ann, data, maxNeurons, neuronsBetweenReports, desiredError);
+        return ann;
+    }
+    memcpy(functions, fann_get_cascade_activation_functions(ann), sizeof(enum fann_activationfunc_enum) * nFunctions);
+    memcpy(steepnesses, fann_get_cascade_activation_steepnesses(ann), sizeof(fann_type) * nSteepnesses);
+
+    unsigned int i, s;
+    unsigned int totalEpochs = 0;
+    struct cascade_job job = {shares, data};
+
+    if (neuronsBetweenReports && ann->callback == NULL) {
+        printf("Max neurons %3d. Desired error: %.6f\n", maxNeurons, desiredError);
+    }
+
+    for (i = 1; i <= maxNeurons; i++) {
+        //Train output neurons
+        totalEpochs += fann_train_outputs(ann, data, desiredError);
+        int desiredErrorReached = fann_desired_error_reached(ann, desiredError);
+
+        if (neuronsBetweenReports && (i % neuronsBetweenReports == 0 || i == maxNeurons || i == 1 || desiredErrorReached == 0)) {
+            if (report(ann, data, i, maxNeurons, neuronsBetweenReports, desiredError, totalEpochs) == -1) break;
+        }
+
+        if (desiredErrorReached == 0) break;
+
+        //Copies must see valid connection pointers
+        fann_set_shortcut_connections(ann);
+
+        //Each share gets its own copy, restricted to its functions and steepnesses
+        int failed = 0;
+        for (s = 0; s < nShares && !failed; s++) {
+            unsigned int f = bySteepness ? s / nSteepnesses : s;
+            struct fann *copy = shares[s].ann = fann_copy(ann);
+            if (copy == NULL) {
+                failed = 1;
+                continue;
+            }
+            fann_set_cascade_activation_functions(copy, &functions[f], 1);
+            if (bySteepness) fann_set_cascade_activation_steepnesses(copy, &steepnesses[s % nSteepnesses], 1);
+            if (fann_initialize_candidates(copy) == -1) failed = 1;
+        }
+
+        unsigned int best = 0;
+        if (!failed) {
+            threads_run(nThreads, nShares, train_share, &job);
+
+            unsigned int maxEpochs = 0;
+            for (s = 0; s < nShares; s++) {
+                if (shares[s].score > shares[best].score) best = s;
+                if (shares[s].epochs > maxEpochs) maxEpochs = shares[s].epochs;
+            }
+            totalEpochs += maxEpochs;
+
+            //The winner installs its candidate and takes the place of the network
+            struct fann *winner = shares[best].ann;
+            fann_install_candidate(winner);
+            fann_set_cascade_activation_functions(winner, functions, nFunctions);
+            fann_set_cascade_activation_steepnesses(winner, steepnesses, nSteepnesses);
+            free(winner->cascade_candidate_scores);
+            winner->cascade_candidate_scores = NULL;
+            fann_set_callback(winner, ann->callback);
+            fann_set_user_data(winner, fann_get_user_data(ann));
+            shares[best].ann = ann;
+            ann = winner;
+        }
+
+        for (s = 0; s < nShares; s++) {
+            if (shares[s].ann != NULL) fann_destroy(shares[s].ann);
+            shares[s].ann = NULL;
+        }
+
+        if (failed) {
+            //Not enough memory for the copies: train this step's pool on the network itself
+            int epochs = train_pool(ann, data);
+            if (epochs == -1) break;
+            totalEpochs += epochs;
+        }
+    }
+
+    //Train outputs one last time but without any desired error
+    totalEpochs += fann_train_outputs(ann, data, 0.0);
+
+    if (neuronsBetweenReports && ann->callback == NULL) {
+        printf("Train outputs    Current error: %.6f. Epochs %6d\n", fann_get_MSE(ann), totalEpochs);
+    }
+
+    fann_set_shortcut_connections(ann);
+
+    free(functions);
+    free(steepnesses);
+    free(shares);
+    return ann;
+}
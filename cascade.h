@@ -0,0 +1,35 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef CASCADE_H
+#define	CASCADE_H
+
+#include <fann.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+struct fann *cascade_train_on_data(struct fann *ann, struct fann_train_data *data, unsigned int maxNeurons,
+        unsigned int neuronsBetweenReports, float desiredError, unsigned int nThreads);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* CASCADE_H */
+
@@ -0,0 +1,23 @@
+IF (ZSTD_ROOT)
+    # force re-find programs
+    set(ZSTD_LIBRARY NOTFOUND CACHE FILE "" FORCE)
+    set(ZSTD_INCLUDE_DIR NOTFOUND CACHE PATH "" FORCE)
+ENDIF (ZSTD_ROOT)
+
+FIND_LIBRARY(ZSTD_LIBRARY zstd HINTS ${ZSTD_ROOT} PATH_SUFFIXES "lib")
+FIND_PATH(ZSTD_INCLUDE_DIR zstd.h HINTS ${ZSTD_ROOT} PATH_SUFFIXES "include")
+
+IF (ZSTD_INCLUDE_DIR AND ZSTD_LIBRARY)
+   SET(ZSTD_FOUND TRUE)
+ENDIF (ZSTD_INCLUDE_DIR AND ZSTD_LIBRARY)
+
+
+IF (ZSTD_FOUND)
+   IF (NOT ZSTD_FIND_QUIETLY)
+      MESSAGE(STATUS "Found Zstd: ${ZSTD_LIBRARY}")
+   ENDIF (NOT ZSTD_FIND_QUIETLY)
+ELSE (ZSTD_FOUND)
+   IF (ZSTD_FIND_REQUIRED)
+      MESSAGE(WARNING "Could not find Zstd")
+   ENDIF (ZSTD_FIND_REQUIRED)
+ENDIF (ZSTD_FOUND)
@@ -18,8 +18,34 @@
 #include <argtable2.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <glob.h>
+#include <time.h>
 #include <fann.h>
 #include "cmd.h"
+#include "net.h"
+#include "cache.h"
+#include "parse.h"
+#include "compress.h"
+#include "profile.h"
+#include "cascade.h"
+#include "dist.h"
+#include "learn.h"
+#include "crossval.h"
+#include "dataset.h"
+#include "stats.h"
+#include "metrics.h"
+#include "grow.h"
+#include "leaderboard.h"
+#include "batch.h"
+#include "tune.h"
+#include "threads.h"
+#include "arena.h"
+#include "pipeline.h"
 
 #define CMD_HEADER(pname,...)\
     const char *PROGNAME = pname; int NERRORS, EXITCODE = 0;\
@@ -72,10 +98,18 @@
 
 #define WEIGHTS_INIT\
     if (aInitW->count > 0) {\
-        struct fann_train_data *training_data = fann_read_train_from_fd(stdin, "STDIN");\
-        assert(training_data != NULL);\
-        fann_init_weights(ann, training_data);\
-        fann_destroy_train(training_data);\
+        struct stats stats;\
+        struct parse_src *src = parse_open_stream(stdin, "STDIN");\
+        int r = (src != NULL) ? stats_compute(src, 0, &stats) : -1;\
+        parse_close(src);\
+        if (r == 0) {\
+            r = stats_init_weights(ann, &stats);\
+            stats_free(&stats);\
+        }\
+        if (r != 0) {\
+            fann_destroy(ann);\
+            CMD_ABORT;\
+        }\
     } else {\
         fann_type minw = (fann_type) -0.1, maxw = (fann_type) 0.1;\
         if (aMinRandomW->count > 0) minw = (fann_type) aMinRandomW->dval[0];\
@@ -101,11 +135,19 @@ static void *xmalloc(size_t sz)
 #define xfree free
 
 /**
- * Dump ANN to stdout
+ * Dump ANN to stdout, compressed as set by $FANNC_COMPRESS
  * @param ann ANN
  */
 static void dump_ann(struct fann *ann) {
-    fann_save_internal_fd(ann, stdout, "STDOUT", 0);
+    enum compress_format format = COMPRESS_NONE;
+    int level = -1;
+    const char *spec = getenv(COMPRESS_ENV);
+
+    if (spec != NULL && *spec != '\0' && compress_parse_spec(spec, &format, &level) != 0) {
+        fprintf(stderr, "Ignoring %s, writing the ANN uncompressed\n", COMPRESS_ENV);
+        format = COMPRESS_NONE;
+    }
+    compress_save_ann(ann, stdout, "STDOUT", format, level);
 }
 
 /**
@@ -172,6 +214,50 @@ static enum fann_stopfunc_enum decode_stop_function(const char *name)
     return (enum fann_stopfunc_enum) -1;
 }
 
+/**
+ * Decode activation mode from name
+ * @param name Name
+ * @return Activation mode or -1 if undefined
+ */
+static enum net_activation_mode decode_activation_mode(const char *name)
+{
+    int i;
+    for (i = 0; i < sizeof(NET_ACTIVATION_MODE_NAMES) / sizeof(NET_ACTIVATION_MODE_NAMES[0]); i++) {
+        if (strcmp(NET_ACTIVATION_MODE_NAMES[i], name) == 0) {            
+            return (enum net_activation_mode) i;
+        }
+    }
+    return (enum net_activation_mode) -1;
+}
+
+/**
+ * Decode the --format argument of data commands
+ * @param aFormat Argument
+ * @param format Output format, or -1 if the argument was not given
+ * @return 0 on success, -1 if the format is unknown (reported)
+ */
+static int decode_data_format(struct arg_str *aFormat, int *format)
+{
+    int i;
+    *format = -1;
+    if (aFormat->count == 0) return 0;
+    for (i = 0; i < sizeof(DATASET_FORMAT_NAMES) / sizeof(DATASET_FORMAT_NAMES[0]); i++) {
+        if (strcmp(DATASET_FORMAT_NAMES[i], aFormat->sval[0]) == 0) {
+            *format = i;
+            return 0;
+        }
+    }
+    fprintf(stderr, "Unknown data format: %s\n", aFormat->sval[0]);
+    return -1;
+}
+
+/** Random seed given by the --seed argument of data commands, or a different one on each run */
+static uint64_t data_seed(struct arg_int *aSeed)
+{
+    if (aSeed->count > 0) return (uint64_t) (unsigned int) aSeed->ival[0];
+    return ((uint64_t) time(NULL) << 20) ^ (uint64_t) getpid();
+}
+
 /** Create standard network */
 static int cmd_create_std(int argc, char **argv)
 {
@@ -310,9 +396,9 @@ static int cmd_set_weights(int argc, char **argv)
     
     struct fann *ann;
     if (aFile->count > 0) {
-        ann = fann_create_from_file(aFile->filename[0]);
+        ann = compress_load_ann(aFile->filename[0]);
     } else {
-        ann = fann_create_from_fd(stdin, "STDIN");
+        ann = compress_load_ann(NULL);
     }
     
     assert(ann != NULL);
@@ -370,9 +456,9 @@ static int cmd_get_params(int argc, char **argv)
     
     struct fann *ann;
     if (aFile->count > 0) {
-        ann = fann_create_from_file(aFile->filename[0]);
+        ann = compress_load_ann(aFile->filename[0]);
     } else {
-        ann = fann_create_from_fd(stdin, "STDIN");
+        ann = compress_load_ann(NULL);
     }
     
     assert(ann != NULL);
@@ -558,9 +644,9 @@ static int cmd_setup_training(int argc, char **argv)
     
     struct fann *ann;
     if (aFile->count > 0) {
-        ann = fann_create_from_file(aFile->filename[0]);
+        ann = compress_load_ann(aFile->filename[0]);
     } else {
-        ann = fann_create_from_fd(stdin, "STDIN");
+        ann = compress_load_ann(NULL);
     }
     
     assert(ann != NULL);
@@ -744,22 +830,50 @@ static int cmd_train(int argc, char **argv)
     struct arg_int  *aReportPeriod = arg_int0(NULL, "report-period", "int", "the number of epochs between printing a status report to stderr. In cascade training, this parameter sets the number of neurons to create between reports. If omitted, no reports should be printed.");
     struct arg_dbl  *aDesiredError = arg_dbl1(NULL, "target-error", "float", "the desired target error");
     struct arg_file *aReport = arg_file0(NULL, "report-file", "filepath", "path to report file. If omitted, STDERR is used.");
-    
-    CMD_PARSE(aFile, aTrainingFile, aCascade, aMaxEpochs, aReportPeriod, aDesiredError, aReport);    
+    struct arg_int  *aThreads = arg_int0(NULL, "threads", "int", "in cascade training, number of threads training the candidate neurons. 0 means one per processor. If omitted, 1 is taken.");
+    struct arg_int  *aWorkers = arg_int0(NULL, "workers", "int", "number of local worker processes, each training on a slice of the training data. The parameters of all the workers are averaged every --sync-period epochs.");
+    struct arg_str  *aListen = arg_str0(NULL, "listen", "address", "address where remote workers connect (see the worker command): HOST:PORT or unix:PATH");
+    struct arg_int  *aRemoteWorkers = arg_int0(NULL, "remote-workers", "int", "number of remote workers to wait for (requires --listen)");
+    struct arg_int  *aSyncPeriod = arg_int0(NULL, "sync-period", "int", "number of epochs workers train between parameter averages. If omitted, 1 is taken.");
+    struct arg_lit  *aShuffle = arg_lit0(NULL, "shuffle", "shuffle the training samples before every epoch");
+    
+    CMD_PARSE(aFile, aTrainingFile, aCascade, aMaxEpochs, aReportPeriod, aDesiredError, aReport, aThreads, aWorkers, aListen, aRemoteWorkers, aSyncPeriod, aShuffle);    
+    
+    unsigned int nLocal = (aWorkers->count > 0 && aWorkers->ival[0] > 0) ? (unsigned int) aWorkers->ival[0] : 0;
+    unsigned int nRemote = (aRemoteWorkers->count > 0 && aRemoteWorkers->ival[0] > 0) ? (unsigned int) aRemoteWorkers->ival[0] : 0;
+    if ((aListen->count > 0) != (nRemote > 0)) {
+        fprintf(stderr, "--listen and --remote-workers must be given together\n");
+        CMD_ABORT;
+    }
+    if (aCascade->count > 0 && nLocal + nRemote > 0) {
+        fprintf(stderr, "Workers cannot be used in cascade training\n");
+        CMD_ABORT;
+    }
+    if (aShuffle->count > 0 && (aCascade->count > 0 || nLocal + nRemote > 0)) {
+        fprintf(stderr, "--shuffle cannot be used in cascade training or with workers\n");
+        CMD_ABORT;
+    }
     
     struct fann *ann;
     if (aFile->count > 0) {
-        ann = fann_create_from_file(aFile->filename[0]);
+        ann = compress_load_ann(aFile->filename[0]);
     } else {
-        ann = fann_create_from_fd(stdin, "STDIN");
+        ann = compress_load_ann(NULL);
     }
     
     assert(ann != NULL);
     
+    struct arena_data *trainingData = parse_train_file(aTrainingFile->filename[0], 0);
+    if (trainingData == NULL) CMD_ERR(ERR);
+    stats_scale_data(ann, &trainingData->data);
+    
     FILE *reportFP = stderr;
     if (aReport->count > 0) {
         FILE *fp = fopen(aReport->filename[0], "w");
-        if (fp == NULL) CMD_ERR(ERR);
+        if (fp == NULL) {
+            arena_destroy(trainingData);
+            CMD_ERR(ERR);
+        }
         reportFP = fp;
     } 
     
@@ -769,15 +883,30 @@ static int cmd_train(int argc, char **argv)
     fann_set_callback(ann, cmd_train_callback);
         
     //Train
-    if (aCascade->count > 0) {
+    if (nLocal + nRemote > 0) {
+        struct dist_params params = {aMaxEpochs->ival[0], (aReportPeriod->count == 0) ? 0 : aReportPeriod->ival[0],
+                (aSyncPeriod->count == 0 || aSyncPeriod->ival[0] <= 0) ? 1 : aSyncPeriod->ival[0], (float) aDesiredError->dval[0], reportFP};
+        int listenFd = -1;
+        if (aListen->count > 0) {
+            listenFd = dist_listen(aListen->sval[0]);
+        }
+        if ((aListen->count > 0 && listenFd < 0) || dist_train(ann, &trainingData->data, nLocal, listenFd, nRemote, &params) != 0) {
+            EXITCODE = 1;
+        }
+        if (listenFd >= 0) close(listenFd);
+    } else if (aCascade->count > 0) {
         unsigned int maxNeurons = aMaxEpochs->ival[0];
         unsigned int neuronsBetweenReports = (aReportPeriod->count == 0) ? 0 : aReportPeriod->ival[0];
-        fann_cascadetrain_on_file(ann, aTrainingFile->filename[0], maxNeurons, neuronsBetweenReports, (float) aDesiredError->dval[0]);
+        unsigned int nThreads = (aThreads->count == 0 || aThreads->ival[0] < 0) ? 1 : (unsigned int) aThreads->ival[0];
+        ann = cascade_train_on_data(ann, &trainingData->data, maxNeurons, neuronsBetweenReports, (float) aDesiredError->dval[0], nThreads);
     } else {
-        fann_train_on_file(ann, aTrainingFile->filename[0], aMaxEpochs->ival[0], (aReportPeriod->count == 0) ? 0 : aReportPeriod->ival[0], (float) aDesiredError->dval[0]);     
+        arena_train(ann, trainingData, aMaxEpochs->ival[0], (aReportPeriod->count == 0) ? 0 : aReportPeriod->ival[0], (float) aDesiredError->dval[0],
+                aShuffle->count > 0);
     }
     
-    dump_ann(ann);
+    if (EXITCODE == 0) dump_ann(ann);
+    
+    arena_destroy(trainingData);
     
     if (reportFP != stderr) fclose(reportFP);
     
@@ -787,59 +916,703 @@ ERR:
     CMD_FOOTER;
 }
 
+/** Train as a worker of a distributed training */
+static int cmd_worker(int argc, char **argv)
+{
+    CMD_HEADER(
+            "worker",            
+            "Serve a coordinator started with train --listen. The worker connects to the coordinator, receives the ANN and trains it on its shard of data, sending the resulting parameters back to be averaged with the ones of the other workers. It exits when training ends."
+            );
+    
+    struct arg_str  *aConnect = arg_str1(NULL, "connect", "address", "address of the coordinator: HOST:PORT or unix:PATH");
+    struct arg_file *aTrainingFile = arg_file1(NULL, "training-data", "filepath", "path to the training data file of this worker.");
+    CMD_PARSE(aConnect, aTrainingFile);    
+    
+    struct arena_data *trainingData = parse_train_file(aTrainingFile->filename[0], 0);
+    if (trainingData == NULL) CMD_ABORT;
+    
+    int fd = dist_connect(aConnect->sval[0]);
+    if (fd < 0 || dist_worker(fd, &trainingData->data, 1) != 0) {
+        EXITCODE = 1;
+    }
+    
+    if (fd >= 0) close(fd);
+    arena_destroy(trainingData);
+    
+    CMD_FOOTER;
+}
+
+/** Cross-validate an ANN */
+static int cmd_crossval(int argc, char **argv)
+{
+    CMD_HEADER(
+            "crossval",            
+            "k-fold cross-validation of an ANN. The data set is split into k folds. For each fold, a copy of the ANN is trained on the other folds and tested on it. Folds are trained concurrently. "
+            "The command prints to STDOUT the training and test results of each fold and the aggregate MSE and bit fail count of all the test samples."
+            );
+    
+    struct arg_file *aFile = arg_file0(NULL, "ann", "filepath", "path to the initial ANN file. If unspecified, read from STDIN");
+    struct arg_file *aDataFile = arg_file1(NULL, "data", "filepath", "path to the data file.");
+    struct arg_int  *aFolds = arg_int0(NULL, "folds", "int", "number of folds. If omitted, 10 is taken.");
+    struct arg_lit  *aShuffle = arg_lit0(NULL, "shuffle", "shuffle the samples before splitting them into folds. Otherwise each fold holds consecutive samples");
+    struct arg_int  *aMaxEpochs = arg_int1(NULL, "max-epochs", "int", "maximum number of epochs each fold is trained.");
+    struct arg_dbl  *aDesiredError = arg_dbl1(NULL, "target-error", "float", "the desired target error");
+    struct arg_int  *aThreads = arg_int0(NULL, "threads", "int", "number of folds trained concurrently. If omitted or 0, one per processor.");
+    struct arg_file *aBest = arg_file0(NULL, "best", "filepath", "path where the network of the fold with the lowest test MSE is written");
+    CMD_PARSE(aFile, aDataFile, aFolds, aShuffle, aMaxEpochs, aDesiredError, aThreads, aBest);    
+    
+    unsigned int k = (aFolds->count > 0 && aFolds->ival[0] > 0) ? (unsigned int) aFolds->ival[0] : 10;
+    unsigned int nThreads = (aThreads->count == 0 || aThreads->ival[0] < 0) ? 0 : (unsigned int) aThreads->ival[0];
+    
+    struct fann *ann;
+    if (aFile->count > 0) {
+        ann = compress_load_ann(aFile->filename[0]);
+    } else {
+        ann = compress_load_ann(NULL);
+    }
+    
+    assert(ann != NULL);
+    
+    struct arena_data *data = parse_train_file(aDataFile->filename[0], 0);
+    if (data == NULL) CMD_ERR(ERR);
+    stats_scale_data(ann, &data->data);
+    
+    struct crossval_fold *folds = (struct crossval_fold *) calloc(k, sizeof(struct crossval_fold));
+    if (folds == NULL || crossval_run(ann, data, k, aShuffle->count > 0, aMaxEpochs->ival[0], (float) aDesiredError->dval[0], nThreads, folds) != 0) {
+        free(folds);
+        arena_destroy(data);
+        CMD_ERR(ERR);
+    }
+    
+    //Aggregate: MSE of all test samples, spread of the fold MSEs
+    double sum = 0, mean = 0, var = 0;
+    unsigned int samples = 0, bitFail = 0, best = 0;
+    for (unsigned int i = 0; i < k; i++) {
+        sum += (double) folds[i].testMSE * folds[i].testSamples;
+        samples += folds[i].testSamples;
+        bitFail += folds[i].bitFail;
+        mean += folds[i].testMSE / (double) k;
+        if (folds[i].testMSE < folds[best].testMSE) best = i;
+    }
+    for (unsigned int i = 0; i < k; i++) {
+        var += (folds[i].testMSE - mean) * (folds[i].testMSE - mean) / (double) k;
+    }
+    
+    printf("%-6s %13s %12s %12s %12s %9s\n", "Fold", "Train samples", "Test samples", "Train MSE", "Test MSE", "Bit fail");
+    for (unsigned int i = 0; i < k; i++) {
+        printf("%-6u %13u %12u %12.6f %12.6f %9u\n", i + 1, folds[i].trainSamples, folds[i].testSamples,
+                folds[i].trainMSE, folds[i].testMSE, folds[i].bitFail);
+    }
+    printf("%-6s %13s %12u %12s %12.6f %9u\n", "All", "", samples, "", sum / samples, bitFail);
+    printf("\nFold test MSE: mean %.6f, std. dev. %.6f. Best fold: %u\n", mean, sqrt(var), best + 1);
+    
+    if (aBest->count > 0 && fann_save(folds[best].ann, aBest->filename[0]) != 0) {
+        fprintf(stderr, "Could not write %s\n", aBest->filename[0]);
+        EXITCODE = 1;
+    }
+    
+    for (unsigned int i = 0; i < k; i++) fann_destroy(folds[i].ann);
+    free(folds);
+    arena_destroy(data);
+    
+ERR:
+    fann_destroy(ann);
+    
+    CMD_FOOTER;
+}
+
+#define DATA_FORMAT_HELP "output format: text (FANN data file) or binary. If omitted, the format of the input is kept"
+#define DATA_SEED_HELP   "random seed. If omitted, a different one is used on each run"
+
+/** Shuffle a data file */
+static int cmd_data_shuffle(int argc, char **argv)
+{
+    CMD_HEADER(
+            "data_shuffle",            
+            "Shuffle the samples of a data file. Files larger than --memory are scattered at random into temporary files which are shuffled one by one, so files of any size can be shuffled. The output may be the input file."
+            );
+    
+    struct arg_file *aInput = arg_file1(NULL, "input", "filepath", "path to the input data file.");
+    struct arg_file *aOutput = arg_file1(NULL, "output", "filepath", "path to the output data file.");
+    struct arg_int  *aMemory = arg_int0(NULL, "memory", "int", "memory used to shuffle, in MB. If omitted, 256 is taken.");
+    struct arg_file *aTempDir = arg_file0(NULL, "temp-dir", "dirpath", "directory for temporary files. If omitted, $TMPDIR or /tmp is used.");
+    struct arg_int  *aSeed = arg_int0(NULL, "seed", "int", DATA_SEED_HELP);
+    struct arg_str  *aFormat = arg_str0(NULL, "format", "string", DATA_FORMAT_HELP);
+    CMD_PARSE(aInput, aOutput, aMemory, aTempDir, aSeed, aFormat);    
+    
+    int format;
+    if (decode_data_format(aFormat, &format) != 0) CMD_ABORT;
+    size_t memory = (size_t) ((aMemory->count > 0 && aMemory->ival[0] > 0) ? aMemory->ival[0] : 256) << 20;
+    
+    if (dataset_shuffle(aInput->filename[0], aOutput->filename[0], format, memory,
+            (aTempDir->count > 0) ? aTempDir->filename[0] : NULL, data_seed(aSeed)) != 0) {
+        EXITCODE = 1;
+    }
+    
+    CMD_FOOTER;
+}
+
+/** Split a data file */
+static int cmd_data_split(int argc, char **argv)
+{
+    CMD_HEADER(
+            "data_split",            
+            "Split a data file into several ones, such as training, validation and test sets. Give an --output for each part and a --fraction of the samples for each of them, in the same order. "
+            "When the last --fraction is omitted, the last part gets the remaining samples; otherwise fractions are taken as relative sizes.",
+            "Parts hold consecutive samples unless --random is given, in which case samples are spread at random among the parts, which still get the requested sizes."
+            );
+    
+    struct arg_file *aInput = arg_file1(NULL, "input", "filepath", "path to the input data file.");
+    struct arg_file *aOutputs = arg_filen(NULL, "output", "filepath", 2, argc+1, "path to an output data file. Repeat for each part.");
+    struct arg_dbl  *aFractions = arg_dbln(NULL, "fraction", "float", 1, argc+1, "fraction of the samples of a part. Repeat for each part.");
+    struct arg_lit  *aRandom = arg_lit0(NULL, "random", "spread samples at random among the parts");
+    struct arg_int  *aSeed = arg_int0(NULL, "seed", "int", DATA_SEED_HELP);
+    struct arg_str  *aFormat = arg_str0(NULL, "format", "string", DATA_FORMAT_HELP);
+    CMD_PARSE(aInput, aOutputs, aFractions, aRandom, aSeed, aFormat);    
+    
+    int format;
+    if (decode_data_format(aFormat, &format) != 0) CMD_ABORT;
+    
+    if (dataset_split(aInput->filename[0], (unsigned int) aOutputs->count, aOutputs->filename, aFractions->dval,
+            (unsigned int) aFractions->count, aRandom->count > 0, format, data_seed(aSeed)) != 0) {
+        EXITCODE = 1;
+    }
+    
+    CMD_FOOTER;
+}
+
+/** Subsample a data file */
+static int cmd_data_subsample(int argc, char **argv)
+{
+    CMD_HEADER(
+            "data_subsample",            
+            "Select a random subset of the samples of a data file, keeping their order. With --stratify, every class keeps its share of the samples. "
+            "The class of a sample is the index of its largest output or, for single output data, the output value."
+            );
+    
+    struct arg_file *aInput = arg_file1(NULL, "input", "filepath", "path to the input data file.");
+    struct arg_file *aOutput = arg_file1(NULL, "output", "filepath", "path to the output data file.");
+    struct arg_dbl  *aFraction = arg_dbl0(NULL, "fraction", "float", "fraction of the samples to select.");
+    struct arg_int  *aSamples = arg_int0(NULL, "samples", "int", "number of samples to select.");
+    struct arg_lit  *aStratify = arg_lit0(NULL, "stratify", "keep the share of every class");
+    struct arg_int  *aSeed = arg_int0(NULL, "seed", "int", DATA_SEED_HELP);
+    struct arg_str  *aFormat = arg_str0(NULL, "format", "string", DATA_FORMAT_HELP);
+    CMD_PARSE(aInput, aOutput, aFraction, aSamples, aStratify, aSeed, aFormat);    
+    
+    int format;
+    if (decode_data_format(aFormat, &format) != 0) CMD_ABORT;
+    if ((aFraction->count > 0) == (aSamples->count > 0) || (aSamples->count > 0 && aSamples->ival[0] <= 0)) {
+        fprintf(stderr, "Either --fraction or a positive --samples must be given\n");
+        CMD_ABORT;
+    }
+    
+    if (dataset_subsample(aInput->filename[0], aOutput->filename[0], (aFraction->count > 0) ? aFraction->dval[0] : 0,
+            (aSamples->count > 0) ? (unsigned int) aSamples->ival[0] : 0, aStratify->count > 0, format, data_seed(aSeed)) != 0) {
+        EXITCODE = 1;
+    }
+    
+    CMD_FOOTER;
+}
+
+/** Concatenate data files */
+static int cmd_data_merge(int argc, char **argv)
+{
+    CMD_HEADER(
+            "data_merge",            
+            "Concatenate data files, which may be in different formats. All of them must have the same number of inputs and outputs."
+            );
+    
+    struct arg_file *aOutput = arg_file1(NULL, "output", "filepath", "path to the output data file.");
+    struct arg_str  *aFormat = arg_str0(NULL, "format", "string", "output format: text (FANN data file) or binary. If omitted, the format of the first input is used");
+    struct arg_file *aInputs = arg_filen(NULL, NULL, "filepath", 1, argc+1, "paths to the input data files.");
+    CMD_PARSE(aOutput, aFormat, aInputs);    
+    
+    int format;
+    if (decode_data_format(aFormat, &format) != 0) CMD_ABORT;
+    
+    if (dataset_merge((unsigned int) aInputs->count, aInputs->filename, aOutput->filename[0], format) != 0) {
+        EXITCODE = 1;
+    }
+    
+    CMD_FOOTER;
+}
+
+/** Print column statistics of a data file */
+static int cmd_stats(int argc, char **argv)
+{
+    CMD_HEADER(
+            "stats",            
+            "Print the minimum, maximum, mean and standard deviation of every input and output of a data file. The file is read once, by several threads, without being held in memory."
+            );
+    
+    struct arg_file *aDataFile = arg_file1(NULL, "data", "filepath", "path to the data file.");
+    struct arg_int  *aThreads = arg_int0(NULL, "threads", "int", "number of threads. If omitted or 0, one per processor.");
+    struct arg_lit  *aJson = arg_lit0(NULL, "json", "print the statistics as JSON");
+    CMD_PARSE(aDataFile, aThreads, aJson);    
+    
+    struct stats stats;
+    unsigned int nThreads = (aThreads->count == 0 || aThreads->ival[0] < 0) ? 0 : (unsigned int) aThreads->ival[0];
+    if (stats_file(aDataFile->filename[0], nThreads, &stats) != 0) CMD_ABORT;
+    
+    unsigned int i;
+    if (aJson->count > 0) {
+        printf("{\n  \"samples\": %u,\n  \"columns\": [\n", stats.numData);
+        for (i = 0; i < stats.numInput + stats.numOutput; i++) {
+            const struct stats_column *c = &stats.columns[i];
+            printf("    {\"type\": \"%s\", \"index\": %u, \"min\": %e, \"max\": %e, \"mean\": %e, \"deviation\": %e}%s\n",
+                    (i < stats.numInput) ? "input" : "output", (i < stats.numInput) ? i : i - stats.numInput,
+                    c->min, c->max, c->mean, stats_deviation(c), (i + 1 < stats.numInput + stats.numOutput) ? "," : "");
+        }
+        printf("  ]\n}\n");
+    } else {
+        printf("%-7s %6s %14s %14s %14s %14s\n", "Type", "Index", "Min", "Max", "Mean", "Std.dev.");
+        for (i = 0; i < stats.numInput + stats.numOutput; i++) {
+            const struct stats_column *c = &stats.columns[i];
+            printf("%-7s %6u %14g %14g %14g %14g\n", (i < stats.numInput) ? "input" : "output", (i < stats.numInput) ? i : i - stats.numInput,
+                    c->min, c->max, c->mean, stats_deviation(c));
+        }
+    }
+    
+    stats_free(&stats);
+    
+    CMD_FOOTER;
+}
+
+/** Set scaling parameters */
+static int cmd_set_scaling(int argc, char **argv)
+{
+    CMD_HEADER(
+            "set_scaling",            
+            "Set the scaling parameters of an ANN from the statistics of its training data. The resulting ANN is dumped to STDOUT.",
+            "Inputs and outputs are scaled as FANN does: the mean minus one standard deviation of each one maps to the new minimum and the mean plus one standard deviation maps to the new maximum. "
+            "ANNs with scaling parameters get their data scaled by train, crossval, worker, learn and test, and their inputs and outputs scaled and descaled by run."
+            );
+    
+    struct arg_file *aFile = arg_file0(NULL, "ann", "filepath", "path to the ANN file. If unspecified, read from STDIN");
+    struct arg_file *aDataFile = arg_file0(NULL, "data", "filepath", "path to the training data file.");
+    struct arg_dbl  *aInputMin = arg_dbl0(NULL, "input-min", "float", "new minimum of the inputs. If omitted, -1 is taken.");
+    struct arg_dbl  *aInputMax = arg_dbl0(NULL, "input-max", "float", "new maximum of the inputs. If omitted, 1 is taken.");
+    struct arg_dbl  *aOutputMin = arg_dbl0(NULL, "output-min", "float", "new minimum of the outputs. If omitted, -1 is taken.");
+    struct arg_dbl  *aOutputMax = arg_dbl0(NULL, "output-max", "float", "new maximum of the outputs. If omitted, 1 is taken.");
+    struct arg_int  *aThreads = arg_int0(NULL, "threads", "int", "number of threads reading the data. If omitted or 0, one per processor.");
+    struct arg_lit  *aClear = arg_lit0(NULL, "clear", "remove the scaling parameters instead");
+    CMD_PARSE(aFile, aDataFile, aInputMin, aInputMax, aOutputMin, aOutputMax, aThreads, aClear);    
+    
+    if ((aDataFile->count > 0) == (aClear->count > 0)) {
+        fprintf(stderr, "Either --data or --clear must be given\n");
+        CMD_ABORT;
+    }
+    
+    struct fann *ann;
+    if (aFile->count > 0) {
+        ann = compress_load_ann(aFile->filename[0]);
+    } else {
+        ann = compress_load_ann(NULL);
+    }
+    
+    assert(ann != NULL);
+    
+    if (aClear->count > 0) {
+        fann_clear_scaling_params(ann);
+    } else {
+        struct stats stats;
+        unsigned int nThreads = (aThreads->count == 0 || aThreads->ival[0] < 0) ? 0 : (unsigned int) aThreads->ival[0];
+        if (stats_file(aDataFile->filename[0], nThreads, &stats) != 0) CMD_ERR(ERR);
+        int r = stats_set_scaling(ann, &stats,
+                (aInputMin->count > 0) ? (float) aInputMin->dval[0] : -1.0f, (aInputMax->count > 0) ? (float) aInputMax->dval[0] : 1.0f,
+                (aOutputMin->count > 0) ? (float) aOutputMin->dval[0] : -1.0f, (aOutputMax->count > 0) ? (float) aOutputMax->dval[0] : 1.0f);
+        stats_free(&stats);
+        if (r != 0) CMD_ERR(ERR);
+    }
+    
+    dump_ann(ann);
+    
+ERR:
+    fann_destroy(ann);
+    
+    CMD_FOOTER;
+}
+
+/** Grow an ANN */
+static int cmd_grow(int argc, char **argv)
+{
+    CMD_HEADER(
+            "grow",            
+            "Add neurons to the hidden layers of a layered ANN, or insert a new hidden layer, keeping every weight so that the ANN computes nearly the same function and training can go on where it stopped. The resulting ANN is dumped to STDOUT.",
+            "New neurons of a hidden layer are copies of existing ones, chosen at random, which share their outgoing weights; a little noise tells them apart. "
+            "An inserted layer has as many neurons as the previous one, each of them passing one neuron of the previous layer through."
+            );
+    
+    struct arg_file *aFile = arg_file0(NULL, "ann", "filepath", "path to the ANN file. If unspecified, read from STDIN");
+    struct arg_str  *aAdd = arg_strn(NULL, "add", "layer:count", 0, argc+1, "add count neurons to a hidden layer. Layers are numbered from 0 (input layer). Repeat for several layers.");
+    struct arg_int  *aInsert = arg_int0(NULL, "insert", "layer", "insert a hidden layer before this layer (1 for the first hidden layer)");
+    struct arg_str  *aActivation = arg_str0(NULL, "activation", "string", "activation function of the inserted layer: FANN_SIGMOID_SYMMETRIC (default), FANN_ELLIOT_SYMMETRIC, FANN_LINEAR_PIECE_SYMMETRIC or FANN_LINEAR");
+    struct arg_dbl  *aSteepness = arg_dbl0(NULL, "steepness", "float", "activation steepness of the inserted layer. If omitted, 1 is taken.");
+    struct arg_dbl  *aEpsilon = arg_dbl0(NULL, "epsilon", "float", "weights of the inserted layer. The smaller, the closer to the original function. If omitted, 0.01 is taken (1 for FANN_LINEAR).");
+    struct arg_dbl  *aNoise = arg_dbl0(NULL, "noise", "float", "amplitude of the noise added to the weights of new neurons. If omitted, 0.01 is taken.");
+    CMD_PARSE(aFile, aAdd, aInsert, aActivation, aSteepness, aEpsilon, aNoise);    
+    
+    struct grow_spec spec = {
+        .add = NULL,
+        .insert = 0,
+        .activation = FANN_SIGMOID_SYMMETRIC,
+        .steepness = (aSteepness->count > 0) ? (fann_type) aSteepness->dval[0] : 1,
+        .noise = (aNoise->count > 0) ? (fann_type) aNoise->dval[0] : (fann_type) 0.01
+    };
+    
+    if (aActivation->count > 0) {
+        spec.activation = decode_activation_func(aActivation->sval[0]);
+        if (spec.activation == -1) {
+            fprintf(stderr, "Unknown activation function: %s\n", aActivation->sval[0]);
+            CMD_ABORT;
+        }
+    }
+    spec.epsilon = (aEpsilon->count > 0) ? (fann_type) aEpsilon->dval[0] : (spec.activation == FANN_LINEAR) ? 1 : (fann_type) 0.01;
+    if (aInsert->count > 0) {
+        if (aInsert->ival[0] <= 0) {
+            fprintf(stderr, "A layer can only be inserted before a layer above the input layer\n");
+            CMD_ABORT;
+        }
+        spec.insert = (unsigned int) aInsert->ival[0];
+    }
+    
+    struct fann *ann;
+    if (aFile->count > 0) {
+        ann = compress_load_ann(aFile->filename[0]);
+    } else {
+        ann = compress_load_ann(NULL);
+    }
+    
+    assert(ann != NULL);
+    
+    unsigned int numLayers = fann_get_num_layers(ann);
+    struct fann *grown = NULL;
+    int i;
+    spec.add = (unsigned int *) xmalloc(sizeof(unsigned int) * numLayers);
+    memset(spec.add, 0, sizeof(unsigned int) * numLayers);
+    for (i = 0; i < aAdd->count; i++) {
+        unsigned int layer, count;
+        char end;
+        if (sscanf(aAdd->sval[i], "%u:%u%c", &layer, &count, &end) != 2) {
+            fprintf(stderr, "Invalid --add: %s. Expected layer:count\n", aAdd->sval[i]);
+            CMD_ERR(ERR);
+        }
+        if (layer >= numLayers) {
+            fprintf(stderr, "Invalid --add: %s. The ANN has %u layers\n", aAdd->sval[i], numLayers);
+            CMD_ERR(ERR);
+        }
+        spec.add[layer] += count;
+    }
+    
+    if (grow_check(ann, &spec) != 0) CMD_ERR(ERR);
+    grown = grow_network(ann, &spec);
+    if (grown == NULL) CMD_ERR(ERR);
+    
+    dump_ann(grown);
+    
+ERR:
+    fann_destroy(ann);
+    if (grown != NULL) fann_destroy(grown);
+    xfree(spec.add);
+    
+    CMD_FOOTER;
+}
+
+/** Set by SIGINT and SIGTERM to end online learning */
+static volatile sig_atomic_t learnStop = 0;
+
+static void on_learn_stop(int sig)
+{
+    (void) sig;
+    learnStop = 1;
+}
+
+/** Learn online from a stream of samples */
+static int cmd_learn(int argc, char **argv)
+{
+    CMD_HEADER(
+            "learn",            
+            "Train an ANN online. Samples (input values followed by output values, as in the body of a data file) are read from STDIN or from connections to --listen, and the ANN is updated incrementally with each of them. "
+            "Snapshots of the ANN are published periodically to the snapshot file, which is replaced atomically. Training ends when STDIN is exhausted or on SIGINT or SIGTERM, after publishing a last snapshot.",
+            "Samples wait in a bounded queue for the update loop. When samples arrive faster than they can be learned and the queue is full, the oldest queued ones are dropped, so producers are never blocked."
+            );
+    
+    struct arg_file *aFile = arg_file1(NULL, "ann", "filepath", "path to the ANN file");
+    struct arg_str  *aListen = arg_str0(NULL, "listen", "address", "address where producers connect to send samples: HOST:PORT or unix:PATH. If omitted, samples are read from STDIN");
+    struct arg_file *aSnapshot = arg_file1(NULL, "snapshot", "filepath", "path of the published snapshots");
+    struct arg_str  *aSnapshotFormat = arg_str0(NULL, "snapshot-format", "string", "format of the snapshots: text (FANN network file, default) or image (network image, see the run command)");
+    struct arg_dbl  *aSnapshotPeriod = arg_dbl0(NULL, "snapshot-period", "float", "seconds between snapshots. 0 publishes only at the end. If omitted, 60 is taken.");
+    struct arg_dbl  *aReportPeriod = arg_dbl0(NULL, "report-period", "float", "seconds between status reports. If omitted, no reports are printed.");
+    struct arg_file *aReport = arg_file0(NULL, "report-file", "filepath", "path to report file. If omitted, STDERR is used.");
+    struct arg_int  *aQueueSize = arg_int0(NULL, "queue-size", "int", "maximum number of queued samples. If omitted, 65536 is taken.");
+    struct arg_int  *aWindow = arg_int0(NULL, "window", "int", "number of recent samples the reported MSE is computed on. If omitted, 1000 is taken.");
+    CMD_PARSE(aFile, aListen, aSnapshot, aSnapshotFormat, aSnapshotPeriod, aReportPeriod, aReport, aQueueSize, aWindow);    
+    
+    struct learn_params params = {aSnapshot->filename[0], 0, 60, 0, 65536, 1000, stderr, &learnStop};
+    if (aSnapshotFormat->count > 0) {
+        if (strcmp(aSnapshotFormat->sval[0], "image") == 0) {
+            params.snapshotImage = 1;
+        } else if (strcmp(aSnapshotFormat->sval[0], "text") != 0) {
+            fprintf(stderr, "Unknown snapshot format: %s\n", aSnapshotFormat->sval[0]);
+            CMD_ABORT;
+        }
+    }
+    if (aSnapshotPeriod->count > 0 && aSnapshotPeriod->dval[0] >= 0) params.snapshotPeriod = aSnapshotPeriod->dval[0];
+    if (aReportPeriod->count > 0 && aReportPeriod->dval[0] > 0) params.reportPeriod = aReportPeriod->dval[0];
+    if (aQueueSize->count > 0 && aQueueSize->ival[0] > 0) params.queueSize = (unsigned int) aQueueSize->ival[0];
+    if (aWindow->count > 0 && aWindow->ival[0] > 0) params.window = (unsigned int) aWindow->ival[0];
+    
+    struct fann *ann = compress_load_ann(aFile->filename[0]);
+    assert(ann != NULL);
+    
+    int listenFd = -1;
+    if (aListen->count > 0) {
+        listenFd = dist_listen(aListen->sval[0]);
+        if (listenFd < 0) CMD_ERR(ERR);
+    }
+    
+    if (aReport->count > 0) {
+        params.report = fopen(aReport->filename[0], "w");
+        if (params.report == NULL) {
+            fprintf(stderr, "Could not open report file %s\n", aReport->filename[0]);
+            CMD_ERR(ERR);
+        }
+    }
+    
+    signal(SIGINT, on_learn_stop);
+    signal(SIGTERM, on_learn_stop);
+    if (learn_run(ann, listenFd, &params) != 0) EXITCODE = 1;
+    
+    if (params.report != stderr) fclose(params.report);
+    
+ERR:
+    if (listenFd >= 0) close(listenFd);
+    fann_destroy(ann);
+    
+    CMD_FOOTER;
+}
+
+/**
+ * Run either a FANN network or, when it is NULL, a network image. Inputs and
+ * outputs are scaled with the network's scaling parameters, if it has any
+ * @param ann ANN or NULL
+ * @param img Image, used when ann is NULL
+ * @param inputs Input values, scaled in place
+ * @param values Neuron values scratch buffer for the image
+ * @param mode Activation mode of the image
+ * @return Output values
+ */
+static fann_type *run_inputs(struct fann *ann, const struct net_image *img, fann_type *inputs, fann_type *values, enum net_activation_mode mode)
+{
+    fann_type *output;
+    if (ann != NULL) {
+        if (ann->scale_mean_in != NULL) fann_scale_input(ann, inputs);
+        output = fann_run(ann, inputs);
+        if (ann->scale_mean_out != NULL) fann_descale_output(ann, output);
+        return output;
+    }
+    net_scale_input(img, inputs);
+    output = net_run(img, inputs, values, mode);
+    net_descale_output(img, output);
+    return output;
+}
+
+/**
+ * Replace a FANN network by its image, for the features only available to images
+ * @param ann ANN, destroyed and set to NULL on success
+ * @param entry Entry receiving the image
+ * @return 0 on success, -1 if out of memory (reported)
+ */
+static int compile_ann(struct fann **ann, struct cache_entry *entry)
+{
+    entry->owned = net_compile(*ann);
+    if (entry->owned == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        return -1;
+    }
+    entry->image = entry->owned;
+    fann_destroy(*ann);
+    *ann = NULL;
+    return 0;
+}
+
+/**
+ * Print a line of output values to stdout
+ * @param output Output values
+ * @param nOutputs Number of output values
+ */
+static void print_outputs(const fann_type *output, unsigned int nOutputs)
+{
+    char *text = (char *) xmalloc((size_t) PIPELINE_VALUE_CHARS * nOutputs);
+    if (text == NULL) return;
+    fwrite(text, 1, pipeline_format(text, output, nOutputs), stdout);
+    xfree(text);
+}
+
+/**
+ * Decide how an ANN is run: as set by its tuning profile (see the autotune
+ * command), if any, and by the options given, which take precedence. Giving
+ * threads or a batch size alone selects the image engine
+ * @param annPath ANN file, or NULL if it has no profile
+ * @param mode Activation mode the ANN is run with. Profiles tuned in another mode are ignored
+ * @param aEngine Engine option
+ * @param aThreads Threads option
+ * @param aBatchSize Batch size option
+ * @param config Output configuration
+ * @return 0 on success, -1 if an option is invalid (reported)
+ */
+static int tuning_options(const char *annPath, enum net_activation_mode mode, struct arg_str *aEngine, struct arg_int *aThreads, struct arg_int *aBatchSize, struct tune_config *config)
+{
+    config->engine = TUNE_ENGINE_FANN;
+    config->threads = 1;
+    config->batchSize = 1;
+    config->usPerSample = 0;
+    if (annPath != NULL) tune_load(annPath, mode, config);
+    
+    if (aThreads->count > 0 || aBatchSize->count > 0) config->engine = TUNE_ENGINE_IMAGE;
+    if (aEngine->count > 0) {
+        if (strcmp(aEngine->sval[0], TUNE_ENGINE_NAMES[TUNE_ENGINE_FANN]) == 0) {
+            config->engine = TUNE_ENGINE_FANN;
+        } else if (strcmp(aEngine->sval[0], TUNE_ENGINE_NAMES[TUNE_ENGINE_IMAGE]) == 0) {
+            config->engine = TUNE_ENGINE_IMAGE;
+        } else {
+            fprintf(stderr, "Unknown engine: %s\n", aEngine->sval[0]);
+            return -1;
+        }
+    }
+    if (aThreads->count > 0) {
+        if (aThreads->ival[0] < 0) {
+            fprintf(stderr, "Invalid number of threads: %d\n", aThreads->ival[0]);
+            return -1;
+        }
+        config->threads = (aThreads->ival[0] == 0) ? threads_available() : (unsigned int) aThreads->ival[0];
+    }
+    if (aBatchSize->count > 0) {
+        if (aBatchSize->ival[0] <= 0) {
+            fprintf(stderr, "Invalid batch size: %d\n", aBatchSize->ival[0]);
+            return -1;
+        }
+        config->batchSize = (unsigned int) aBatchSize->ival[0];
+    }
+    //FANN runs one row at a time on the calling thread
+    if (config->engine == TUNE_ENGINE_FANN) config->threads = 1;
+    return 0;
+}
+
 /** Run network */
 static int cmd_run(int argc, char **argv)
 {
     CMD_HEADER(
             "run",            
-            "Run an ANN. This command either reads the input values from a file that contains values separated with spaces (using --input-file) or from the command line (using -i option as many times as inputs). The command prints to STDOUT the output values separated with spaces."
+            "Run an ANN. This command either reads the input values from a file that contains values separated with spaces (using --input-file) or from the command line (using -i option as many times as inputs). The command prints to STDOUT the output values separated with spaces.",
+            "An input file may hold several rows of input values, in which case a line of output values is printed for each of them. "
+            "Rows are run in batches, as set by the ANN's tuning profile (see the autotune command) or by --engine, --threads and --batch-size. "
+            "Rows of an input file are parsed, run and written by separate threads at once."
             );
     
-    struct arg_file *aFile = arg_file0(NULL, "ann", "filepath", "path to the ANN file. If unspecified, read from STDIN");
+    struct arg_file *aFile = arg_file0(NULL, "ann", "filepath", "path to the ANN file or network image (see the learn command). If unspecified, read from STDIN");
+    struct arg_lit  *aCache = arg_lit0(NULL, "cache", "load the ANN through the model cache (requires --ann). See the cache command");
     struct arg_file *aInputFile = arg_file0(NULL, "input-file", "filepath", "path to the input file. If omitted input values are read from the command line");
     struct arg_dbl  *aInputValues = arg_dbln("i", NULL, "float", 0, argc+1, "input values");
-    CMD_PARSE(aFile, aInputFile, aInputValues);    
+    struct arg_str  *aActivation = arg_str0(NULL, "activation", "string", "activation mode: exact (default) or fast. fast evaluates sigmoid and gaussian functions with a vectorized approximation of exp() (absolute error below 4e-7)");
+    struct arg_lit  *aStats = arg_lit0(NULL, "stats", "when finished, print row and byte counts, time per phase and latency percentiles as JSON to STDERR");
+    struct arg_str  *aEngine = arg_str0(NULL, "engine", "string", "engine: fann (FANN, one row at a time) or image (network image, in batches shared by threads). If omitted, taken from the tuning profile, or fann");
+    struct arg_int  *aThreads = arg_int0(NULL, "threads", "int", "number of threads sharing each batch of rows (0: one per processor). If omitted, taken from the tuning profile, or 1");
+    struct arg_int  *aBatchSize = arg_int0(NULL, "batch-size", "int", "number of rows run at once. If omitted, taken from the tuning profile, or 1");
+    CMD_PARSE(aFile, aCache, aInputFile, aInputValues, aActivation, aStats, aEngine, aThreads, aBatchSize);    
     
     if (aInputFile->count == 0 && aInputValues->count == 0) {
         fprintf(stderr, "You must specify either a file with input data or pass data through the command line. See --help for further information");
         CMD_ABORT;
     }
     
-    struct fann *ann;
-    if (aFile->count > 0) {
-        ann = fann_create_from_file(aFile->filename[0]);
-    } else {
-        ann = fann_create_from_fd(stdin, "STDIN");
+    if (aCache->count > 0 && aFile->count == 0) {
+        fprintf(stderr, "--cache requires --ann\n");
+        CMD_ABORT;
     }
     
-    assert(ann != NULL);
+    enum net_activation_mode mode = NET_ACTIVATION_EXACT;
+    if (aActivation->count > 0) {
+        mode = decode_activation_mode(aActivation->sval[0]);
+        if (mode == -1) {
+            fprintf(stderr, "Unknown activation mode: %s\n", aActivation->sval[0]);
+            CMD_ABORT;
+        }
+    }
     
-    unsigned int nInputs = fann_get_num_input(ann);
+    struct tune_config tuning;
+    if (tuning_options((aFile->count > 0) ? aFile->filename[0] : NULL, mode, aEngine, aThreads, aBatchSize, &tuning) != 0) CMD_ABORT;
     
-       
-    fann_type *inputs = NULL;
-    if (aInputFile->count > 0) {
-        FILE *fp = fopen(aInputFile->filename[0], "r");
-        if (fp == NULL) {
-            fprintf(stderr, "Could not open input file\n");
-            CMD_ERR(RUN_ERR);
+    struct metrics metrics, *m = NULL;
+    uint64_t t = 0;
+    if (aStats->count > 0) {
+        metrics_init(&metrics);
+        m = &metrics;
+        t = m->start;
+    }
+    
+    struct fann *ann = NULL;
+    struct cache_entry cached = {NULL};
+    unsigned int nInputs, nOutputs;
+    int isImage;
+    if (aCache->count > 0) {
+        if (cache_load(aFile->filename[0], &cached) != 0) {
+            fprintf(stderr, "Could not load ANN from %s\n", aFile->filename[0]);
+            CMD_ABORT;
+        }
+        nInputs = cached.image->numInput;
+        nOutputs = cached.image->numOutput;
+    } else if (aFile->count > 0 && (isImage = cache_map_image(aFile->filename[0], &cached)) != 0) {
+        if (isImage < 0) CMD_ABORT;
+        nInputs = cached.image->numInput;
+        nOutputs = cached.image->numOutput;
+    } else {
+        if (aFile->count > 0) {
+            ann = compress_load_ann(aFile->filename[0]);
+        } else {
+            ann = compress_load_ann(NULL);
         }
+    
+        assert(ann != NULL);
+        nInputs = fann_get_num_input(ann);
+        nOutputs = fann_get_num_output(ann);
         
+        if ((mode != NET_ACTIVATION_EXACT || tuning.engine == TUNE_ENGINE_IMAGE) && compile_ann(&ann, &cached) != 0) {
+            fann_destroy(ann);
+            CMD_ABORT;
+        }
+    }
+    
+    fann_type *inputs = (fann_type *) xmalloc(sizeof(fann_type) * nInputs), *values = NULL;
+    struct batch_runner runner = {NULL};
+    if (inputs == NULL) CMD_ERR(RUN_ERR);
+    if (ann == NULL) {
+        values = (fann_type *) xmalloc(sizeof(fann_type) * cached.image->totalNeurons);
+        if (batch_init(&runner, cached.image, mode, tuning.threads) != 0) {
+            fprintf(stderr, "Out of memory!\n");
+            CMD_ERR(RUN_ERR);
+        }
+    }
+    t = metrics_lap(m, METRICS_LOAD, t);
+    
+    if (aInputFile->count > 0) {
+        struct parse_src *src = parse_open(aInputFile->filename[0]);
+        if (src == NULL) CMD_ERR(RUN_ERR);
+        t = metrics_lap(m, METRICS_PARSE, t);
         
-        int i;
+        //Parse, compute and write on separate threads
+        struct pipeline_config pipeline = {ann, &runner, nInputs, nOutputs, tuning.batchSize};
+        unsigned long rows;
+        int r = pipeline_run(&pipeline, src, stdout, m, &rows);
         
-        inputs = (fann_type *) xmalloc(sizeof(fann_type) * nInputs);
-        i = 0;
-        while(i < nInputs && !feof(fp)) {
-            double v;
-            fscanf(fp, "%f", &v);
-            inputs[i] = (fann_type) v;            
-            i++;
-        }
-               
-        fclose(fp);
+        if (m != NULL) {
+            m->rows = rows;
+            m->bytes = src->offset + src->pos;
+        }
+        parse_close(src);
         
-        if (i < nInputs) {
+        if (r != 0) CMD_ERR(RUN_ERR);
+        if (rows == 0) {
             fprintf(stderr, "End of file reached! There are missing values in the file.\n");            
             CMD_ERR(RUN_ERR);
         }
@@ -850,94 +1623,595 @@ static int cmd_run(int argc, char **argv)
             fprintf(stderr, "Input dimension error. Expected %u inputs but %d were supplied\n", nInputs, aInputValues->count);
             CMD_ERR(RUN_ERR);
         }
-        inputs = (fann_type *) xmalloc(sizeof(fann_type) * nInputs);
         
         for (i = 0; i < nInputs; i++) {
             inputs[i] = (fann_type) aInputValues->dval[i];
         }
+        
+        uint64_t requested = t;
+        fann_type *output = run_inputs(ann, cached.image, inputs, values, mode);
+        t = metrics_lap(m, METRICS_COMPUTE, t);
+        print_outputs(output, nOutputs);
+        t = metrics_lap(m, METRICS_OUTPUT, t);
+        if (m != NULL) {
+            metrics_record(&m->latency, t - requested);
+            m->rows = 1;
+        }
     }
     
-    fann_type *output = fann_run(ann, inputs);
-    unsigned int iOutput;
-    
-    for (iOutput = 0; iOutput < fann_get_num_output(ann); iOutput++) {
-        if (iOutput > 0) fputc(' ', stdout);
-        fprintf(stdout, "%f", output[iOutput]);
+    if (m != NULL) {
+        fflush(stdout);
+        metrics_print(m, "run", stderr);
     }
-    fputc('\n', stdout);
-    
-    
         
     RUN_ERR:
     
-    fann_destroy(ann);
+    if (ann != NULL) fann_destroy(ann);
+    cache_release(&cached);
+    batch_free(&runner);
     if (inputs != NULL) xfree(inputs);
+    if (values != NULL) xfree(values);
     
     CMD_FOOTER;
 }
 
+/**
+ * Rank networks on a test data file and print the leaderboard to stdout
+ * @param dataPath Test data file
+ * @param nPatterns Number of paths
+ * @param patterns Paths of ANN files or network images. Glob patterns are expanded
+ * @param useCache Non-zero to load ANN files through the model cache
+ * @param mode Activation mode
+ * @param nThreads Maximum number of threads (0: one per processor)
+ * @return 0 if every network was tested, -1 otherwise (reported)
+ */
+static int test_leaderboard(const char *dataPath, int nPatterns, const char **patterns, int useCache, enum net_activation_mode mode, unsigned int nThreads)
+{
+    glob_t paths;
+    int i, failed = 0;
+    
+    memset(&paths, 0, sizeof(paths));
+    for (i = 0; i < nPatterns; i++) {
+        //Patterns matching nothing are kept as they are, to be reported when loaded
+        if (glob(patterns[i], GLOB_NOCHECK | (i > 0 ? GLOB_APPEND : 0), NULL, &paths) != 0) {
+            fprintf(stderr, "Out of memory!\n");
+            globfree(&paths);
+            return -1;
+        }
+    }
+    
+    struct arena_data *data = parse_train_file(dataPath, nThreads);
+    if (data == NULL) {
+        globfree(&paths);
+        return -1;
+    }
+    
+    unsigned int count = (unsigned int) paths.gl_pathc, rank;
+    struct leaderboard_entry *entries = (struct leaderboard_entry *) xmalloc(sizeof(struct leaderboard_entry) * count);
+    leaderboard_run(&data->data, count, (const char *const *) paths.gl_pathv, useCache, mode, nThreads, entries);
+    leaderboard_sort(entries, count);
+    
+    printf("%5s %14s %9s %11s %12s  %s\n", "Rank", "MSE", "Bit fail", "Parameters", "us/sample", "ANN");
+    for (rank = 0; rank < count; rank++) {
+        const struct leaderboard_entry *e = &entries[rank];
+        if (!e->ok) {
+            failed++;
+            continue;
+        }
+        printf("%5u %14.6e %9u %11u %12.3f  %s\n", rank + 1, e->mse, e->bitFail, e->parameters, e->usPerSample, e->path);
+    }
+    
+    xfree(entries);
+    arena_destroy(data);
+    globfree(&paths);
+    
+    if (failed > 0) {
+        fprintf(stderr, "%d of %u ANNs could not be tested\n", failed, count);
+        return -1;
+    }
+    return 0;
+}
+
 /** Test network */
 static int cmd_test(int argc, char **argv)
 {
     CMD_HEADER(
             "test",            
-            "Test an ANN. This command either reads the test data from a file (using --test-data) or performs a single test reading the input and output values from the command line (using -i and -o options as many times as inputs and outputs). The command prints to STDOUT the resulting MSE."
+            "Test an ANN. This command either reads the test data from a file (using --test-data) or performs a single test reading the input and output values from the command line (using -i and -o options as many times as inputs and outputs). The command prints to STDOUT the resulting MSE.",
+            "With --leaderboard, the test data is loaded once and every ANN given as argument is tested against it, several at a time. The command prints a table of the ANNs ranked by MSE, with their bit fail count, number of weights and inference time per sample."
             );
     
-    struct arg_file *aFile = arg_file0(NULL, "ann", "filepath", "path to the ANN file. If unspecified, read from STDIN");
+    struct arg_file *aFile = arg_file0(NULL, "ann", "filepath", "path to the ANN file or network image (see the learn command). If unspecified, read from STDIN");
+    struct arg_lit  *aCache = arg_lit0(NULL, "cache", "load the ANN through the model cache (requires --ann). See the cache command");
     struct arg_file *aTestData = arg_file0(NULL, "test-data", "filepath", "path to the input test file. If omitted input and output test values are read from the command line");
     struct arg_dbl  *aInputValues = arg_dbln("i", NULL, "float", 0, argc+1, "input values");
     struct arg_dbl  *aOutputValues = arg_dbln("o", NULL, "float", 0, argc+1, "output values");
-    CMD_PARSE(aFile, aTestData, aInputValues, aOutputValues);    
+    struct arg_str  *aActivation = arg_str0(NULL, "activation", "string", "activation mode: exact (default) or fast. fast evaluates sigmoid and gaussian functions with a vectorized approximation of exp() (absolute error below 4e-7)");
+    struct arg_lit  *aMaxDeviation = arg_lit0(NULL, "max-deviation", "also print the largest absolute difference between the outputs and the ones of exact evaluation");
+    struct arg_lit  *aStats = arg_lit0(NULL, "stats", "when finished, print row and byte counts, time per phase and latency percentiles as JSON to STDERR");
+    struct arg_lit  *aLeaderboard = arg_lit0(NULL, "leaderboard", "test every ANN given as argument against --test-data, concurrently, and print them ranked by MSE");
+    struct arg_str  *aEngine = arg_str0(NULL, "engine", "string", "engine: fann (FANN, one sample at a time) or image (network image, in batches shared by threads). If omitted, taken from the tuning profile, or fann");
+    struct arg_int  *aThreads = arg_int0(NULL, "threads", "int", "number of threads sharing each batch of samples (0: one per processor). If omitted, taken from the tuning profile, or 1. With --leaderboard, number of ANNs tested at once, one per processor if omitted or 0.");
+    struct arg_int  *aBatchSize = arg_int0(NULL, "batch-size", "int", "number of samples tested at once. If omitted, taken from the tuning profile, or 1");
+    struct arg_file *aAnns = arg_filen(NULL, NULL, "filepath", 0, argc+1, "ANN files or network images to rank with --leaderboard. Quoted glob patterns are expanded.");
+    CMD_PARSE(aFile, aCache, aTestData, aInputValues, aOutputValues, aActivation, aMaxDeviation, aStats, aLeaderboard, aEngine, aThreads, aBatchSize, aAnns);    
+    
+    if (aLeaderboard->count > 0) {
+        if (aTestData->count == 0 || aAnns->count == 0) {
+            fprintf(stderr, "--leaderboard requires --test-data and at least one ANN file\n");
+            CMD_ABORT;
+        }
+    } else if (aAnns->count > 0) {
+        fprintf(stderr, "ANN files can only be given as arguments with --leaderboard. Use --ann otherwise\n");
+        CMD_ABORT;
+    }
     
     if (aTestData->count == 0 && (aInputValues->count == 0 || aOutputValues->count == 0)) {
         fprintf(stderr, "You must specify either a file with test data or pass data through the command line. See --help for further information");
         CMD_ABORT;
     }
     
-    struct fann *ann;
-    if (aFile->count > 0) {
-        ann = fann_create_from_file(aFile->filename[0]);
-    } else {
-        ann = fann_create_from_fd(stdin, "STDIN");
+    if (aCache->count > 0 && aFile->count == 0 && aLeaderboard->count == 0) {
+        fprintf(stderr, "--cache requires --ann\n");
+        CMD_ABORT;
     }
     
-    assert(ann != NULL);
+    enum net_activation_mode mode = NET_ACTIVATION_EXACT;
+    if (aActivation->count > 0) {
+        mode = decode_activation_mode(aActivation->sval[0]);
+        if (mode == -1) {
+            fprintf(stderr, "Unknown activation mode: %s\n", aActivation->sval[0]);
+            CMD_ABORT;
+        }
+    }
+    
+    if (aLeaderboard->count > 0) {
+        unsigned int nThreads = (aThreads->count == 0 || aThreads->ival[0] < 0) ? 0 : (unsigned int) aThreads->ival[0];
+        if (test_leaderboard(aTestData->filename[0], aAnns->count, aAnns->filename, aCache->count > 0, mode, nThreads) != 0) CMD_ABORT;
+        goto EXIT;
+    }
+    
+    struct tune_config tuning;
+    if (tuning_options((aFile->count > 0) ? aFile->filename[0] : NULL, mode, aEngine, aThreads, aBatchSize, &tuning) != 0) CMD_ABORT;
+    
+    struct metrics metrics, *m = NULL;
+    uint64_t t = 0;
+    if (aStats->count > 0) {
+        metrics_init(&metrics);
+        m = &metrics;
+        t = m->start;
+    }
+    
+    struct fann *ann = NULL;
+    struct cache_entry cached = {NULL};
+    unsigned int nInputs, nOutputs;
+    int isImage;
+    if (aCache->count > 0) {
+        if (cache_load(aFile->filename[0], &cached) != 0) {
+            fprintf(stderr, "Could not load ANN from %s\n", aFile->filename[0]);
+            CMD_ABORT;
+        }
+        nInputs = cached.image->numInput;
+        nOutputs = cached.image->numOutput;
+    } else if (aFile->count > 0 && (isImage = cache_map_image(aFile->filename[0], &cached)) != 0) {
+        if (isImage < 0) CMD_ABORT;
+        nInputs = cached.image->numInput;
+        nOutputs = cached.image->numOutput;
+    } else {
+        if (aFile->count > 0) {
+            ann = compress_load_ann(aFile->filename[0]);
+        } else {
+            ann = compress_load_ann(NULL);
+        }
+    
+        assert(ann != NULL);
+        nInputs = fann_get_num_input(ann);
+        nOutputs = fann_get_num_output(ann);
+        
+        if ((mode != NET_ACTIVATION_EXACT || tuning.engine == TUNE_ENGINE_IMAGE || aMaxDeviation->count > 0) && compile_ann(&ann, &cached) != 0) {
+            fann_destroy(ann);
+            CMD_ABORT;
+        }
+    }
     
+    struct arena_data *testArena = NULL;
     struct fann_train_data *testData = NULL;
+    fann_type *values = NULL, *exact = NULL;
+    unsigned int i, j;
+    t = metrics_lap(m, METRICS_LOAD, t);
     
     if (aTestData->count > 0) {
-        testData = fann_read_train_from_file(aTestData->filename[0]);        
-        if (testData == NULL) {
-            fprintf(stderr, "Could not open test file\n");
+        testArena = parse_train_file(aTestData->filename[0], 0);        
+        if (testArena == NULL) {
             CMD_ERR(ERR);
         }
+        
+        struct stat st;
+        if (m != NULL && stat(aTestData->filename[0], &st) == 0) m->bytes = (uint64_t) st.st_size;
 
     } else {        
-        unsigned int nInputs = fann_get_num_input(ann), nOutputs = fann_get_num_output(ann);
-        int i;
         if ((unsigned int) aInputValues->count != nInputs || (unsigned int) aOutputValues->count != nOutputs) {
             fprintf(stderr, "Input or output dimension error. Expected %u inputs and %u outputs, but %d inputs and %d outputs were supplied\n", nInputs, nOutputs, aInputValues->count, aOutputValues->count);
             CMD_ERR(ERR);
         }
                 
-        testData = fann_create_train(1, nInputs, nOutputs);
+        testArena = arena_create(1, nInputs, nOutputs);
+        if (testArena == NULL) {
+            fprintf(stderr, "Out of memory!\n");
+            CMD_ERR(ERR);
+        }
                 
         for (i = 0; i < nInputs; i++) {
-            testData->input[0][i]  = (fann_type) aInputValues->dval[i];
+            testArena->inputs[i]  = (fann_type) aInputValues->dval[i];
         }
         for (i = 0; i < nOutputs; i++) {
-            testData->output[0][i] = (fann_type) aOutputValues->dval[i];
+            testArena->outputs[i] = (fann_type) aOutputValues->dval[i];
         }
     }
-        
+    testData = &testArena->data;
+    
+    if (testData->num_input != nInputs || testData->num_output != nOutputs) {
+        fprintf(stderr, "Input or output dimension error. Expected %u inputs and %u outputs, but test data has %u inputs and %u outputs\n", nInputs, nOutputs, testData->num_input, testData->num_output);
+        CMD_ERR(ERR);
+    }
+    if (ann != NULL) stats_scale_data(ann, testData);
+    t = metrics_lap(m, METRICS_PARSE, t);
+    
+    if (ann != NULL) {
+        fann_reset_MSE(ann);
+        for (i = 0; i < testData->num_data; i++) {
+            uint64_t requested = t;
+            fann_test(ann, testData->input[i], testData->output[i]);
+            t = metrics_lap(m, METRICS_COMPUTE, t);
+            if (m != NULL) metrics_record(&m->latency, t - requested);
+        }
+        fprintf(stdout, "%f\n", (double) fann_get_MSE(ann));
+    } else if (aMaxDeviation->count > 0) {
+        struct net_mse mse = {0};
+        double maxDeviation = 0;
+        values = (fann_type *) xmalloc(sizeof(fann_type) * cached.image->totalNeurons);
+        exact = (fann_type *) xmalloc(sizeof(fann_type) * cached.image->totalNeurons);
+        for (i = 0; i < testData->num_data; i++) {
+            uint64_t requested = t;
+            net_scale_input(cached.image, testData->input[i]);
+            net_scale_output(cached.image, testData->output[i]);
+            net_test(cached.image, testData->input[i], testData->output[i], values, mode, &mse);
+            const fann_type *output = values + NET_LAYERS(cached.image)[cached.image->numLayers - 1];
+            const fann_type *exactOutput = net_run(cached.image, testData->input[i], exact, NET_ACTIVATION_EXACT);
+            for (j = 0; j < nOutputs; j++) {
+                double deviation = fabs((double) output[j] - (double) exactOutput[j]);
+                if (deviation > maxDeviation) maxDeviation = deviation;
+            }
+            t = metrics_lap(m, METRICS_COMPUTE, t);
+            if (m != NULL) metrics_record(&m->latency, t - requested);
+        }
+        fprintf(stdout, "%f\n", (double) net_get_mse(&mse));
+        fprintf(stdout, "%e\n", maxDeviation);
+    } else {
+        struct net_mse mse = {0};
+        struct batch_runner runner;
+        if (batch_init(&runner, cached.image, mode, tuning.threads) != 0) {
+            fprintf(stderr, "Out of memory!\n");
+            CMD_ERR(ERR);
+        }
+        for (i = 0; i < testData->num_data; i += j) {
+            uint64_t requested = t;
+            j = (testData->num_data - i < tuning.batchSize) ? testData->num_data - i : tuning.batchSize;
+            batch_test(&runner, testData->input + i, testData->output + i, j, &mse);
+            t = metrics_lap(m, METRICS_COMPUTE, t);
+            //Every sample of a batch waits for the whole batch
+            for (unsigned int k = 0; m != NULL && k < j; k++) {
+                metrics_record(&m->latency, t - requested);
+            }
+        }
+        batch_free(&runner);
+        fprintf(stdout, "%f\n", (double) net_get_mse(&mse));
+    }
+    
+    if (m != NULL) {
+        fflush(stdout);
+        t = metrics_lap(m, METRICS_OUTPUT, t);
+        m->rows = testData->num_data;
+        metrics_print(m, "test", stderr);
+    }
+    
+ERR:
+    
+    if (ann != NULL) fann_destroy(ann);
+    cache_release(&cached);
+    arena_destroy(testArena);
+    if (values != NULL) xfree(values);
+    if (exact != NULL) xfree(exact);
+    
+    CMD_FOOTER;
+}
+
+/** Inspect or clear the model cache */
+static int cmd_cache(int argc, char **argv)
+{
+    CMD_HEADER(
+            "cache",            
+            "Inspect or clear the model cache. Without options, list the cached ANNs and tuning profiles along with their status (valid, stale, missing or invalid), image size (or profile) and path.",
+            "The run and test commands use the cache when --cache is given. Cached ANNs are kept in $FANNC_CACHE_DIR, $XDG_CACHE_HOME/fannc or $HOME/.cache/fannc."
+            );
+    
+    struct arg_lit *aClear = arg_lit0(NULL, "clear", "remove all cache entries and tuning profiles");
+    struct arg_lit *aPrune = arg_lit0(NULL, "prune", "remove only the entries and tuning profiles whose ANN file changed or no longer exists");
+    CMD_PARSE(aClear, aPrune);
+    
+    if (aClear->count > 0 || aPrune->count > 0) {
+        if (cache_clear(aClear->count == 0) != 0) {
+            fprintf(stderr, "Could not clear cache %s\n", cache_dir());
+            CMD_ABORT;
+        }
+    } else if (cache_list(stdout) != 0) {
+        fprintf(stderr, "Could not read cache %s\n", cache_dir());
+        CMD_ABORT;
+    }
+    
+    CMD_FOOTER;
+}
+
+
+
+/**
+ * Read all rows of an input file
+ * @param path File path
+ * @param nInputs Values per row
+ * @param rows Output number of rows
+ * @return Row-major values (release with xfree) or NULL on error (reported)
+ */
+static fann_type *read_input_rows(const char *path, unsigned int nInputs, unsigned int *rows)
+{
+    struct parse_src *src = parse_open(path);
+    fann_type *data = NULL;
+    unsigned int capacity = 0;
+    int r;
+
+    *rows = 0;
+    if (src == NULL) return NULL;
+
+    do {
+        if (*rows == capacity) {
+            capacity = (capacity == 0) ? 1024 : capacity * 2;
+            fann_type *grown = (fann_type *) realloc(data, sizeof(fann_type) * nInputs * capacity);
+            if (grown == NULL) {
+                fprintf(stderr, "Out of memory!\n");
+                r = -1;
+                break;
+            }
+            data = grown;
+        }
+        r = parse_row(src, data + (size_t) *rows * nInputs, nInputs);
+        if (r > 0) (*rows)++;
+    } while (r > 0);
+
+    parse_close(src);
+    if (r < 0 || *rows == 0) {
+        if (r == 0) fprintf(stderr, "%s: no input rows\n", path);
+        xfree(data);
+        return NULL;
+    }
+    return data;
+}
+
+/**
+ * Read the inputs of all samples of a data file
+ * @param path File path
+ * @param nInputs Expected number of inputs
+ * @param rows Output number of rows
+ * @return Row-major values (release with xfree) or NULL on error (reported)
+ */
+static fann_type *read_data_inputs(const char *path, unsigned int nInputs, unsigned int *rows)
+{
+    struct arena_data *data = parse_train_file(path, 0);
+
+    if (data == NULL) return NULL;
+    if (data->data.num_input != nInputs) {
+        fprintf(stderr, "Input dimension error. Expected %u inputs but test data has %u\n", nInputs, data->data.num_input);
+        arena_destroy(data);
+        return NULL;
+    }
+    *rows = data->data.num_data;
+    fann_type *inputs = (fann_type *) xmalloc(sizeof(fann_type) * nInputs * *rows);
+    //Inputs are row-major in the arena
+    if (inputs != NULL) memcpy(inputs, data->inputs, sizeof(fann_type) * nInputs * *rows);
+    arena_destroy(data);
+    return inputs;
+}
+
+/** Profile network */
+static int cmd_profile(int argc, char **argv)
+{
+    CMD_HEADER(
+            "profile",            
+            "Profile an ANN. Runs the ANN over a set of input rows and reports, for each layer, the wall time, floating point operations, "
+            "bytes of weights read, achieved GFLOP/s and share of the total time, as well as the time spent in each activation function.",
+            "Input rows are read from an input file (as in the run command) or from the inputs of a data file (as in the test command)."
+            );
+    
+    struct arg_file *aFile = arg_file0(NULL, "ann", "filepath", "path to the ANN file. If unspecified, read from STDIN");
+    struct arg_file *aInputFile = arg_file0(NULL, "input-file", "filepath", "path to a file with rows of input values");
+    struct arg_file *aTestData = arg_file0(NULL, "test-data", "filepath", "path to a data file whose inputs are used");
+    struct arg_int  *aRepeat = arg_int0(NULL, "repeat", "int", "number of times the input rows are run. If omitted, 1 is taken.");
+    struct arg_lit  *aJSON = arg_lit0(NULL, "json", "print the report in JSON format");
+    struct arg_str  *aActivation = arg_str0(NULL, "activation", "string", "activation mode: exact (default) or fast. fast evaluates sigmoid and gaussian functions with a vectorized approximation of exp() (absolute error below 4e-7)");
+    CMD_PARSE(aFile, aInputFile, aTestData, aRepeat, aJSON, aActivation);    
+    
+    if ((aInputFile->count > 0) == (aTestData->count > 0)) {
+        fprintf(stderr, "You must specify either --input-file or --test-data. See --help for further information\n");
+        CMD_ABORT;
+    }
+    
+    unsigned int repeat = (aRepeat->count > 0 && aRepeat->ival[0] > 0) ? (unsigned int) aRepeat->ival[0] : 1;
+    
+    enum net_activation_mode mode = NET_ACTIVATION_EXACT;
+    if (aActivation->count > 0) {
+        mode = decode_activation_mode(aActivation->sval[0]);
+        if (mode == -1) {
+            fprintf(stderr, "Unknown activation mode: %s\n", aActivation->sval[0]);
+            CMD_ABORT;
+        }
+    }
+    
+    struct fann *ann;
+    if (aFile->count > 0) {
+        ann = compress_load_ann(aFile->filename[0]);
+    } else {
+        ann = compress_load_ann(NULL);
+    }
     
-    fprintf(stdout, "%f\n", (double) fann_test_data(ann, testData));
+    assert(ann != NULL);
+    
+    struct net_image *img = net_compile(ann);
+    fann_type *inputs = NULL;
+    unsigned int i, rows = 0;
+    struct profile prof = {0};
+    
+    if (img == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        CMD_ERR(ERR);
+    }
+    
+    if (aInputFile->count > 0) {
+        inputs = read_input_rows(aInputFile->filename[0], img->numInput, &rows);
+    } else {
+        inputs = read_data_inputs(aTestData->filename[0], img->numInput, &rows);
+    }
+    if (inputs == NULL) CMD_ERR(ERR);
+    
+    if (profile_run(img, inputs, rows, repeat, mode, &prof) != 0) {
+        fprintf(stderr, "Out of memory!\n");
+        CMD_ERR(ERR);
+    }
+    
+    double total = (prof.totalSeconds > 0) ? prof.totalSeconds : 1;
+    if (aJSON->count > 0) {
+        printf("{\n");
+        printf("  \"samples\": %lu,\n", prof.samples);
+        printf("  \"seconds\": %e,\n", prof.totalSeconds);
+        printf("  \"layers\": [\n");
+        for (i = 0; i < prof.numLayers; i++) {
+            const struct profile_layer *pl = &prof.layers[i];
+            double flops = 2.0 * (double) pl->connections * (double) prof.samples;
+            printf("    {\"layer\": %u, \"type\": \"%s\", \"neurons\": %u, \"bias\": %u, \"connections\": %llu, "
+                   "\"seconds\": %e, \"flops\": %.0f, \"weightBytes\": %llu, \"gflops\": %f, \"share\": %f}%s\n",
+                    i, (i == 0) ? "input" : (i == prof.numLayers - 1) ? "output" : "hidden", pl->neurons, pl->bias,
+                    (unsigned long long) pl->connections, pl->seconds, flops, (unsigned long long) (pl->connections * sizeof(fann_type)),
+                    (pl->seconds > 0) ? flops / pl->seconds * 1e-9 : 0, pl->seconds / total, (i + 1 < prof.numLayers) ? "," : "");
+        }
+        printf("  ],\n");
+        printf("  \"activationFunctions\": [");
+        int dumped = 0;
+        for (i = 0; i < NET_NUM_ACTIVATIONS; i++) {
+            if (prof.activationCount[i] == 0) continue;
+            printf("%s\n    {\"function\": \"%s\", \"neurons\": %llu, \"evaluations\": %llu, \"seconds\": %e, \"share\": %f}",
+                    (dumped++ > 0) ? "," : "", FANN_ACTIVATIONFUNC_NAMES[i], (unsigned long long) prof.activationCount[i],
+                    (unsigned long long) prof.activationCount[i] * prof.samples, prof.activationSeconds[i], prof.activationSeconds[i] / total);
+        }
+        printf("\n  ]\n");
+        printf("}\n");
+    } else {
+        printf("Samples: %lu (%u rows x %u)\n", prof.samples, rows, repeat);
+        printf("%-6s %-7s %8s %5s %12s %12s %7s %12s %9s %12s\n", "Layer", "Type", "Neurons", "Bias", "Connections", "Time(ms)", "Share", "MFLOP", "GFLOP/s", "Weights(KB)");
+        for (i = 0; i < prof.numLayers; i++) {
+            const struct profile_layer *pl = &prof.layers[i];
+            double flops = 2.0 * (double) pl->connections * (double) prof.samples;
+            printf("%-6u %-7s %8u %5u %12llu %12.3f %6.1f%% %12.3f %9.3f %12.2f\n",
+                    i, (i == 0) ? "input" : (i == prof.numLayers - 1) ? "output" : "hidden", pl->neurons, pl->bias,
+                    (unsigned long long) pl->connections, pl->seconds * 1e3, 100.0 * pl->seconds / total, flops * 1e-6,
+                    (pl->seconds > 0) ? flops / pl->seconds * 1e-9 : 0, (double) (pl->connections * sizeof(fann_type)) / 1024.0);
+        }
+        printf("%-6s %-7s %8s %5s %12s %12.3f %6.1f%%\n", "Total", "", "", "", "", prof.totalSeconds * 1e3, 100.0);
+        printf("\n%-32s %8s %12s %7s\n", "Activation function", "Neurons", "Time(ms)", "Share");
+        for (i = 0; i < NET_NUM_ACTIVATIONS; i++) {
+            if (prof.activationCount[i] == 0) continue;
+            printf("%-32s %8llu %12.3f %6.1f%%\n", FANN_ACTIVATIONFUNC_NAMES[i], (unsigned long long) prof.activationCount[i],
+                    prof.activationSeconds[i] * 1e3, 100.0 * prof.activationSeconds[i] / total);
+        }
+    }
     
 ERR:
+    profile_free(&prof);
+    if (inputs != NULL) xfree(inputs);
+    if (img != NULL) xfree(img);
+    fann_destroy(ann);
     
+    CMD_FOOTER;
+}
+
+/** Tune how a network is run */
+static int cmd_autotune(int argc, char **argv)
+{
+    CMD_HEADER(
+            "autotune",            
+            "Find the fastest way of running an ANN on this host. The ANN is run over a set of input rows with every engine (FANN or network image), number of threads and batch size worth trying, "
+            "and the time per sample of each configuration is printed. The chosen configuration is saved as the ANN's tuning profile, which the run and test commands use from then on.",
+            "Configurations within 3% of the fastest one are considered as fast, and the one using fewer threads and smaller batches is chosen. "
+            "Profiles are kept in the cache directory (see the cache command) and are ignored once the ANN file changes, on a different host or when the ANN is run with another --activation mode."
+            );
+    
+    struct arg_file *aFile = arg_file1(NULL, "ann", "filepath", "path to the ANN file");
+    struct arg_file *aInputFile = arg_file0(NULL, "input-file", "filepath", "path to a file with rows of input values");
+    struct arg_file *aTestData = arg_file0(NULL, "test-data", "filepath", "path to a data file whose inputs are used");
+    struct arg_str  *aActivation = arg_str0(NULL, "activation", "string", "activation mode the ANN will be run with: exact (default) or fast. FANN is only tried in exact mode");
+    struct arg_int  *aMaxThreads = arg_int0(NULL, "max-threads", "int", "maximum number of threads tried. If omitted or 0, one per processor.");
+    struct arg_dbl  *aMinTime = arg_dbl0(NULL, "min-time", "float", "seconds each configuration is run for. If omitted, 0.2 is taken.");
+    struct arg_lit  *aDryRun = arg_lit0(NULL, "dry-run", "print the results without saving the profile");
+    CMD_PARSE(aFile, aInputFile, aTestData, aActivation, aMaxThreads, aMinTime, aDryRun);    
+    
+    if ((aInputFile->count > 0) == (aTestData->count > 0)) {
+        fprintf(stderr, "You must specify either --input-file or --test-data. See --help for further information\n");
+        CMD_ABORT;
+    }
+    
+    enum net_activation_mode mode = NET_ACTIVATION_EXACT;
+    if (aActivation->count > 0) {
+        mode = decode_activation_mode(aActivation->sval[0]);
+        if (mode == -1) {
+            fprintf(stderr, "Unknown activation mode: %s\n", aActivation->sval[0]);
+            CMD_ABORT;
+        }
+    }
+    unsigned int maxThreads = (aMaxThreads->count > 0 && aMaxThreads->ival[0] > 0) ? (unsigned int) aMaxThreads->ival[0] : 0;
+    double minTime = (aMinTime->count > 0 && aMinTime->dval[0] > 0) ? aMinTime->dval[0] : 0.2;
+    
+    struct fann *ann = compress_load_ann(aFile->filename[0]);
+    if (ann == NULL) CMD_ABORT;
+    
+    struct net_image *img = net_compile(ann);
+    struct tune_config *configs = NULL;
+    fann_type *inputs = NULL;
+    unsigned int i, rows = 0, count = 0;
+    
+    if (img == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        CMD_ERR(ERR);
+    }
+    
+    if (aInputFile->count > 0) {
+        inputs = read_input_rows(aInputFile->filename[0], img->numInput, &rows);
+    } else {
+        inputs = read_data_inputs(aTestData->filename[0], img->numInput, &rows);
+    }
+    if (inputs == NULL) CMD_ERR(ERR);
+    
+    if (tune_benchmark(ann, img, inputs, rows, mode, maxThreads, minTime, &configs, &count) != 0) CMD_ERR(ERR);
+    
+    unsigned int best = tune_pick(configs, count);
+    printf("%-8s %8s %8s %12s\n", "Engine", "Threads", "Batch", "us/sample");
+    for (i = 0; i < count; i++) {
+        printf("%-8s %8u %8u %12.3f%s\n", TUNE_ENGINE_NAMES[configs[i].engine], configs[i].threads, configs[i].batchSize,
+                configs[i].usPerSample, (i == best) ? "  *" : "");
+    }
+    
+    if (aDryRun->count == 0 && tune_save(aFile->filename[0], mode, &configs[best]) != 0) CMD_ERR(ERR);
+    
+ERR:
+    if (configs != NULL) free(configs);
+    if (inputs != NULL) xfree(inputs);
+    if (img != NULL) xfree(img);
     fann_destroy(ann);
-    if (testData != NULL) fann_destroy_train(testData);
     
     CMD_FOOTER;
 }
@@ -962,6 +2236,19 @@ static struct cmd_tab_entry {
     {.name = "train", .f = cmd_train, .brief = "Train ANN from data file"},
     {.name = "run", .f = cmd_run, .brief = "Run an ANN"},
     {.name = "test", .f = cmd_test, .brief="Test an ANN"},
+    {.name = "cache", .f = cmd_cache, .brief="Inspect or clear the model cache"},
+    {.name = "profile", .f = cmd_profile, .brief="Profile an ANN layer by layer"},
+    {.name = "autotune", .f = cmd_autotune, .brief="Find the fastest way of running an ANN on this host"},
+    {.name = "worker", .f = cmd_worker, .brief="Train as a worker of a distributed training"},
+    {.name = "crossval", .f = cmd_crossval, .brief="Cross-validate an ANN"},
+    {.name = "data_shuffle", .f = cmd_data_shuffle, .brief="Shuffle a data file"},
+    {.name = "data_split", .f = cmd_data_split, .brief="Split a data file"},
+    {.name = "data_subsample", .f = cmd_data_subsample, .brief="Select a random subset of a data file"},
+    {.name = "data_merge", .f = cmd_data_merge, .brief="Concatenate data files"},
+    {.name = "stats", .f = cmd_stats, .brief="Print column statistics of a data file"},
+    {.name = "set_scaling", .f = cmd_set_scaling, .brief="Set ANN's scaling parameters from training data"},
+    {.name = "grow", .f = cmd_grow, .brief="Add neurons or a hidden layer to an ANN, keeping its weights"},
+    {.name = "learn", .f = cmd_learn, .brief="Train an ANN online from a stream of samples"},
     ///////////////////////////
     {.name = NULL} //Last item
 };
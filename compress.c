@@ -0,0 +1,652 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+/*
+ * Compressed streams.
+ *
+ * Compressed files are recognized by their magic bytes, whatever their name.
+ * They are decompressed by a background thread that writes the plain data
+ * into one end of a socket pair, while the caller reads the other end as an
+ * ordinary stream. Decompression and parsing thus run in parallel, and the
+ * socket buffer keeps the decompressor a little ahead of the reader. A socket
+ * is used rather than a pipe so that a reader that stops early (for example
+ * FANN once it has read a network) only makes the thread's next send fail
+ * with EPIPE instead of raising SIGPIPE.
+ *
+ * gzip support needs zlib (HAVE_ZLIB) and zstd support needs libzstd
+ * (HAVE_ZSTD). Without them, compressed files are reported as unsupported.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <fann.h>
+#include <fann_internal.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "compress.h"
+
+/** Size of the blocks read and written by the decompression thread */
+#define COMPRESS_BUFSIZE    (256 << 10)
+
+/** Socket buffer between the decompression thread and the reader */
+#define COMPRESS_SOCKBUF    (1 << 20)
+
+/** Default compression level of zstd */
+#define ZSTD_LEVEL_DEFAULT  3
+
+static const unsigned char GZIP_MAGIC[] = {0x1f, 0x8b};
+static const unsigned char ZSTD_MAGIC[] = {0x28, 0xb5, 0x2f, 0xfd};
+
+struct compress_reader {
+    const char *name;                       /**< Name used in error messages */
+    enum compress_format format;            /**< Format of the input */
+    int in;                                 /**< Compressed input, or -1 to read inFp */
+    FILE *inFp;                             /**< Compressed input stream, used when in is -1 */
+    unsigned char head[COMPRESS_MAGIC_SIZE]; /**< Bytes already read from the input */
+    size_t headLen;
+    size_t headPos;
+    int out;                                /**< Socket written by the thread */
+    FILE *fp;                               /**< Socket read by the caller */
+    pthread_t thread;
+    int joined;                             /**< Non-zero once the thread has been joined */
+    int error;                              /**< Non-zero if decompression failed (reported) */
+};
+
+/**
+ * Detect the compression of a file from its first bytes
+ * @param head First bytes of the file
+ * @param len Number of bytes (up to COMPRESS_MAGIC_SIZE are looked at)
+ * @return Format, COMPRESS_NONE if not compressed
+ */
+enum compress_format compress_detect(const void *head, size_t len)
+{
+    if (len >= sizeof(ZSTD_MAGIC) && memcmp(head, ZSTD_MAGIC, sizeof(ZSTD_MAGIC)) == 0) return COMPRESS_ZSTD;
+    if (len >= sizeof(GZIP_MAGIC) && memcmp(head, GZIP_MAGIC, sizeof(GZIP_MAGIC)) == 0) return COMPRESS_GZIP;
+    return COMPRESS_NONE;
+}
+
+/**
+ * Check whether this build supports a format
+ * @param format Format
+ * @return Non-zero if supported
+ */
+int compress_available(enum compress_format format)
+{
+    switch (format) {
+        case COMPRESS_NONE:
+            return 1;
+#ifdef HAVE_ZLIB
+        case COMPRESS_GZIP:
+            return 1;
+#endif
+#ifdef HAVE_ZSTD
+        case COMPRESS_ZSTD:
+            return 1;
+#endif
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Decode a compression specification
+ * @param spec FORMAT or FORMAT:LEVEL, where FORMAT is none, gzip (levels 1 to 9) or zstd (levels 1 to 19)
+ * @param format Output format
+ * @param level Output level, or -1 for the format's default
+ * @return 0 on success, -1 if the specification is invalid or the format unsupported (reported)
+ */
+int compress_parse_spec(const char *spec, enum compress_format *format, int *level)
+{
+    static const int MAX_LEVEL[] = {0, 9, 19};
+    const char *colon = strchr(spec, ':');
+    size_t len = (colon != NULL) ? (size_t) (colon - spec) : strlen(spec);
+    unsigned int i;
+
+    for (i = 0; i < sizeof(COMPRESS_FORMAT_NAMES) / sizeof(COMPRESS_FORMAT_NAMES[0]); i++) {
+        if (strlen(COMPRESS_FORMAT_NAMES[i]) == len && strncmp(spec, COMPRESS_FORMAT_NAMES[i], len) == 0) break;
+    }
+    if (i == sizeof(COMPRESS_FORMAT_NAMES) / sizeof(COMPRESS_FORMAT_NAMES[0])) {
+        fprintf(stderr, "Unknown compression format '%.*s'. Use none, gzip or zstd\n", (int) len, spec);
+        return -1;
+    }
+    *format = (enum compress_format) i;
+    *level = -1;
+
+    if (colon != NULL) {
+        char *end;
+        long l = strtol(colon + 1, &end, 10);
+        if (*format == COMPRESS_NONE || end == colon + 1 || *end != '\0' || l < 1 || l > MAX_LEVEL[i]) {
+            fprintf(stderr, "Invalid compression level '%s' for %s\n", colon + 1, COMPRESS_FORMAT_NAMES[i]);
+            return -1;
+        }
+        *level = (int) l;
+    }
+    if (!compress_available(*format)) {
+        fprintf(stderr, "This build does not support %s compression\n", COMPRESS_FORMAT_NAMES[i]);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Read compressed input, starting with the bytes already read
+ * @param r Reader
+ * @param buf Buffer
+ * @param size Buffer size
+ * @return Number of bytes read, 0 at end of file, -1 on error (reported)
+ */
+static ssize_t read_input(struct compress_reader *r, unsigned char *buf, size_t size)
+{
+    ssize_t n;
+
+    if (r->headPos < r->headLen) {
+        n = (ssize_t) (r->headLen - r->headPos);
+        if ((size_t) n > size) n = (ssize_t) size;
+        memcpy(buf, r->head + r->headPos, (size_t) n);
+        r->headPos += (size_t) n;
+        return n;
+    }
+    if (r->inFp != NULL) {
+        n = (ssize_t) fread(buf, 1, size, r->inFp);
+        if (n == 0 && ferror(r->inFp)) n = -1;
+    } else {
+        do {
+            n = read(r->in, buf, size);
+        } while (n < 0 && errno == EINTR);
+    }
+    if (n < 0) fprintf(stderr, "%s: read error\n", r->name);
+    return n;
+}
+
+/**
+ * Hand decompressed data to the reader
+ * @param r Reader
+ * @param buf Data
+ * @param size Size of the data
+ * @return 0 on success, -1 if the reader is gone or on error (reported)
+ */
+static int write_output(struct compress_reader *r, const unsigned char *buf, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = send(r->out, buf, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            //The reader closed its end: not an error, it just needs no more data
+            if (errno != EPIPE && errno != ECONNRESET) fprintf(stderr, "%s: write error while decompressing\n", r->name);
+            return -1;
+        }
+        buf += n;
+        size -= (size_t) n;
+    }
+    return 0;
+}
+
+/** Copy uncompressed input */
+static int copy_stream(struct compress_reader *r, unsigned char *in)
+{
+    ssize_t n;
+    while ((n = read_input(r, in, COMPRESS_BUFSIZE)) > 0) {
+        if (write_output(r, in, (size_t) n) != 0) return 0;
+    }
+    return (n < 0) ? -1 : 0;
+}
+
+#ifdef HAVE_ZLIB
+/** Decompress gzip input, which may hold several concatenated members */
+static int inflate_stream(struct compress_reader *r, unsigned char *in, unsigned char *out)
+{
+    z_stream z;
+    int ret = Z_OK, status = 0;
+    ssize_t n;
+
+    memset(&z, 0, sizeof(z));
+    if (inflateInit2(&z, 15 + 16) != Z_OK) {
+        fprintf(stderr, "%s: could not initialize gzip decompression\n", r->name);
+        return -1;
+    }
+    while ((n = read_input(r, in, COMPRESS_BUFSIZE)) > 0) {
+        z.next_in = in;
+        z.avail_in = (uInt) n;
+        do {
+            if (ret == Z_STREAM_END) inflateReset(&z);
+            z.next_out = out;
+            z.avail_out = COMPRESS_BUFSIZE;
+            ret = inflate(&z, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                fprintf(stderr, "%s: corrupt gzip data\n", r->name);
+                status = -1;
+                goto END;
+            }
+            if (write_output(r, out, COMPRESS_BUFSIZE - z.avail_out) != 0) goto END;
+        } while (z.avail_in > 0 || (z.avail_out == 0 && ret == Z_OK));
+    }
+    if (n < 0) {
+        status = -1;
+    } else if (ret != Z_STREAM_END) {
+        fprintf(stderr, "%s: truncated gzip data\n", r->name);
+        status = -1;
+    }
+
+END:
+    inflateEnd(&z);
+    return status;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/** Decompress zstd input, which may hold several concatenated frames */
+static int zstd_stream(struct compress_reader *r, unsigned char *in, unsigned char *out)
+{
+    ZSTD_DStream *ds = ZSTD_createDStream();
+    size_t last = 0;
+    int status = 0;
+    ssize_t n;
+
+    if (ds == NULL || ZSTD_isError(ZSTD_initDStream(ds))) {
+        fprintf(stderr, "%s: could not initialize zstd decompression\n", r->name);
+        ZSTD_freeDStream(ds);
+        return -1;
+    }
+    while ((n = read_input(r, in, COMPRESS_BUFSIZE)) > 0) {
+        ZSTD_inBuffer ib = {in, (size_t) n, 0};
+        ZSTD_outBuffer ob;
+        do {
+            ob.dst = out;
+            ob.size = COMPRESS_BUFSIZE;
+            ob.pos = 0;
+            last = ZSTD_decompressStream(ds, &ob, &ib);
+            if (ZSTD_isError(last)) {
+                fprintf(stderr, "%s: corrupt zstd data: %s\n", r->name, ZSTD_getErrorName(last));
+                status = -1;
+                goto END;
+            }
+            if (write_output(r, out, ob.pos) != 0) goto END;
+        } while (ib.pos < ib.size || ob.pos == ob.size);
+    }
+    if (n < 0) {
+        status = -1;
+    } else if (last != 0) {
+        fprintf(stderr, "%s: truncated zstd data\n", r->name);
+        status = -1;
+    }
+
+END:
+    ZSTD_freeDStream(ds);
+    return status;
+}
+#endif
+
+/** Decompression thread */
+static void *decompress_task(void *arg)
+{
+    struct compress_reader *r = (struct compress_reader *) arg;
+    unsigned char *in = (unsigned char *) malloc(COMPRESS_BUFSIZE);
+    unsigned char *out = (unsigned char *) malloc(COMPRESS_BUFSIZE);
+
+    if (in == NULL || out == NULL) {
+        fprintf(stderr, "%s: out of memory\n", r->name);
+        r->error = 1;
+    } else {
+        switch (r->format) {
+#ifdef HAVE_ZLIB
+            case COMPRESS_GZIP:
+                r->error = inflate_stream(r, in, out) != 0;
+                break;
+#endif
+#ifdef HAVE_ZSTD
+            case COMPRESS_ZSTD:
+                r->error = zstd_stream(r, in, out) != 0;
+                break;
+#endif
+            default:
+                r->error = copy_stream(r, in) != 0;
+                break;
+        }
+    }
+    free(in);
+    free(out);
+    //Closing the socket is the reader's end of file
+    close(r->out);
+    r->out = -1;
+    return NULL;
+}
+
+/**
+ * Start decompressing on a background thread
+ * @param fd Compressed input, or -1 to read fp
+ * @param fp Compressed input stream, used when fd is -1
+ * @param format Input format. COMPRESS_NONE copies the input as is, which is
+ *               useful to give back bytes already read from a stream
+ * @param head Bytes already read from the input, handed out first
+ * @param headLen Number of bytes in head, up to COMPRESS_MAGIC_SIZE
+ * @param name Name used in error messages
+ * @return Reader, or NULL on error (reported)
+ */
+static struct compress_reader *open_reader(int fd, FILE *fp, enum compress_format format, const void *head, size_t headLen, const char *name)
+{
+    struct compress_reader *r;
+    int sv[2], size = COMPRESS_SOCKBUF;
+
+    if (!compress_available(format)) {
+        fprintf(stderr, "%s: %s compressed, but this build does not support %s\n", name, COMPRESS_FORMAT_NAMES[format], COMPRESS_FORMAT_NAMES[format]);
+        goto ERR_FD;
+    }
+    r = (struct compress_reader *) calloc(1, sizeof(struct compress_reader));
+    if (r == NULL) {
+        fprintf(stderr, "%s: out of memory\n", name);
+        goto ERR_FD;
+    }
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        fprintf(stderr, "%s: could not create decompression stream\n", name);
+        goto ERR_MEM;
+    }
+    setsockopt(sv[1], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(sv[0], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    if (fd >= 0) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    r->name = name;
+    r->format = format;
+    r->in = fd;
+    r->inFp = fp;
+    if (headLen > COMPRESS_MAGIC_SIZE) headLen = COMPRESS_MAGIC_SIZE;
+    if (headLen > 0) memcpy(r->head, head, headLen);
+    r->headLen = headLen;
+    r->out = sv[1];
+    r->fp = fdopen(sv[0], "r");
+    if (r->fp == NULL) {
+        close(sv[0]);
+        close(sv[1]);
+        fprintf(stderr, "%s: could not create decompression stream\n", name);
+        goto ERR_MEM;
+    }
+    if (pthread_create(&r->thread, NULL, decompress_task, r) != 0) {
+        fclose(r->fp);
+        close(sv[1]);
+        fprintf(stderr, "%s: could not start decompression thread\n", name);
+        goto ERR_MEM;
+    }
+    return r;
+
+ERR_MEM:
+    free(r);
+ERR_FD:
+    if (fd >= 0 && fd != STDIN_FILENO) close(fd);
+    return NULL;
+}
+
+/**
+ * Start decompressing a file on a background thread. The reader takes
+ * ownership of the descriptor, and closes it unless it is STDIN.
+ * @param fd Compressed input
+ * @param format Input format. COMPRESS_NONE copies the input as is, which is
+ *               useful to give back bytes already read from a stream
+ * @param head Bytes already read from the input, handed out first
+ * @param headLen Number of bytes in head, up to COMPRESS_MAGIC_SIZE
+ * @param name Name used in error messages
+ * @return Reader, or NULL on error (reported)
+ */
+struct compress_reader *compress_open(int fd, enum compress_format format, const void *head, size_t headLen, const char *name)
+{
+    return open_reader(fd, NULL, format, head, headLen, name);
+}
+
+/**
+ * Start decompressing a stream on a background thread, from its current
+ * position, including any data it has buffered or had pushed back. The
+ * stream is not closed.
+ * @param fp Compressed input stream
+ * @param format Input format
+ * @param name Name used in error messages
+ * @return Reader, or NULL on error (reported)
+ */
+struct compress_reader *compress_open_stream(FILE *fp, enum compress_format format, const char *name)
+{
+    return open_reader(-1, fp, format, NULL, 0, name);
+}
+
+/**
+ * Get the stream of decompressed data
+ * @param reader Reader
+ * @return Stream, owned by the reader
+ */
+FILE *compress_stream(struct compress_reader *reader)
+{
+    return reader->fp;
+}
+
+/**
+ * Wait for the decompression thread once the stream has reached its end
+ * @param reader Reader
+ * @return 0 if the whole input was decompressed, -1 if it failed (reported)
+ */
+int compress_finish(struct compress_reader *reader)
+{
+    if (!reader->joined) {
+        pthread_join(reader->thread, NULL);
+        reader->joined = 1;
+    }
+    return reader->error ? -1 : 0;
+}
+
+/**
+ * Close a reader, stopping the decompression thread if the stream was not read to the end
+ * @param reader Reader
+ * @return 0 if no decompression error was found, -1 otherwise (reported)
+ */
+int compress_close(struct compress_reader *reader)
+{
+    if (reader == NULL) return 0;
+    fclose(reader->fp);
+    int r = compress_finish(reader);
+    if (reader->in >= 0 && reader->in != STDIN_FILENO) close(reader->in);
+    free(reader);
+    return r;
+}
+
+/**
+ * Write data, optionally compressed
+ * @param fp Destination
+ * @param data Data
+ * @param size Size of the data
+ * @param format Format
+ * @param level Compression level, or -1 for the format's default
+ * @param name Name used in error messages
+ * @return 0 on success, -1 on error (reported)
+ */
+int compress_write(FILE *fp, const void *data, size_t size, enum compress_format format, int level, const char *name)
+{
+    int status = 0, writeErr = 0;
+
+    switch (format) {
+        case COMPRESS_NONE:
+            writeErr = fwrite(data, 1, size, fp) != size;
+            break;
+#ifdef HAVE_ZLIB
+        case COMPRESS_GZIP: {
+            unsigned char *out = (unsigned char *) malloc(COMPRESS_BUFSIZE);
+            z_stream z;
+            int ret;
+
+            memset(&z, 0, sizeof(z));
+            if (out == NULL || deflateInit2(&z, (level < 0) ? Z_DEFAULT_COMPRESSION : level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                free(out);
+                fprintf(stderr, "%s: could not initialize gzip compression\n", name);
+                return -1;
+            }
+            z.next_in = (Bytef *) data;
+            z.avail_in = (uInt) size;
+            do {
+                z.next_out = out;
+                z.avail_out = COMPRESS_BUFSIZE;
+                ret = deflate(&z, Z_FINISH);
+                size_t n = COMPRESS_BUFSIZE - z.avail_out;
+                writeErr = fwrite(out, 1, n, fp) != n;
+            } while (ret == Z_OK && !writeErr);
+            if (ret != Z_STREAM_END && !writeErr) {
+                fprintf(stderr, "%s: gzip compression failed\n", name);
+                status = -1;
+            }
+            deflateEnd(&z);
+            free(out);
+            break;
+        }
+#endif
+#ifdef HAVE_ZSTD
+        case COMPRESS_ZSTD: {
+            size_t bound = ZSTD_compressBound(size);
+            void *out = malloc(bound);
+            if (out == NULL) {
+                fprintf(stderr, "%s: out of memory\n", name);
+                return -1;
+            }
+            size_t n = ZSTD_compress(out, bound, data, size, (level < 0) ? ZSTD_LEVEL_DEFAULT : level);
+            if (ZSTD_isError(n)) {
+                fprintf(stderr, "%s: zstd compression failed: %s\n", name, ZSTD_getErrorName(n));
+                status = -1;
+            } else {
+                writeErr = fwrite(out, 1, n, fp) != n;
+            }
+            free(out);
+            break;
+        }
+#endif
+        default:
+            fprintf(stderr, "%s: this build does not support %s compression\n", name, COMPRESS_FORMAT_NAMES[format]);
+            return -1;
+    }
+    if (status == 0 && (writeErr || fflush(fp) != 0)) {
+        fprintf(stderr, "%s: write error\n", name);
+        status = -1;
+    }
+    return status;
+}
+
+/**
+ * Load an ANN saved by FANN, compressed or not, from an open file.
+ * The file is read from its start, whatever its offset, so that a caller can
+ * hash or inspect the same descriptor before or after.
+ * @param fd Regular file, left open
+ * @param name Name used in error messages
+ * @return ANN, or NULL on error (reported)
+ */
+struct fann *compress_load_ann_fd(int fd, const char *name)
+{
+    unsigned char head[COMPRESS_MAGIC_SIZE];
+    ssize_t len;
+    struct fann *ann;
+
+    do {
+        len = pread(fd, head, sizeof(head), 0);
+    } while (len < 0 && errno == EINTR);
+    int dupFd = dup(fd);
+    if (len < 0 || dupFd < 0 || lseek(dupFd, (len > 0) ? len : 0, SEEK_SET) < 0) {
+        if (dupFd >= 0) close(dupFd);
+        fprintf(stderr, "%s: read error\n", name);
+        return NULL;
+    }
+
+    enum compress_format format = compress_detect(head, (size_t) len);
+    if (format == COMPRESS_NONE) {
+        FILE *fp = (lseek(dupFd, 0, SEEK_SET) == 0) ? fdopen(dupFd, "r") : NULL;
+        if (fp == NULL) {
+            close(dupFd);
+            fprintf(stderr, "%s: read error\n", name);
+            return NULL;
+        }
+        ann = fann_create_from_fd(fp, name);
+        fclose(fp);
+        return ann;
+    }
+
+    struct compress_reader *reader = compress_open(dupFd, format, head, (size_t) len, name);
+    if (reader == NULL) return NULL;
+    ann = fann_create_from_fd(compress_stream(reader), name);
+    if (compress_close(reader) != 0 && ann != NULL) {
+        fann_destroy(ann);
+        ann = NULL;
+    }
+    return ann;
+}
+
+/**
+ * Load an ANN saved by FANN, compressed or not
+ * @param path File path, or NULL for STDIN
+ * @return ANN, or NULL on error (reported)
+ */
+struct fann *compress_load_ann(const char *path)
+{
+    if (path != NULL) {
+        int fd = open(path, O_RDONLY);
+        //Let FANN report files it cannot open
+        if (fd < 0) return fann_create_from_file(path);
+        struct fann *ann = compress_load_ann_fd(fd, path);
+        close(fd);
+        return ann;
+    }
+
+    //STDIN cannot be rewound: peek at its first byte, which tells compressed input apart from FANN's text.
+    //Plain input is read by FANN, which stops after the network and leaves the rest of STDIN alone
+    int c = getc(stdin);
+    if (c != EOF) ungetc(c, stdin);
+    if (c != GZIP_MAGIC[0] && c != ZSTD_MAGIC[0]) return fann_create_from_fd(stdin, "STDIN");
+
+    struct compress_reader *reader = compress_open_stream(stdin, (c == GZIP_MAGIC[0]) ? COMPRESS_GZIP : COMPRESS_ZSTD, "STDIN");
+    if (reader == NULL) return NULL;
+    struct fann *ann = fann_create_from_fd(compress_stream(reader), "STDIN");
+    if (compress_close(reader) != 0 && ann != NULL) {
+        fann_destroy(ann);
+        ann = NULL;
+    }
+    return ann;
+}
+
+/**
+ * Save an ANN in FANN's format, optionally compressed
+ * @param ann ANN
+ * @param fp Destination
+ * @param name Name used in error messages
+ * @param format Format
+ * @param level Compression level, or -1 for the format's default
+ * @return 0 on success, -1 on error (reported)
+ */
+int compress_save_ann(struct fann *ann, FILE *fp, const char *name, enum compress_format format, int level)
+{
+    if (format == COMPRESS_NONE) return fann_save_internal_fd(ann, fp, name, 0);
+
+    char *buf = NULL;
+    size_t size = 0;
+    FILE *mem = open_memstream(&buf, &size);
+    if (mem == NULL) {
+        fprintf(stderr, "%s: out of memory\n", name);
+        return -1;
+    }
+    int r = fann_save_internal_fd(ann, mem, name, 0);
+    if (fclose(mem) != 0) r = -1;
+    if (r == 0) r = compress_write(fp, buf, size, format, level, name);
+    free(buf);
+    return r;
+}
@@ -0,0 +1,65 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef COMPRESS_H
+#define	COMPRESS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <fann.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/** Environment variable selecting the compression of ANNs written to STDOUT, as FORMAT[:LEVEL] */
+#define COMPRESS_ENV "FANNC_COMPRESS"
+
+/** Compression formats, recognized by their magic bytes */
+enum compress_format {
+    COMPRESS_NONE = 0,
+    COMPRESS_GZIP,
+    COMPRESS_ZSTD
+};
+
+static char const *const COMPRESS_FORMAT_NAMES[] = {"none", "gzip", "zstd"};
+
+/** Bytes needed by compress_detect() */
+#define COMPRESS_MAGIC_SIZE 4
+
+/** Stream decompressed by a background thread */
+struct compress_reader;
+
+enum compress_format compress_detect(const void *head, size_t len);
+int compress_available(enum compress_format format);
+int compress_parse_spec(const char *spec, enum compress_format *format, int *level);
+struct compress_reader *compress_open(int fd, enum compress_format format, const void *head, size_t headLen, const char *name);
+struct compress_reader *compress_open_stream(FILE *fp, enum compress_format format, const char *name);
+FILE *compress_stream(struct compress_reader *reader);
+int compress_finish(struct compress_reader *reader);
+int compress_close(struct compress_reader *reader);
+int compress_write(FILE *fp, const void *data, size_t size, enum compress_format format, int level, const char *name);
+struct fann *compress_load_ann_fd(int fd, const char *name);
+struct fann *compress_load_ann(const char *path);
+int compress_save_ann(struct fann *ann, FILE *fp, const char *name, enum compress_format format, int level);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* COMPRESS_H */
+
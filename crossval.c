@@ -0,0 +1,169 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+/*
+ * k-fold cross-validation.
+ *
+ * The data set is loaded once and split into k folds of consecutive samples
+ * (after an optional shuffle of the arena's row pointers). Folds are views:
+ * arrays of row pointers into the arena, so no sample is copied. Every fold
+ * trains its own copy of the initial network on the other k - 1 folds and is
+ * tested on the held out one. Folds are trained concurrently; only as many
+ * views as folds running at once exist, each built when its fold starts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fann.h>
+#include "crossval.h"
+#include "threads.h"
+
+/** Argument of run_fold() */
+struct crossval_job {
+    const struct fann_train_data *data;
+    unsigned int k;
+    fann_type **rows;           /**< nSlots buffers of 2n row pointers */
+    int *busy;                  /**< Non-zero while a fold uses the buffer */
+    unsigned int nSlots;        /**< At least the number of folds running at once */
+    struct crossval_fold *folds;
+    unsigned int maxEpochs;
+    float desiredError;
+};
+
+/**
+ * Append consecutive rows of a data set to a view
+ * @param view View to fill. Its row pointer arrays must have room for count rows
+ * @param data Data the rows belong to
+ * @param first First row
+ * @param count Number of rows
+ */
+static void view_add(struct fann_train_data *view, const struct fann_train_data *data, unsigned int first, unsigned int count)
+{
+    memcpy(view->input + view->num_data, data->input + first, sizeof(fann_type *) * count);
+    memcpy(view->output + view->num_data, data->output + first, sizeof(fann_type *) * count);
+    view->num_data += count;
+}
+
+/**
+ * Build the train and test views of a fold, then train the fold's network on
+ * the first and test it on the second
+ */
+static void run_fold(unsigned int index, void *arg)
+{
+    struct crossval_job *job = (struct crossval_job *) arg;
+    const struct fann_train_data *data = job->data;
+    struct crossval_fold *fold = &job->folds[index];
+    unsigned int n = data->num_data;
+    unsigned int first = (unsigned int) ((unsigned long) index * n / job->k);
+    unsigned int last = (unsigned int) ((unsigned long) (index + 1) * n / job->k);
+
+    //No more folds run at once than there are buffers, so one is always free
+    unsigned int slot = 0;
+    while (__sync_lock_test_and_set(&job->busy[slot], 1)) slot = (slot + 1) % job->nSlots;
+    fann_type **base = job->rows + (size_t) 2 * n * slot;
+
+    struct fann_train_data train, test;
+    memset(&train, 0, sizeof(train));
+    memset(&test, 0, sizeof(test));
+    test.num_input = train.num_input = data->num_input;
+    test.num_output = train.num_output = data->num_output;
+    test.input = base;
+    test.output = base + (last - first);
+    view_add(&test, data, first, last - first);
+    train.input = base + 2 * (last - first);
+    train.output = train.input + (n - (last - first));
+    view_add(&train, data, 0, first);
+    view_add(&train, data, last, n - last);
+
+    fann_train_on_data(fold->ann, &train, job->maxEpochs, 0, job->desiredError);
+    fold->trainMSE = fann_get_MSE(fold->ann);
+    fann_test_data(fold->ann, &test);
+    fold->testMSE = fann_get_MSE(fold->ann);
+    fold->bitFail = fann_get_bit_fail(fold->ann);
+
+    __sync_lock_release(&job->busy[slot]);
+}
+
+/**
+ * Cross-validate an ANN.
+ * Each fold trains a copy of the given ANN, which is left untouched. Training
+ * works as fann_train_on_data() with no reports.
+ * @param ann Initial ANN
+ * @param arena Data set
+ * @param k Number of folds, at least 2 and at most the number of samples
+ * @param shuffle Non-zero to shuffle samples before splitting them into folds (see arena_shuffle())
+ * @param maxEpochs Maximum number of epochs of each fold
+ * @param desiredError Desired error
+ * @param nThreads Number of threads, or 0 for one per processor
+ * @param folds Array of k fold results, filled on success. The caller must
+ *              destroy their networks
+ * @return 0 on success, -1 on error
+ */
+int crossval_run(struct fann *ann, struct arena_data *arena, unsigned int k, int shuffle,
+        unsigned int maxEpochs, float desiredError, unsigned int nThreads, struct crossval_fold *folds)
+{
+    const struct fann_train_data *data = &arena->data;
+    unsigned int n = data->num_data;
+    if (k < 2 || k > n) {
+        fprintf(stderr, "The number of folds must be between 2 and the number of samples (%u)\n", n);
+        return -1;
+    }
+
+    if (nThreads == 0) nThreads = threads_available();
+    unsigned int nSlots = (nThreads < k) ? nThreads : k;
+    int *busy = (int *) calloc(nSlots, sizeof(int));
+    fann_type **rows = (fann_type **) malloc(sizeof(fann_type *) * n * 2 * nSlots);
+    if (busy == NULL || rows == NULL) {
+        fprintf(stderr, "Not enough memory for %u folds\n", k);
+        free(busy);
+        free(rows);
+        return -1;
+    }
+
+    if (shuffle) arena_shuffle(arena);
+
+    int result = 0;
+    unsigned int nCopies = 0;
+    for (unsigned int i = 0; i < k; i++) {
+        unsigned int first = (unsigned int) ((unsigned long) i * n / k);
+        unsigned int last = (unsigned int) ((unsigned long) (i + 1) * n / k);
+        folds[i].trainSamples = n - (last - first);
+        folds[i].testSamples = last - first;
+        folds[i].ann = fann_copy(ann);
+        if (folds[i].ann == NULL) {
+            result = -1;
+            break;
+        }
+        nCopies++;
+    }
+
+    if (result == 0) {
+        struct crossval_job job = {data, k, rows, busy, nSlots, folds, maxEpochs, desiredError};
+        threads_run(nSlots, k, run_fold, &job);
+    } else {
+        fprintf(stderr, "Could not copy the ANN\n");
+        for (unsigned int i = 0; i < nCopies; i++) {
+            fann_destroy(folds[i].ann);
+            folds[i].ann = NULL;
+        }
+    }
+
+    free(busy);
+    free(rows);
+    return result;
+}
@@ -0,0 +1,45 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef CROSSVAL_H
+#define	CROSSVAL_H
+
+#include <fann.h>
+#include "arena.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/** Result of a cross-validation fold */
+struct crossval_fold {
+    unsigned int trainSamples;  /**< Samples the fold's network was trained on */
+    unsigned int testSamples;   /**< Samples held out to test it */
+    float trainMSE;             /**< MSE of the last training epoch */
+    float testMSE;              /**< MSE on the held out samples */
+    unsigned int bitFail;       /**< Bit fail count on the held out samples */
+    struct fann *ann;           /**< Trained network, owned by the caller */
+};
+
+int crossval_run(struct fann *ann, struct arena_data *arena, unsigned int k, int shuffle,
+        unsigned int maxEpochs, float desiredError, unsigned int nThreads, struct crossval_fold *folds);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* CROSSVAL_H */
@@ -0,0 +1,1225 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+/*
+ * Out-of-core data file processing.
+ *
+ * Data files are processed as streams of samples, so they may be far larger
+ * than the available memory. Readers parse samples ahead on a background
+ * thread and writers format and write them on another one; both hand blocks
+ * of samples over a small ring shared with the calling thread. Writers leave
+ * room for the number of samples in the header and fill it in when they are
+ * finished, so it is always right whatever the number of samples written.
+ *
+ * Two formats are supported, the FANN text format and a binary format holding
+ * raw values, which is several times faster to read and write. Readers detect
+ * the format of a file from its first bytes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include "dataset.h"
+#include "parse.h"
+#include "cache.h"
+
+/** Blocks in the ring between a reader or writer thread and the calling thread */
+#define PIPE_BLOCKS 4
+
+/** Approximate size of a block in bytes */
+#define BLOCK_BYTES (1 << 20)
+
+/** Maximum number of temporary files of an external shuffle */
+#define MAX_BUCKETS 1024
+
+/** Descriptors left for the input, the output and their threads when sizing an external shuffle */
+#define SPARE_FDS   16
+
+/** Width of the number of samples in text headers, so that it can be rewritten in place */
+#define COUNT_WIDTH 10
+
+/**
+ * State shared by a reader or writer and its thread.
+ * The producer fills the block following the queued ones and the consumer
+ * keeps the head block until it asks for the next one.
+ */
+struct dataset_impl {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    fann_type *values;              /**< PIPE_BLOCKS blocks of blockRows samples */
+    unsigned int width;             /**< Values per sample */
+    unsigned int blockRows;         /**< Samples per block */
+    unsigned int rows[PIPE_BLOCKS]; /**< Samples in each queued block */
+    unsigned int head;              /**< First queued block */
+    unsigned int count;             /**< Queued blocks, including the one held by the consumer */
+    int held;                       /**< Non-zero while the consumer holds the head block */
+    int done;                       /**< Non-zero once the producer has finished */
+    int cancel;                     /**< Non-zero once the consumer has given up */
+    int error;                      /**< Non-zero if either side failed */
+    fann_type *fill;                /**< Block being filled by the calling thread (writers) */
+    unsigned int pos;               /**< Next sample in the held (readers) or filled (writers) block */
+    struct parse_src *src;          /**< Text source (readers) */
+    FILE *fp;                       /**< Binary source (readers) or destination (writers) */
+    char *tempPath;                 /**< File written in place of the destination until it is complete (writers) */
+};
+
+static struct dataset_impl *impl_create(unsigned int width)
+{
+    struct dataset_impl *impl = (struct dataset_impl *) calloc(1, sizeof(struct dataset_impl));
+    if (impl == NULL) return NULL;
+    impl->width = width;
+    impl->blockRows = BLOCK_BYTES / (width * sizeof(fann_type));
+    if (impl->blockRows == 0) impl->blockRows = 1;
+    impl->values = (fann_type *) malloc(sizeof(fann_type) * width * impl->blockRows * PIPE_BLOCKS);
+    if (impl->values == NULL) {
+        free(impl);
+        return NULL;
+    }
+    pthread_mutex_init(&impl->lock, NULL);
+    pthread_cond_init(&impl->changed, NULL);
+    return impl;
+}
+
+static void impl_destroy(struct dataset_impl *impl)
+{
+    pthread_mutex_destroy(&impl->lock);
+    pthread_cond_destroy(&impl->changed);
+    free(impl->values);
+    free(impl->tempPath);
+    free(impl);
+}
+
+/**
+ * Get the block the producer fills next, waiting for it to be free
+ * @return Block, or NULL if the consumer has given up
+ */
+static fann_type *pipe_slot(struct dataset_impl *impl)
+{
+    fann_type *block = NULL;
+    pthread_mutex_lock(&impl->lock);
+    while (impl->count == PIPE_BLOCKS && !impl->cancel) pthread_cond_wait(&impl->changed, &impl->lock);
+    if (!impl->cancel) {
+        block = impl->values + (size_t) ((impl->head + impl->count) % PIPE_BLOCKS) * impl->blockRows * impl->width;
+    }
+    pthread_mutex_unlock(&impl->lock);
+    return block;
+}
+
+/** Queue the block returned by pipe_slot(), holding the given number of samples */
+static void pipe_push(struct dataset_impl *impl, unsigned int rows)
+{
+    pthread_mutex_lock(&impl->lock);
+    impl->rows[(impl->head + impl->count) % PIPE_BLOCKS] = rows;
+    impl->count++;
+    pthread_cond_broadcast(&impl->changed);
+    pthread_mutex_unlock(&impl->lock);
+}
+
+/** Signal that the producer has finished, successfully or not */
+static void pipe_end(struct dataset_impl *impl, int error)
+{
+    pthread_mutex_lock(&impl->lock);
+    impl->done = 1;
+    if (error) impl->error = 1;
+    pthread_cond_broadcast(&impl->changed);
+    pthread_mutex_unlock(&impl->lock);
+}
+
+/** Signal that the consumer gives up, failing if error is non-zero */
+static void pipe_cancel(struct dataset_impl *impl, int error)
+{
+    pthread_mutex_lock(&impl->lock);
+    impl->cancel = 1;
+    if (error) impl->error = 1;
+    pthread_cond_broadcast(&impl->changed);
+    pthread_mutex_unlock(&impl->lock);
+}
+
+/**
+ * Release the held block, if any, and hold the next one, waiting for it
+ * @return Samples in the block, or 0 once the producer has finished and all blocks are consumed
+ */
+static unsigned int pipe_pop(struct dataset_impl *impl)
+{
+    unsigned int rows = 0;
+    pthread_mutex_lock(&impl->lock);
+    if (impl->held) {
+        impl->head = (impl->head + 1) % PIPE_BLOCKS;
+        impl->count--;
+        impl->held = 0;
+        pthread_cond_broadcast(&impl->changed);
+    }
+    while (impl->count == 0 && !impl->done) pthread_cond_wait(&impl->changed, &impl->lock);
+    if (impl->count > 0) {
+        impl->held = 1;
+        impl->pos = 0;
+        rows = impl->rows[impl->head];
+    }
+    pthread_mutex_unlock(&impl->lock);
+    return rows;
+}
+
+/** Block held by the consumer */
+static fann_type *pipe_head(struct dataset_impl *impl)
+{
+    return impl->values + (size_t) impl->head * impl->blockRows * impl->width;
+}
+
+/**
+ * Read samples from a reader's file
+ * @return 0 on success, -1 on error (reported)
+ */
+static int read_rows(struct dataset_reader *reader, unsigned int done, fann_type *block, unsigned int rows)
+{
+    struct dataset_impl *impl = reader->impl;
+    if (reader->format == DATASET_FORMAT_BINARY) {
+        size_t got = fread(block, sizeof(fann_type) * impl->width, rows, impl->fp);
+        if (got != rows) {
+            if (ferror(impl->fp)) {
+                fprintf(stderr, "%s: could not read file\n", reader->name);
+            } else {
+                fprintf(stderr, "%s: unexpected end of file: found %u of %u samples\n", reader->name, done + (unsigned int) got, reader->numData);
+            }
+            return -1;
+        }
+        return 0;
+    }
+    for (unsigned int i = 0; i < rows; i++) {
+        int r = parse_row(impl->src, block + (size_t) i * impl->width, impl->width);
+        if (r < 0) return -1;
+        if (r == 0) {
+            fprintf(stderr, "%s:%lu: unexpected end of file: found %u of %u samples\n", reader->name, impl->src->line, done + i, reader->numData);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Check that nothing follows the last sample of a reader's file
+ * @return 0 on success, -1 on error (reported)
+ */
+static int read_end(struct dataset_reader *reader)
+{
+    struct dataset_impl *impl = reader->impl;
+    if (reader->format == DATASET_FORMAT_BINARY) {
+        if (fgetc(impl->fp) == EOF) return 0;
+        fprintf(stderr, "%s: unexpected data after the last of %u samples\n", reader->name, reader->numData);
+        return -1;
+    }
+    fann_type value;
+    int r = parse_next(impl->src, &value);
+    if (r > 0) fprintf(stderr, "%s:%lu: unexpected data after the last of %u samples\n", reader->name, impl->src->line, reader->numData);
+    return (r == 0) ? 0 : -1;
+}
+
+/** Reader thread: parse samples ahead of the calling thread */
+static void *read_task(void *arg)
+{
+    struct dataset_reader *reader = (struct dataset_reader *) arg;
+    struct dataset_impl *impl = reader->impl;
+    unsigned int done = 0;
+    int error = 0;
+
+    while (done < reader->numData) {
+        fann_type *block = pipe_slot(impl);
+        if (block == NULL) break;
+        unsigned int rows = reader->numData - done;
+        if (rows > impl->blockRows) rows = impl->blockRows;
+        if (read_rows(reader, done, block, rows) != 0) {
+            error = 1;
+            break;
+        }
+        pipe_push(impl, rows);
+        done += rows;
+    }
+    if (!error && done == reader->numData && read_end(reader) != 0) error = 1;
+    pipe_end(impl, error);
+    return NULL;
+}
+
+/**
+ * Open a data file in either format and start reading its samples
+ * @param path File path
+ * @return Reader, or NULL on error (reported)
+ */
+struct dataset_reader *dataset_open(const char *path)
+{
+    struct dataset_binary_header header;
+    struct dataset_reader *reader = (struct dataset_reader *) calloc(1, sizeof(struct dataset_reader));
+    struct parse_src *src = NULL;
+    FILE *fp = fopen(path, "rb");
+
+    if (reader == NULL) return NULL;
+    if (fp == NULL) {
+        fprintf(stderr, "%s: could not open file\n", path);
+        free(reader);
+        return NULL;
+    }
+    reader->name = path;
+
+    if (fread(&header, sizeof(header), 1, fp) == 1 && memcmp(header.magic, DATASET_BINARY_MAGIC, sizeof(header.magic)) == 0) {
+        if (header.typeSize != sizeof(fann_type)) {
+            fprintf(stderr, "%s: file holds %u-byte values but this build uses %u-byte values\n", path, header.typeSize, (unsigned int) sizeof(fann_type));
+            goto ERR;
+        }
+        if (header.numInput == 0 || header.numOutput == 0) {
+            fprintf(stderr, "%s: invalid header\n", path);
+            goto ERR;
+        }
+        reader->format = DATASET_FORMAT_BINARY;
+        reader->numData = header.numData;
+        reader->numInput = header.numInput;
+        reader->numOutput = header.numOutput;
+    } else {
+        fclose(fp);
+        fp = NULL;
+        src = parse_open(path);
+        if (src == NULL || parse_header(src, &reader->numData, &reader->numInput, &reader->numOutput) != 0) goto ERR;
+        reader->format = DATASET_FORMAT_TEXT;
+    }
+
+    reader->impl = impl_create(reader->numInput + reader->numOutput);
+    if (reader->impl == NULL) {
+        fprintf(stderr, "%s: not enough memory\n", path);
+        goto ERR;
+    }
+    reader->impl->src = src;
+    reader->impl->fp = fp;
+    if (pthread_create(&reader->impl->thread, NULL, read_task, reader) != 0) {
+        fprintf(stderr, "%s: could not start reader thread\n", path);
+        impl_destroy(reader->impl);
+        goto ERR;
+    }
+    return reader;
+
+ERR:
+    if (fp != NULL) fclose(fp);
+    parse_close(src);
+    free(reader);
+    return NULL;
+}
+
+/**
+ * Read the next sample
+ * @param reader Reader
+ * @return Sample values (inputs followed by outputs), valid until the next
+ *         call, or NULL at the end of the file or on error. dataset_close()
+ *         tells which
+ */
+const fann_type *dataset_read(struct dataset_reader *reader)
+{
+    struct dataset_impl *impl = reader->impl;
+    if (!impl->held || impl->pos == impl->rows[impl->head]) {
+        if (pipe_pop(impl) == 0) return NULL;
+    }
+    return pipe_head(impl) + (size_t) impl->pos++ * impl->width;
+}
+
+/**
+ * Close a reader, whether all of its samples were read or not
+ * @param reader Reader
+ * @return 0 if no error was found, -1 otherwise (reported)
+ */
+int dataset_close(struct dataset_reader *reader)
+{
+    if (reader == NULL) return 0;
+    struct dataset_impl *impl = reader->impl;
+    pipe_cancel(impl, 0);
+    pthread_join(impl->thread, NULL);
+    int result = impl->error ? -1 : 0;
+    if (impl->fp != NULL) fclose(impl->fp);
+    parse_close(impl->src);
+    impl_destroy(impl);
+    free(reader);
+    return result;
+}
+
+/**
+ * Write a file header
+ * @return 0 on success, -1 on error
+ */
+static int write_header(struct dataset_writer *writer, FILE *fp)
+{
+    if (writer->format == DATASET_FORMAT_BINARY) {
+        struct dataset_binary_header header;
+        memcpy(header.magic, DATASET_BINARY_MAGIC, sizeof(header.magic));
+        header.numData = writer->numData;
+        header.numInput = writer->numInput;
+        header.numOutput = writer->numOutput;
+        header.typeSize = sizeof(fann_type);
+        return (fwrite(&header, sizeof(header), 1, fp) == 1) ? 0 : -1;
+    }
+    return (fprintf(fp, "%-*u %u %u\n", COUNT_WIDTH, writer->numData, writer->numInput, writer->numOutput) > 0) ? 0 : -1;
+}
+
+/**
+ * Write samples to a writer's file
+ * @return 0 on success, -1 on error
+ */
+static int write_rows(struct dataset_writer *writer, const fann_type *block, unsigned int rows)
+{
+    struct dataset_impl *impl = writer->impl;
+    FILE *fp = impl->fp;
+    if (writer->format == DATASET_FORMAT_BINARY) {
+        return (fwrite(block, sizeof(fann_type) * impl->width, rows, fp) == rows) ? 0 : -1;
+    }
+
+    //Shortest representations that read back to the same values
+    const char *fmt = (sizeof(fann_type) == sizeof(float)) ? "%.9g" : "%.17g";
+    for (unsigned int i = 0; i < rows; i++) {
+        const fann_type *sample = block + (size_t) i * impl->width;
+        for (unsigned int j = 0; j < impl->width; j++) {
+            fprintf(fp, fmt, (double) sample[j]);
+            fputc((j + 1 == writer->numInput || j + 1 == impl->width) ? '\n' : ' ', fp);
+        }
+    }
+    return ferror(fp) ? -1 : 0;
+}
+
+/** Writer thread: format and write the samples queued by the calling thread */
+static void *write_task(void *arg)
+{
+    struct dataset_writer *writer = (struct dataset_writer *) arg;
+    struct dataset_impl *impl = writer->impl;
+    unsigned int rows;
+
+    while ((rows = pipe_pop(impl)) > 0) {
+        if (write_rows(writer, pipe_head(impl), rows) != 0) {
+            fprintf(stderr, "%s: could not write file\n", writer->name);
+            pipe_cancel(impl, 1);
+            break;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Create a data file and start writing samples to it. The samples go to a
+ * temporary file next to it, which replaces the file only once
+ * dataset_finish() succeeds, so an existing file is never left half written
+ * @param path File path
+ * @param format File format
+ * @param numInput Number of inputs
+ * @param numOutput Number of outputs
+ * @return Writer, or NULL on error (reported)
+ */
+struct dataset_writer *dataset_create(const char *path, enum dataset_format format, unsigned int numInput, unsigned int numOutput)
+{
+    struct dataset_writer *writer = (struct dataset_writer *) calloc(1, sizeof(struct dataset_writer));
+    if (writer == NULL) return NULL;
+    writer->name = path;
+    writer->format = format;
+    writer->numInput = numInput;
+    writer->numOutput = numOutput;
+
+    char *tempPath = (char *) malloc(PATH_MAX);
+    int fd = (tempPath != NULL) ? cache_temp_file(path, tempPath) : -1;
+    FILE *fp = (fd >= 0) ? fdopen(fd, "wb") : NULL;
+    if (fp == NULL) {
+        fprintf(stderr, "%s: could not create file\n", path);
+        if (fd >= 0) {
+            close(fd);
+            unlink(tempPath);
+        }
+        free(tempPath);
+        free(writer);
+        return NULL;
+    }
+    if (write_header(writer, fp) != 0) {
+        fprintf(stderr, "%s: could not write file\n", path);
+        goto ERR;
+    }
+    writer->impl = impl_create(numInput + numOutput);
+    if (writer->impl == NULL) {
+        fprintf(stderr, "%s: not enough memory\n", path);
+        goto ERR;
+    }
+    writer->impl->fp = fp;
+    if (pthread_create(&writer->impl->thread, NULL, write_task, writer) != 0) {
+        fprintf(stderr, "%s: could not start writer thread\n", path);
+        impl_destroy(writer->impl);
+        goto ERR;
+    }
+    writer->impl->tempPath = tempPath;
+    return writer;
+
+ERR:
+    fclose(fp);
+    unlink(tempPath);
+    free(tempPath);
+    free(writer);
+    return NULL;
+}
+
+/**
+ * Write a sample
+ * @param writer Writer
+ * @param sample Sample values (inputs followed by outputs)
+ * @return 0 on success, -1 on error (reported)
+ */
+int dataset_write(struct dataset_writer *writer, const fann_type *sample)
+{
+    struct dataset_impl *impl = writer->impl;
+    if (writer->numData == UINT_MAX) {
+        fprintf(stderr, "%s: too many samples\n", writer->name);
+        return -1;
+    }
+    if (impl->fill == NULL) {
+        impl->fill = pipe_slot(impl);
+        if (impl->fill == NULL) return -1;
+        impl->pos = 0;
+    }
+    memcpy(impl->fill + (size_t) impl->pos * impl->width, sample, sizeof(fann_type) * impl->width);
+    writer->numData++;
+    if (++impl->pos == impl->blockRows) {
+        pipe_push(impl, impl->pos);
+        impl->fill = NULL;
+    }
+    return 0;
+}
+
+/**
+ * Write the pending samples, fix up the header and close the file, replacing
+ * the destination. On error the destination is left untouched
+ * @param writer Writer
+ * @return 0 on success, -1 on error (reported)
+ */
+int dataset_finish(struct dataset_writer *writer)
+{
+    if (writer == NULL) return 0;
+    struct dataset_impl *impl = writer->impl;
+    if (impl->fill != NULL && impl->pos > 0) pipe_push(impl, impl->pos);
+    pipe_end(impl, 0);
+    pthread_join(impl->thread, NULL);
+
+    int result = impl->error ? -1 : 0;
+    if (result == 0 && (fflush(impl->fp) != 0 || fseek(impl->fp, 0, SEEK_SET) != 0 || write_header(writer, impl->fp) != 0)) {
+        fprintf(stderr, "%s: could not write file header\n", writer->name);
+        result = -1;
+    }
+    if (fclose(impl->fp) != 0 && result == 0) {
+        fprintf(stderr, "%s: could not write file\n", writer->name);
+        result = -1;
+    }
+    if (result == 0 && rename(impl->tempPath, writer->name) != 0) {
+        fprintf(stderr, "%s: could not replace file\n", writer->name);
+        result = -1;
+    }
+    if (result != 0) unlink(impl->tempPath);
+    impl_destroy(impl);
+    free(writer);
+    return result;
+}
+
+/**
+ * Stop writing and delete what was written, leaving the destination untouched
+ * @param writer Writer, or NULL
+ */
+void dataset_discard(struct dataset_writer *writer)
+{
+    if (writer == NULL) return;
+    struct dataset_impl *impl = writer->impl;
+    pipe_end(impl, 1);
+    pthread_join(impl->thread, NULL);
+    fclose(impl->fp);
+    unlink(impl->tempPath);
+    impl_destroy(impl);
+    free(writer);
+}
+
+/** Next value of a SplitMix64 generator */
+static uint64_t rng_next(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/** Random integer in [0, n) */
+static uint64_t rng_below(uint64_t *state, uint64_t n)
+{
+    return rng_next(state) % n;
+}
+
+/**
+ * Check that an output file is not one of the input files
+ * @return 0 if it is not, -1 otherwise (reported)
+ */
+static int check_output(const char *output, unsigned int nInputs, const char *const *inputs)
+{
+    struct stat out, in;
+    if (stat(output, &out) != 0) return 0;
+    for (unsigned int i = 0; i < nInputs; i++) {
+        if (stat(inputs[i], &in) == 0 && in.st_dev == out.st_dev && in.st_ino == out.st_ino) {
+            fprintf(stderr, "%s: output file is also an input file\n", output);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Apportion a number of samples among parts in proportion to their weights,
+ * using the largest remainders to round
+ * @param total Samples to apportion
+ * @param n Number of parts
+ * @param weights Weight of each part, adding up to 1
+ * @param counts Output samples of each part
+ */
+static void apportion(unsigned int total, unsigned int n, const double *weights, unsigned int *counts)
+{
+    unsigned int assigned = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        counts[i] = (unsigned int) (weights[i] * total);
+        assigned += counts[i];
+    }
+    while (assigned < total) {
+        unsigned int best = 0;
+        double bestRemainder = -1;
+        for (unsigned int i = 0; i < n; i++) {
+            double remainder = weights[i] * total - counts[i];
+            if (remainder > bestRemainder) {
+                bestRemainder = remainder;
+                best = i;
+            }
+        }
+        counts[best]++;
+        assigned++;
+    }
+}
+
+/**
+ * Number of temporary files to scatter samples into, so that each one can
+ * be shuffled in memory
+ * @param bytes Size of the samples
+ * @param memory Memory to use for shuffling, in bytes
+ * @param rowBytes Size of a sample
+ * @param limit Maximum number of files, at least 1
+ * @return Number of files, 1 if the samples fit in memory, up to limit
+ */
+static unsigned int bucket_count(double bytes, size_t memory, size_t rowBytes, unsigned int limit)
+{
+    if (bytes <= memory) return 1;
+    //Leave room for buckets larger than the average
+    double n = bytes * 1.25 / (double) (memory > rowBytes ? memory : rowBytes);
+    return (n >= limit) ? limit : (unsigned int) n + 1;
+}
+
+/**
+ * Number of temporary files an external shuffle may keep open at once,
+ * within MAX_BUCKETS and the limit on open files of the process
+ * @return Number of files, at least 2
+ */
+static unsigned int bucket_limit(void)
+{
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0 || rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur >= MAX_BUCKETS + SPARE_FDS) return MAX_BUCKETS;
+    return (rl.rlim_cur >= SPARE_FDS + 2) ? (unsigned int) (rl.rlim_cur - SPARE_FDS) : 2;
+}
+
+/**
+ * Create anonymous temporary files
+ * @param buckets Output files
+ * @param n Number of files
+ * @param tempDir Directory
+ * @return 0 on success, -1 on error (reported)
+ */
+static int create_buckets(FILE **buckets, unsigned int n, const char *tempDir)
+{
+    size_t pathSize = strlen(tempDir) + 32;
+    char *path = (char *) malloc(pathSize);
+    for (unsigned int i = 0; path != NULL && i < n; i++) {
+        snprintf(path, pathSize, "%s/fannc-shuffle-XXXXXX", tempDir);
+        int fd = mkstemp(path);
+        if (fd < 0) break;
+        unlink(path);
+        buckets[i] = fdopen(fd, "w+b");
+        if (buckets[i] == NULL) {
+            close(fd);
+            break;
+        }
+    }
+    free(path);
+    if (buckets[n - 1] == NULL) {
+        fprintf(stderr, "Could not create temporary files in %s\n", tempDir);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Close temporary files
+ * @param buckets Files, NULL entries are skipped
+ * @param n Number of files
+ */
+static void close_buckets(FILE **buckets, unsigned int n)
+{
+    for (unsigned int i = 0; buckets != NULL && i < n; i++) {
+        if (buckets[i] != NULL) fclose(buckets[i]);
+    }
+    free(buckets);
+}
+
+/**
+ * Read back the samples of a temporary file
+ * @param bucket File
+ * @param rows Output samples
+ * @param count Number of samples
+ * @param rowBytes Size of a sample
+ * @return 0 on success, -1 on error (reported)
+ */
+static int read_bucket(FILE *bucket, char *rows, unsigned int count, size_t rowBytes)
+{
+    if (fflush(bucket) != 0 || fseek(bucket, 0, SEEK_SET) != 0 || fread(rows, rowBytes, count, bucket) != count) {
+        fprintf(stderr, "Could not read temporary files\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Shuffle samples in memory and write them
+ * @param writer Writer
+ * @param rows Samples, followed by room for one more used as scratch
+ * @param count Number of samples
+ * @param rowBytes Size of a sample
+ * @param seed Random state
+ * @return 0 on success, -1 on error (reported)
+ */
+static int write_shuffled(struct dataset_writer *writer, char *rows, unsigned int count, size_t rowBytes, uint64_t *seed)
+{
+    char *tmp = rows + rowBytes * count;
+    //Fisher-Yates
+    for (unsigned int i = count; i > 1; i--) {
+        unsigned int j = (unsigned int) rng_below(seed, i);
+        if (j != i - 1) {
+            memcpy(tmp, rows + rowBytes * j, rowBytes);
+            memcpy(rows + rowBytes * j, rows + rowBytes * (i - 1), rowBytes);
+            memcpy(rows + rowBytes * (i - 1), tmp, rowBytes);
+        }
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        if (dataset_write(writer, (const fann_type *) (rows + rowBytes * i)) != 0) return -1;
+    }
+    return 0;
+}
+
+/**
+ * Shuffle a temporary file too large for memory: scatter it again into
+ * smaller temporary files, then shuffle and write each of them
+ * @param writer Writer
+ * @param bucket File
+ * @param count Number of samples in the file
+ * @param rows Buffer for *capacity samples, plus one. Grown if a smaller file
+ *             turns out larger than it
+ * @param capacity Capacity of the buffer
+ * @param rowBytes Size of a sample
+ * @param memory Memory to use for shuffling, in bytes
+ * @param limit Maximum number of temporary files, which must fit in the free descriptors
+ * @param tempDir Directory for temporary files
+ * @param seed Random state
+ * @return 0 on success, -1 on error (reported)
+ */
+static int shuffle_large_bucket(struct dataset_writer *writer, FILE *bucket, unsigned int count, char **rows, unsigned int *capacity,
+        size_t rowBytes, size_t memory, unsigned int limit, const char *tempDir, uint64_t *seed)
+{
+    unsigned int nBuckets = bucket_count((double) count * rowBytes, memory, rowBytes, limit);
+    FILE **buckets = (FILE **) calloc(nBuckets, sizeof(FILE *));
+    unsigned int *counts = (unsigned int *) calloc(nBuckets, sizeof(unsigned int));
+    int result = -1;
+
+    if (buckets == NULL || counts == NULL) {
+        fprintf(stderr, "Not enough memory\n");
+        goto END;
+    }
+    if (create_buckets(buckets, nBuckets, tempDir) != 0) goto END;
+
+    if (fflush(bucket) != 0 || fseek(bucket, 0, SEEK_SET) != 0) {
+        fprintf(stderr, "Could not read temporary files\n");
+        goto END;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int b = (unsigned int) rng_below(seed, nBuckets);
+        if (fread(*rows, rowBytes, 1, bucket) != 1) {
+            fprintf(stderr, "Could not read temporary files\n");
+            goto END;
+        }
+        if (fwrite(*rows, rowBytes, 1, buckets[b]) != 1) {
+            fprintf(stderr, "Could not write temporary files in %s\n", tempDir);
+            goto END;
+        }
+        counts[b]++;
+    }
+
+    for (unsigned int b = 0; b < nBuckets; b++) {
+        if (counts[b] > *capacity) {
+            char *grown = (char *) realloc(*rows, rowBytes * ((size_t) counts[b] + 1));
+            if (grown == NULL) {
+                fprintf(stderr, "Not enough memory to shuffle %u samples. Try a smaller --memory\n", counts[b]);
+                goto END;
+            }
+            *rows = grown;
+            *capacity = counts[b];
+        }
+        if (read_bucket(buckets[b], *rows, counts[b], rowBytes) != 0) goto END;
+        if (write_shuffled(writer, *rows, counts[b], rowBytes, seed) != 0) goto END;
+    }
+    result = 0;
+
+END:
+    close_buckets(buckets, nBuckets);
+    free(counts);
+    return result;
+}
+
+/**
+ * Shuffle the samples of a data file, which may be larger than the available memory.
+ * Files that do not fit in memory are scattered at random into temporary
+ * files, each one small enough to be shuffled in memory, which are then
+ * shuffled and written one after another. The number of temporary files is
+ * bounded by MAX_BUCKETS and the limit on open files; when that is not enough,
+ * half of the descriptors are kept to scatter each temporary file that is
+ * still too large once more when its turn comes. The output may be the input file.
+ * @param input Input file path
+ * @param output Output file path
+ * @param format Output format, or -1 for the input's
+ * @param memory Memory to use for shuffling, in bytes
+ * @param tempDir Directory for temporary files, or NULL for $TMPDIR or /tmp
+ * @param seed Random seed
+ * @return 0 on success, -1 on error (reported)
+ */
+int dataset_shuffle(const char *input, const char *output, int format, size_t memory, const char *tempDir, uint64_t seed)
+{
+    struct dataset_reader *reader = dataset_open(input);
+    if (reader == NULL) return -1;
+
+    unsigned int numInput = reader->numInput, numOutput = reader->numOutput;
+    enum dataset_format outFormat = (format < 0) ? reader->format : (enum dataset_format) format;
+    size_t rowBytes = sizeof(fann_type) * (numInput + numOutput);
+    unsigned int limit = bucket_limit();
+    unsigned int nBuckets = bucket_count((double) reader->numData * rowBytes, memory, rowBytes, limit);
+    //Too many samples for one scatter: keep half the descriptors to scatter each bucket again
+    if (nBuckets == limit) nBuckets = limit / 2;
+    //Samples shuffled in memory at once
+    unsigned int memRows = (memory / rowBytes > UINT_MAX - 1) ? UINT_MAX - 1 : (memory / rowBytes > 0) ? (unsigned int) (memory / rowBytes) : 1;
+
+    FILE **buckets = (FILE **) calloc(nBuckets, sizeof(FILE *));
+    unsigned int *counts = (unsigned int *) calloc(nBuckets, sizeof(unsigned int));
+    char *rows = NULL;
+    unsigned int capacity = 0;
+    struct dataset_writer *writer = NULL;
+    int result = -1;
+
+    if (tempDir == NULL) tempDir = getenv("TMPDIR");
+    if (tempDir == NULL || *tempDir == '\0') tempDir = "/tmp";
+
+    if (buckets == NULL || counts == NULL) {
+        fprintf(stderr, "Not enough memory\n");
+        dataset_close(reader);
+        goto END;
+    }
+
+    if (nBuckets == 1) {
+        //Shuffle in memory
+        rows = (char *) malloc(rowBytes * ((size_t) reader->numData + 1));
+        if (rows == NULL) {
+            fprintf(stderr, "Not enough memory to shuffle %u samples. Try a smaller --memory\n", reader->numData);
+            dataset_close(reader);
+            goto END;
+        }
+        const fann_type *sample;
+        while ((sample = dataset_read(reader)) != NULL) {
+            memcpy(rows + rowBytes * counts[0]++, sample, rowBytes);
+        }
+    } else {
+        if (create_buckets(buckets, nBuckets, tempDir) != 0) {
+            dataset_close(reader);
+            goto END;
+        }
+
+        const fann_type *sample;
+        while ((sample = dataset_read(reader)) != NULL) {
+            unsigned int b = (unsigned int) rng_below(&seed, nBuckets);
+            if (fwrite(sample, rowBytes, 1, buckets[b]) != 1) {
+                fprintf(stderr, "Could not write temporary files in %s\n", tempDir);
+                dataset_close(reader);
+                goto END;
+            }
+            counts[b]++;
+        }
+    }
+    if (dataset_close(reader) != 0) goto END;
+
+    if (rows == NULL) {
+        //Buckets larger than memory are scattered again, through a buffer of memRows samples
+        unsigned int largest = 0;
+        for (unsigned int b = 0; b < nBuckets; b++) {
+            if (counts[b] > largest) largest = counts[b];
+        }
+        capacity = (largest > memRows) ? memRows : largest;
+        rows = (char *) malloc(rowBytes * ((size_t) capacity + 1));
+        if (rows == NULL) {
+            fprintf(stderr, "Not enough memory to shuffle %u samples. Try a smaller --memory\n", capacity);
+            goto END;
+        }
+    }
+
+    writer = dataset_create(output, outFormat, numInput, numOutput);
+    if (writer == NULL) goto END;
+
+    for (unsigned int b = 0; b < nBuckets; b++) {
+        if (nBuckets == 1) {
+            if (write_shuffled(writer, rows, counts[b], rowBytes, &seed) != 0) goto END;
+        } else if (counts[b] > memRows) {
+            //Buckets b to nBuckets - 1 are still open
+            if (shuffle_large_bucket(writer, buckets[b], counts[b], &rows, &capacity, rowBytes, memory, limit - (nBuckets - b), tempDir, &seed) != 0) goto END;
+        } else {
+            if (read_bucket(buckets[b], rows, counts[b], rowBytes) != 0) goto END;
+            if (write_shuffled(writer, rows, counts[b], rowBytes, &seed) != 0) goto END;
+        }
+        //Done with this bucket: free its descriptor for the next ones scattered again
+        if (buckets[b] != NULL) {
+            fclose(buckets[b]);
+            buckets[b] = NULL;
+        }
+    }
+    result = 0;
+
+END:
+    if (result != 0) {
+        dataset_discard(writer);
+    } else if (dataset_finish(writer) != 0) {
+        result = -1;
+    }
+    close_buckets(buckets, nBuckets);
+    free(counts);
+    free(rows);
+    return result;
+}
+
+/**
+ * Split a data file into several ones.
+ * Samples go to the outputs in order (the first samples to the first output,
+ * and so on) or, if random is non-zero, each one to an output drawn at random,
+ * so that the outputs get a random partition of the input with the requested
+ * sizes, keeping the input order.
+ * @param input Input file path
+ * @param nOutputs Number of outputs
+ * @param outputs Output file paths
+ * @param fractions Fraction of the samples of each output. When there is one
+ *                  fraction less than outputs, the last output gets the
+ *                  remaining samples. Otherwise fractions are weights
+ * @param nFractions Number of fractions, either nOutputs or nOutputs - 1
+ * @param random Non-zero to draw the output of each sample at random
+ * @param format Output format, or -1 for the input's
+ * @param seed Random seed
+ * @return 0 on success, -1 on error (reported)
+ */
+int dataset_split(const char *input, unsigned int nOutputs, const char *const *outputs, const double *fractions,
+        unsigned int nFractions, int random, int format, uint64_t seed)
+{
+    if (nFractions + 1 != nOutputs && nFractions != nOutputs) {
+        fprintf(stderr, "Expected %u or %u fractions for %u outputs\n", nOutputs - 1, nOutputs, nOutputs);
+        return -1;
+    }
+    double sum = 0;
+    for (unsigned int i = 0; i < nFractions; i++) {
+        if (fractions[i] < 0) {
+            fprintf(stderr, "Fractions must not be negative\n");
+            return -1;
+        }
+        sum += fractions[i];
+    }
+    if ((nFractions < nOutputs && sum > 1 + 1e-9) || (nFractions == nOutputs && sum <= 0)) {
+        fprintf(stderr, "Invalid fractions: they add up to %g\n", sum);
+        return -1;
+    }
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        if (check_output(outputs[i], 1, &input) != 0) return -1;
+    }
+
+    struct dataset_reader *reader = dataset_open(input);
+    if (reader == NULL) return -1;
+
+    enum dataset_format outFormat = (format < 0) ? reader->format : (enum dataset_format) format;
+    double *weights = (double *) malloc(sizeof(double) * nOutputs);
+    unsigned int *left = (unsigned int *) malloc(sizeof(unsigned int) * nOutputs);
+    struct dataset_writer **writers = (struct dataset_writer **) calloc(nOutputs, sizeof(struct dataset_writer *));
+    int result = -1;
+
+    if (weights == NULL || left == NULL || writers == NULL) {
+        fprintf(stderr, "Not enough memory\n");
+        goto END;
+    }
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        weights[i] = (i < nFractions) ? ((nFractions == nOutputs) ? fractions[i] / sum : fractions[i]) : 1 - sum;
+        if (weights[i] < 0) weights[i] = 0;
+    }
+    apportion(reader->numData, nOutputs, weights, left);
+
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        writers[i] = dataset_create(outputs[i], outFormat, reader->numInput, reader->numOutput);
+        if (writers[i] == NULL) goto END;
+    }
+
+    const fann_type *sample;
+    unsigned int remaining = reader->numData, current = 0;
+    while ((sample = dataset_read(reader)) != NULL) {
+        unsigned int out = current;
+        if (random) {
+            //An output with k of the r remaining samples gets this one with probability k/r
+            uint64_t r = rng_below(&seed, remaining);
+            for (out = 0; r >= left[out]; out++) r -= left[out];
+        } else {
+            while (left[out] == 0) out++;
+            current = out;
+        }
+        if (dataset_write(writers[out], sample) != 0) goto END;
+        left[out]--;
+        remaining--;
+    }
+    result = 0;
+
+END:
+    if (dataset_close(reader) != 0) result = -1;
+    for (unsigned int i = 0; writers != NULL && i < nOutputs; i++) {
+        if (result != 0) {
+            dataset_discard(writers[i]);
+        } else if (dataset_finish(writers[i]) != 0) {
+            result = -1;
+        }
+    }
+    free(weights);
+    free(left);
+    free(writers);
+    return result;
+}
+
+/** Class of a sample in stratified subsampling */
+struct sample_class {
+    uint64_t key;               /**< Class key, see class_key() */
+    unsigned int total;         /**< Samples of the class */
+    unsigned int left;          /**< Samples of the class not seen yet */
+    unsigned int wanted;        /**< Samples of the class still to be selected */
+    int used;                   /**< Non-zero if the slot is used */
+};
+
+/** Open addressing table of classes */
+struct class_table {
+    struct sample_class *slots;
+    unsigned int size;          /**< Number of slots, a power of 2 */
+    unsigned int count;         /**< Number of classes */
+};
+
+/**
+ * Class of a sample: the index of its largest output or, when there is a
+ * single output, its value
+ */
+static uint64_t class_key(const fann_type *outputs, unsigned int numOutput)
+{
+    uint64_t key = 0;
+    if (numOutput == 1) {
+        fann_type value = (outputs[0] == 0) ? 0 : outputs[0];
+        memcpy(&key, &value, sizeof(value));
+        return key;
+    }
+    for (unsigned int i = 1; i < numOutput; i++) {
+        if (outputs[i] > outputs[key]) key = i;
+    }
+    return key;
+}
+
+/**
+ * Find a class, adding it if it is not in the table yet
+ * @return Class, or NULL if out of memory
+ */
+static struct sample_class *class_find(struct class_table *table, uint64_t key)
+{
+    if (table->count * 2 >= table->size) {
+        struct class_table grown = {NULL, table->size ? table->size * 2 : 64, 0};
+        grown.slots = (struct sample_class *) calloc(grown.size, sizeof(struct sample_class));
+        if (grown.slots == NULL) return NULL;
+        for (unsigned int i = 0; i < table->size; i++) {
+            if (table->slots[i].used) *class_find(&grown, table->slots[i].key) = table->slots[i];
+        }
+        free(table->slots);
+        *table = grown;
+    }
+    unsigned int i = (unsigned int) ((key * 0x9e3779b97f4a7c15ULL) >> 32) & (table->size - 1);
+    while (table->slots[i].used && table->slots[i].key != key) i = (i + 1) & (table->size - 1);
+    if (!table->slots[i].used) {
+        table->slots[i].used = 1;
+        table->slots[i].key = key;
+        table->count++;
+    }
+    return &table->slots[i];
+}
+
+/**
+ * Select a random subset of the samples of a data file, keeping their order.
+ * When stratified, every class (see class_key()) keeps its share of the
+ * samples, which takes an additional pass over the input to count them.
+ * @param input Input file path
+ * @param output Output file path
+ * @param fraction Fraction of the samples to select, used if samples is 0
+ * @param samples Number of samples to select, or 0 to use fraction
+ * @param stratify Non-zero to keep the share of every class
+ * @param format Output format, or -1 for the input's
+ * @param seed Random seed
+ * @return 0 on success, -1 on error (reported)
+ */
+int dataset_subsample(const char *input, const char *output, double fraction, unsigned int samples, int stratify,
+        int format, uint64_t seed)
+{
+    if (samples == 0 && (fraction < 0 || fraction > 1)) {
+        fprintf(stderr, "The fraction must be between 0 and 1\n");
+        return -1;
+    }
+    if (check_output(output, 1, &input) != 0) return -1;
+
+    struct dataset_reader *reader = dataset_open(input);
+    if (reader == NULL) return -1;
+
+    struct class_table table = {NULL, 0, 0};
+    struct sample_class single = {0, reader->numData, reader->numData, 0, 1};
+    struct dataset_writer *writer = NULL;
+    double *weights = NULL;
+    unsigned int *wanted = NULL;
+    unsigned int target = (samples > 0) ? samples : (unsigned int) (fraction * reader->numData + 0.5);
+    unsigned int numInput = reader->numInput, numOutput = reader->numOutput;
+    const fann_type *sample;
+    int result = -1;
+
+    if (target > reader->numData) target = reader->numData;
+    single.wanted = target;
+
+    if (stratify) {
+        //First pass: count the samples of each class
+        while ((sample = dataset_read(reader)) != NULL) {
+            struct sample_class *c = class_find(&table, class_key(sample + numInput, numOutput));
+            if (c == NULL) {
+                fprintf(stderr, "Not enough memory\n");
+                goto END;
+            }
+            c->total++;
+        }
+        unsigned int numData = reader->numData;
+        int error = dataset_close(reader);
+        reader = NULL;
+        if (error != 0) goto END;
+
+        weights = (double *) malloc(sizeof(double) * table.count);
+        wanted = (unsigned int *) malloc(sizeof(unsigned int) * table.count);
+        if (weights == NULL || wanted == NULL) {
+            fprintf(stderr, "Not enough memory\n");
+            goto END;
+        }
+        for (unsigned int i = 0, n = 0; i < table.size; i++) {
+            if (table.slots[i].used) weights[n++] = (double) table.slots[i].total / numData;
+        }
+        apportion(target, table.count, weights, wanted);
+        for (unsigned int i = 0, n = 0; i < table.size; i++) {
+            if (table.slots[i].used) {
+                table.slots[i].left = table.slots[i].total;
+                table.slots[i].wanted = wanted[n++];
+            }
+        }
+
+        reader = dataset_open(input);
+        if (reader == NULL) goto END;
+    }
+
+    writer = dataset_create(output, (format < 0) ? reader->format : (enum dataset_format) format, numInput, numOutput);
+    if (writer == NULL) goto END;
+
+    //Selection sampling: a sample is selected with probability wanted/left
+    while ((sample = dataset_read(reader)) != NULL) {
+        struct sample_class *c = stratify ? class_find(&table, class_key(sample + numInput, numOutput)) : &single;
+        if (c == NULL) {
+            fprintf(stderr, "Not enough memory\n");
+            goto END;
+        }
+        if (c->left > 0 && rng_below(&seed, c->left) < c->wanted) {
+            if (dataset_write(writer, sample) != 0) goto END;
+            c->wanted--;
+        }
+        if (c->left > 0) c->left--;
+    }
+    result = 0;
+
+END:
+    if (dataset_close(reader) != 0) result = -1;
+    if (result != 0) {
+        dataset_discard(writer);
+    } else if (dataset_finish(writer) != 0) {
+        result = -1;
+    }
+    free(table.slots);
+    free(weights);
+    free(wanted);
+    return result;
+}
+
+/**
+ * Concatenate data files. All of them must have the same number of inputs and outputs
+ * @param nInputs Number of input files
+ * @param inputs Input file paths
+ * @param output Output file path
+ * @param format Output format, or -1 for the format of the first input
+ * @return 0 on success, -1 on error (reported)
+ */
+int dataset_merge(unsigned int nInputs, const char *const *inputs, const char *output, int format)
+{
+    if (check_output(output, nInputs, inputs) != 0) return -1;
+
+    struct dataset_writer *writer = NULL;
+    int result = 0;
+    for (unsigned int i = 0; i < nInputs && result == 0; i++) {
+        struct dataset_reader *reader = dataset_open(inputs[i]);
+        if (reader == NULL) {
+            result = -1;
+            break;
+        }
+        if (writer == NULL) {
+            writer = dataset_create(output, (format < 0) ? reader->format : (enum dataset_format) format, reader->numInput, reader->numOutput);
+            if (writer == NULL) result = -1;
+        } else if (reader->numInput != writer->numInput || reader->numOutput != writer->numOutput) {
+            fprintf(stderr, "%s: samples have %u inputs and %u outputs but %s ones have %u and %u\n", inputs[i],
+                    reader->numInput, reader->numOutput, inputs[0], writer->numInput, writer->numOutput);
+            result = -1;
+        }
+        const fann_type *sample;
+        while (result == 0 && (sample = dataset_read(reader)) != NULL) {
+            if (dataset_write(writer, sample) != 0) result = -1;
+        }
+        if (dataset_close(reader) != 0) result = -1;
+    }
+    if (result != 0) {
+        dataset_discard(writer);
+    } else if (dataset_finish(writer) != 0) {
+        result = -1;
+    }
+    return result;
+}
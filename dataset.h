@@ -0,0 +1,91 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef DATASET_H
+#define	DATASET_H
+
+#include <stdint.h>
+#include <fann.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/** Magic string starting binary data files */
+#define DATASET_BINARY_MAGIC "FANNCDS1"
+
+/**
+ * Data file formats.
+ * Binary files start with a struct dataset_binary_header and hold the values of
+ * each sample (inputs followed by outputs) as raw fann_type in host byte order.
+ */
+enum dataset_format {
+    DATASET_FORMAT_TEXT = 0,    /**< FANN data file */
+    DATASET_FORMAT_BINARY       /**< fannc binary data file */
+};
+
+static char const *const DATASET_FORMAT_NAMES[] = {"text", "binary"};
+
+/** Header of binary data files */
+struct dataset_binary_header {
+    char magic[8];              /**< DATASET_BINARY_MAGIC, not NUL terminated */
+    uint32_t numData;           /**< Number of samples */
+    uint32_t numInput;          /**< Number of inputs */
+    uint32_t numOutput;         /**< Number of outputs */
+    uint32_t typeSize;          /**< sizeof(fann_type) of the writer */
+};
+
+/** Sample reader. Samples are parsed ahead by a background thread */
+struct dataset_reader {
+    const char *name;           /**< File path */
+    enum dataset_format format; /**< File format */
+    unsigned int numData;       /**< Number of samples, from the header */
+    unsigned int numInput;      /**< Number of inputs */
+    unsigned int numOutput;     /**< Number of outputs */
+    struct dataset_impl *impl;  /**< Private state */
+};
+
+/** Sample writer. Samples are written by a background thread */
+struct dataset_writer {
+    const char *name;           /**< File path */
+    enum dataset_format format; /**< File format */
+    unsigned int numData;       /**< Number of samples written so far */
+    unsigned int numInput;      /**< Number of inputs */
+    unsigned int numOutput;     /**< Number of outputs */
+    struct dataset_impl *impl;  /**< Private state */
+};
+
+struct dataset_reader *dataset_open(const char *path);
+const fann_type *dataset_read(struct dataset_reader *reader);
+int dataset_close(struct dataset_reader *reader);
+struct dataset_writer *dataset_create(const char *path, enum dataset_format format, unsigned int numInput, unsigned int numOutput);
+int dataset_write(struct dataset_writer *writer, const fann_type *sample);
+int dataset_finish(struct dataset_writer *writer);
+void dataset_discard(struct dataset_writer *writer);
+
+int dataset_shuffle(const char *input, const char *output, int format, size_t memory, const char *tempDir, uint64_t seed);
+int dataset_split(const char *input, unsigned int nOutputs, const char *const *outputs, const double *fractions,
+        unsigned int nFractions, int random, int format, uint64_t seed);
+int dataset_subsample(const char *input, const char *output, double fraction, unsigned int samples, int stratify,
+        int format, uint64_t seed);
+int dataset_merge(unsigned int nInputs, const char *const *inputs, const char *output, int format);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* DATASET_H */
@@ -0,0 +1,584 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+/*
+ * Data parallel training across processes.
+ *
+ * A coordinator holds the network and a set of workers, each holding a shard
+ * of the training data. Local workers are forked by the coordinator and get
+ * a slice of its data over a socket pair; remote workers connect over TCP or
+ * a Unix socket and load their own shard. Every round the coordinator sends
+ * the current weights, each worker trains its copy for a number of epochs on
+ * its shard and sends its weights back, and the coordinator averages them,
+ * weighting each worker by its number of samples.
+ *
+ * Messages are a fixed header followed by a payload:
+ *   header  {uint32 magic, uint32 type, uint64 length}
+ *   NET     coordinator -> worker: the network in FANN's text format
+ *   HELLO   worker -> coordinator: {uint32 samples, inputs, outputs, sizeof(fann_type)}
+ *   TRAIN   coordinator -> worker: {uint32 epochs, uint32 unused} + weights
+ *   RESULT  worker -> coordinator: {uint32 samples, uint32 bitFail, float mse, uint32 unused} + weights
+ *   DONE    coordinator -> worker: empty
+ * Integers and weights are sent in host byte order, so all the processes must
+ * run on machines with the same endianness and FANN build.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fann.h>
+#include <fann_internal.h>
+#include "dist.h"
+#include "stats.h"
+
+#define DIST_MAGIC  0x574e4e46u   /* "FNNW" */
+
+/** Largest network accepted from a coordinator, in bytes of FANN's text format */
+#define DIST_MAX_NET    (1 << 30)
+
+/** Step by which the buffer of a network being received grows */
+#define DIST_NET_CHUNK  (1 << 20)
+
+/** Prefix of Unix socket addresses */
+#define UNIX_PREFIX "unix:"
+
+enum dist_msg_type {
+    DIST_MSG_NET = 1,
+    DIST_MSG_HELLO,
+    DIST_MSG_TRAIN,
+    DIST_MSG_RESULT,
+    DIST_MSG_DONE
+};
+
+struct dist_header {
+    uint32_t magic;
+    uint32_t type;
+    uint64_t length;
+};
+
+struct dist_hello {
+    uint32_t samples;
+    uint32_t numInput;
+    uint32_t numOutput;
+    uint32_t typeSize;
+};
+
+struct dist_train {
+    uint32_t epochs;
+    uint32_t unused;
+};
+
+struct dist_result {
+    uint32_t samples;
+    uint32_t bitFail;
+    float mse;
+    uint32_t unused;
+};
+
+/** Connection to a worker, as seen by the coordinator */
+struct dist_peer {
+    int fd;                     /**< Socket */
+    pid_t pid;                  /**< Process of a local worker, or 0 */
+    unsigned int samples;       /**< Size of the worker's shard */
+};
+
+/** Monotonic time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Write a whole buffer to a socket. A peer that went away makes it fail with
+ * EPIPE rather than raise SIGPIPE
+ * @return 0 on success, -1 on error
+ */
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = (const char *) buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t) n;
+    }
+    return 0;
+}
+
+/**
+ * Read a whole buffer
+ * @return 0 on success, -1 on error or end of stream
+ */
+static int read_all(int fd, void *buf, size_t len)
+{
+    char *p = (char *) buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) return -1;
+        p += n;
+        len -= (size_t) n;
+    }
+    return 0;
+}
+
+/**
+ * Send a message made of a fixed part and an optional array of weights
+ * @param fd Socket
+ * @param type Message type
+ * @param fixed Fixed part
+ * @param fixedLen Size of the fixed part
+ * @param weights Weights, or NULL
+ * @param numWeights Number of weights
+ * @return 0 on success, -1 on error
+ */
+static int send_msg(int fd, uint32_t type, const void *fixed, size_t fixedLen, const fann_type *weights, size_t numWeights)
+{
+    struct dist_header hdr = {DIST_MAGIC, type, fixedLen + sizeof(fann_type) * numWeights};
+    if (write_all(fd, &hdr, sizeof(hdr)) != 0) return -1;
+    if (fixedLen > 0 && write_all(fd, fixed, fixedLen) != 0) return -1;
+    if (numWeights > 0 && write_all(fd, weights, sizeof(fann_type) * numWeights) != 0) return -1;
+    return 0;
+}
+
+/**
+ * Receive a message made of a fixed part and an optional array of weights
+ * @param fd Socket
+ * @param type Expected message type
+ * @param fixed Buffer for the fixed part
+ * @param fixedLen Size of the fixed part
+ * @param weights Buffer for the weights, or NULL
+ * @param numWeights Number of weights
+ * @return 0 on success, -1 on error or if the message is not the expected one
+ */
+static int recv_msg(int fd, uint32_t type, void *fixed, size_t fixedLen, fann_type *weights, size_t numWeights)
+{
+    struct dist_header hdr;
+    if (read_all(fd, &hdr, sizeof(hdr)) != 0) return -1;
+    if (hdr.magic != DIST_MAGIC || hdr.type != type || hdr.length != fixedLen + sizeof(fann_type) * numWeights) return -1;
+    if (fixedLen > 0 && read_all(fd, fixed, fixedLen) != 0) return -1;
+    if (numWeights > 0 && read_all(fd, weights, sizeof(fann_type) * numWeights) != 0) return -1;
+    return 0;
+}
+
+/**
+ * Resolve an address and create a socket for it
+ * @param address "unix:PATH" or "HOST:PORT"
+ * @param bindIt Non-zero to bind and listen, zero to connect
+ * @return Socket, or -1 on error (reported)
+ */
+static int open_socket(const char *address, int bindIt)
+{
+    int fd = -1;
+
+    if (strncmp(address, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0) {
+        struct sockaddr_un sa;
+        const char *path = address + strlen(UNIX_PREFIX);
+        if (strlen(path) >= sizeof(sa.sun_path)) {
+            fprintf(stderr, "Socket path too long: %s\n", path);
+            return -1;
+        }
+        memset(&sa, 0, sizeof(sa));
+        sa.sun_family = AF_UNIX;
+        strcpy(sa.sun_path, path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            perror("socket");
+            return -1;
+        }
+        if (bindIt) unlink(path);
+        if ((bindIt ? bind(fd, (struct sockaddr *) &sa, sizeof(sa)) : connect(fd, (struct sockaddr *) &sa, sizeof(sa))) != 0) {
+            perror(path);
+            close(fd);
+            return -1;
+        }
+    } else {
+        char host[256];
+        const char *colon = strrchr(address, ':');
+        if (colon == NULL || (size_t) (colon - address) >= sizeof(host)) {
+            fprintf(stderr, "Bad address: %s. Expected HOST:PORT or unix:PATH\n", address);
+            return -1;
+        }
+        memcpy(host, address, colon - address);
+        host[colon - address] = '\0';
+
+        struct addrinfo hints, *res, *ai;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = bindIt ? AI_PASSIVE : 0;
+        int err = getaddrinfo(host[0] ? host : NULL, colon + 1, &hints, &res);
+        if (err != 0) {
+            fprintf(stderr, "%s: %s\n", address, gai_strerror(err));
+            return -1;
+        }
+        for (ai = res; ai != NULL; ai = ai->ai_next) {
+            fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd < 0) continue;
+            int one = 1;
+            if (bindIt) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if ((bindIt ? bind(fd, ai->ai_addr, ai->ai_addrlen) : connect(fd, ai->ai_addr, ai->ai_addrlen)) == 0) {
+                if (!bindIt) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                break;
+            }
+            close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(res);
+        if (fd < 0) {
+            fprintf(stderr, "Could not %s %s\n", bindIt ? "listen on" : "connect to", address);
+            return -1;
+        }
+    }
+
+    if (bindIt && listen(fd, 64) != 0) {
+        perror("listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Listen for remote workers
+ * @param address "unix:PATH" or "HOST:PORT". An empty host listens on all interfaces
+ * @return Listening socket, or -1 on error (reported)
+ */
+int dist_listen(const char *address)
+{
+    return open_socket(address, 1);
+}
+
+/**
+ * Connect to a coordinator
+ * @param address "unix:PATH" or "HOST:PORT"
+ * @return Socket, or -1 on error (reported)
+ */
+int dist_connect(const char *address)
+{
+    return open_socket(address, 0);
+}
+
+/**
+ * Send a network to a worker
+ * @return 0 on success, -1 on error
+ */
+static int send_net(int fd, struct fann *ann)
+{
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *fp = open_memstream(&buf, &len);
+    if (fp == NULL) return -1;
+    int r = fann_save_internal_fd(ann, fp, "worker", 0);
+    fclose(fp);
+    if (r == 0 && len > DIST_MAX_NET) {
+        fprintf(stderr, "The ANN is too large to send to workers\n");
+        r = -1;
+    }
+    if (r == 0) r = send_msg(fd, DIST_MSG_NET, buf, len, NULL, 0);
+    free(buf);
+    return r;
+}
+
+/**
+ * Receive a network from the coordinator
+ * @return Network, or NULL on error
+ */
+static struct fann *recv_net(int fd)
+{
+    struct dist_header hdr;
+    if (read_all(fd, &hdr, sizeof(hdr)) != 0) return NULL;
+    if (hdr.magic != DIST_MAGIC || hdr.type != DIST_MSG_NET || hdr.length == 0 || hdr.length > DIST_MAX_NET) return NULL;
+
+    //The buffer grows with the bytes actually received, so a bogus length does not allocate it all up front
+    size_t len = (size_t) hdr.length, got = 0;
+    char *buf = NULL;
+    struct fann *ann = NULL;
+    while (got < len) {
+        size_t step = (len - got < DIST_NET_CHUNK) ? len - got : DIST_NET_CHUNK;
+        char *grown = (char *) realloc(buf, got + step);
+        if (grown == NULL) break;
+        buf = grown;
+        if (read_all(fd, buf + got, step) != 0) break;
+        got += step;
+    }
+    if (got == len) {
+        FILE *fp = fmemopen(buf, len, "r");
+        if (fp != NULL) {
+            ann = fann_create_from_fd(fp, "coordinator");
+            fclose(fp);
+        }
+    }
+    free(buf);
+    return ann;
+}
+
+/**
+ * Serve a coordinator: train shards of epochs on the given data until told to stop
+ * @param fd Socket connected to the coordinator
+ * @param data Shard of training data
+ * @param scale Non-zero to scale the data with the scaling parameters of the ANN, if it has any
+ * @return 0 on success, -1 on error (reported)
+ */
+int dist_worker(int fd, struct fann_train_data *data, int scale)
+{
+    struct fann *ann = recv_net(fd);
+    if (ann == NULL) {
+        fprintf(stderr, "Could not receive the ANN from the coordinator\n");
+        return -1;
+    }
+    if (scale) stats_scale_data(ann, data);
+
+    int r = -1;
+    unsigned int numWeights = fann_get_total_connections(ann);
+    struct dist_hello hello = {data->num_data, data->num_input, data->num_output, sizeof(fann_type)};
+    if (send_msg(fd, DIST_MSG_HELLO, &hello, sizeof(hello), NULL, 0) != 0) goto EXIT;
+
+    for (;;) {
+        struct dist_header hdr;
+        struct dist_train train;
+        struct dist_result result = {data->num_data, 0, 0, 0};
+        unsigned int i;
+
+        if (read_all(fd, &hdr, sizeof(hdr)) != 0 || hdr.magic != DIST_MAGIC) break;
+        if (hdr.type == DIST_MSG_DONE) {
+            r = 0;
+            break;
+        }
+        if (hdr.type != DIST_MSG_TRAIN || hdr.length != sizeof(train) + sizeof(fann_type) * numWeights) break;
+        if (read_all(fd, &train, sizeof(train)) != 0 || read_all(fd, ann->weights, sizeof(fann_type) * numWeights) != 0) break;
+
+        for (i = 0; i < train.epochs && data->num_data > 0; i++) {
+            result.mse = fann_train_epoch(ann, data);
+        }
+        result.bitFail = fann_get_bit_fail(ann);
+
+        if (send_msg(fd, DIST_MSG_RESULT, &result, sizeof(result), ann->weights, numWeights) != 0) break;
+    }
+
+    if (r != 0) fprintf(stderr, "Lost connection with the coordinator\n");
+EXIT:
+    fann_destroy(ann);
+    return r;
+}
+
+/**
+ * Start a local worker on a slice of the data
+ * @param peer Output peer
+ * @param data Training data
+ * @param first First sample of the slice
+ * @param count Number of samples
+ * @param closeFds Sockets the child must close (the coordinator's ends of other workers), -1 terminated
+ * @return 0 on success, -1 on error (reported)
+ */
+static int start_local(struct dist_peer *peer, struct fann_train_data *data, unsigned int first, unsigned int count, const int *closeFds)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        perror("socketpair");
+        return -1;
+    }
+
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        //Worker: a view over the slice, sharing the coordinator's copy-on-write pages
+        struct fann_train_data shard = *data;
+        shard.num_data = count;
+        shard.input = data->input + first;
+        shard.output = data->output + first;
+        close(sv[0]);
+        for (; *closeFds >= 0; closeFds++) close(*closeFds);
+        _exit(dist_worker(sv[1], &shard, 0) == 0 ? 0 : 1);
+    }
+
+    close(sv[1]);
+    peer->fd = sv[0];
+    peer->pid = pid;
+    return 0;
+}
+
+/**
+ * Check whether training may stop, as fann_desired_error_reached() does
+ * @return Non-zero if the desired error is reached
+ */
+static int error_reached(struct fann *ann, float mse, unsigned int bitFail, float desiredError)
+{
+    if (fann_get_train_stop_function(ann) == FANN_STOPFUNC_BIT) return bitFail <= desiredError;
+    return mse <= desiredError;
+}
+
+/**
+ * Train a network with workers, averaging their parameters every few epochs
+ * @param ann ANN, receiving the trained weights
+ * @param data Training data, split among the local workers
+ * @param nLocal Number of local workers
+ * @param listenFd Listening socket for remote workers, or -1
+ * @param nRemote Number of remote workers to wait for
+ * @param params Training parameters
+ * @return 0 on success, -1 on error (reported)
+ */
+int dist_train(struct fann *ann, struct fann_train_data *data, unsigned int nLocal, int listenFd, unsigned int nRemote, const struct dist_params *params)
+{
+    unsigned int nPeers = nLocal + nRemote;
+    unsigned int numWeights = fann_get_total_connections(ann);
+    unsigned int syncPeriod = (params->syncPeriod > 0) ? params->syncPeriod : 1;
+    struct dist_peer *peers = (struct dist_peer *) calloc(nPeers + 1, sizeof(struct dist_peer));
+    int *closeFds = (int *) malloc(sizeof(int) * (nPeers + 2));
+    fann_type *weights = (fann_type *) malloc(sizeof(fann_type) * (numWeights + 1));
+    double *sum = (double *) malloc(sizeof(double) * (numWeights + 1));
+    unsigned int i, j, started = 0;
+    int r = -1;
+
+    if (peers == NULL || closeFds == NULL || weights == NULL || sum == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        goto EXIT;
+    }
+
+    //Local workers get consecutive slices of the data
+    unsigned int nClose = 0;
+    if (listenFd >= 0) closeFds[nClose++] = listenFd;
+    closeFds[nClose] = -1;
+    for (i = 0; i < nLocal; i++, started++) {
+        unsigned int first = (unsigned int) ((uint64_t) data->num_data * i / nLocal);
+        unsigned int last = (unsigned int) ((uint64_t) data->num_data * (i + 1) / nLocal);
+        if (start_local(&peers[i], data, first, last - first, closeFds) != 0) goto EXIT;
+        closeFds[nClose++] = peers[i].fd;
+        closeFds[nClose] = -1;
+    }
+
+    for (i = nLocal; i < nPeers; i++, started++) {
+        peers[i].fd = accept(listenFd, NULL, NULL);
+        if (peers[i].fd < 0) {
+            perror("accept");
+            goto EXIT;
+        }
+        int one = 1;
+        setsockopt(peers[i].fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    uint64_t totalSamples = 0;
+    for (i = 0; i < nPeers; i++) {
+        struct dist_hello hello;
+        if (send_net(peers[i].fd, ann) != 0 || recv_msg(peers[i].fd, DIST_MSG_HELLO, &hello, sizeof(hello), NULL, 0) != 0) {
+            fprintf(stderr, "Worker %u did not answer\n", i);
+            goto EXIT;
+        }
+        if (hello.typeSize != sizeof(fann_type) || hello.numInput != fann_get_num_input(ann) || hello.numOutput != fann_get_num_output(ann)) {
+            fprintf(stderr, "Worker %u has data with %u inputs and %u outputs, or another FANN build. Expected %u inputs and %u outputs\n",
+                    i, hello.numInput, hello.numOutput, fann_get_num_input(ann), fann_get_num_output(ann));
+            goto EXIT;
+        }
+        peers[i].samples = hello.samples;
+        totalSamples += hello.samples;
+    }
+
+    if (totalSamples == 0) {
+        fprintf(stderr, "Workers have no training data\n");
+        goto EXIT;
+    }
+
+    unsigned int epochs = 0;
+    while (epochs < params->maxEpochs) {
+        struct dist_train train = {syncPeriod, 0};
+        double t0 = now(), mse = 0;
+        unsigned int bitFail = 0;
+
+        if (train.epochs > params->maxEpochs - epochs) train.epochs = params->maxEpochs - epochs;
+
+        for (i = 0; i < nPeers; i++) {
+            if (send_msg(peers[i].fd, DIST_MSG_TRAIN, &train, sizeof(train), ann->weights, numWeights) != 0) {
+                fprintf(stderr, "Lost connection with worker %u\n", i);
+                goto EXIT;
+            }
+        }
+
+        //Average the weights of all workers, weighted by the size of their shards
+        memset(sum, 0, sizeof(double) * numWeights);
+        for (i = 0; i < nPeers; i++) {
+            struct dist_result result;
+            if (recv_msg(peers[i].fd, DIST_MSG_RESULT, &result, sizeof(result), weights, numWeights) != 0) {
+                fprintf(stderr, "Lost connection with worker %u\n", i);
+                goto EXIT;
+            }
+            double share = (double) result.samples / (double) totalSamples;
+            for (j = 0; j < numWeights; j++) {
+                sum[j] += share * weights[j];
+            }
+            mse += share * result.mse;
+            bitFail += result.bitFail;
+        }
+        for (j = 0; j < numWeights; j++) {
+            ann->weights[j] = (fann_type) sum[j];
+        }
+
+        unsigned int prevEpochs = epochs;
+        epochs += train.epochs;
+        double epochTime = (now() - t0) / train.epochs;
+        int reached = error_reached(ann, (float) mse, bitFail, params->desiredError);
+
+        if (params->reportPeriod > 0 && (epochs / params->reportPeriod != prevEpochs / params->reportPeriod
+                || prevEpochs == 0 || epochs == params->maxEpochs || reached)) {
+            fprintf(params->report, "Epochs     %8d. MSE: %.5f. Desired-MSE: %.5f. Epoch time: %.6fs\n",
+                    epochs, mse, params->desiredError, epochTime);
+        }
+        if (reached) break;
+    }
+
+    r = 0;
+
+EXIT:
+    for (i = 0; i < started; i++) {
+        if (peers[i].fd >= 0) {
+            if (r == 0) send_msg(peers[i].fd, DIST_MSG_DONE, NULL, 0, NULL, 0);
+            close(peers[i].fd);
+        }
+    }
+    for (i = 0; i < started; i++) {
+        if (peers[i].pid > 0) waitpid(peers[i].pid, NULL, 0);
+    }
+    free(peers);
+    free(closeFds);
+    free(weights);
+    free(sum);
+    return r;
+}
@@ -0,0 +1,47 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef DIST_H
+#define	DIST_H
+
+#include <stdio.h>
+#include <fann.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/** Parameters of a distributed training */
+struct dist_params {
+    unsigned int maxEpochs;         /**< Maximum number of epochs */
+    unsigned int reportPeriod;      /**< Epochs between reports, or 0 for no reports */
+    unsigned int syncPeriod;        /**< Epochs each worker trains between parameter averages */
+    float desiredError;             /**< Desired error, checked after each average */
+    FILE *report;                   /**< Report stream */
+};
+
+int dist_listen(const char *address);
+int dist_connect(const char *address);
+int dist_train(struct fann *ann, struct fann_train_data *data, unsigned int nLocal, int listenFd, unsigned int nRemote, const struct dist_params *params);
+int dist_worker(int fd, struct fann_train_data *data, int scale);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* DIST_H */
+
@@ -0,0 +1,339 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+/*
+ * Embeddable API on top of the network image engine.
+ *
+ * A model keeps the FANN network it was loaded from, if any, and a reference
+ * counted image compiled from it. Runs and tests take a reference to the
+ * current image under the model lock, then work without any lock on scratch
+ * buffers of their own. Training is serialized by a separate mutex and works
+ * on the FANN network only; the image compiled once training is over replaces
+ * the current one before the next training may start, and the old one is
+ * released when its last user is done.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fann.h>
+#include "fannc.h"
+#include "net.h"
+#include "cache.h"
+#include "compress.h"
+#include "stats.h"
+#include "arena.h"
+
+/** The API hands out fann_type values as floats */
+typedef char fannc_float_check[(sizeof(fann_type) == sizeof(float)) ? 1 : -1];
+
+/** Image shared by a model and the calls using it */
+struct fannc_image {
+    struct cache_entry entry;       /**< Image */
+    unsigned int refs;              /**< References, including the model's */
+};
+
+struct fannc_model {
+    pthread_mutex_t lock;           /**< Guards image and its reference count */
+    pthread_mutex_t trainLock;      /**< Serializes access to ann */
+    struct fann *ann;               /**< Network, or NULL if loaded from an image */
+    struct fannc_image *image;      /**< Current image, used to run and test */
+    enum net_activation_mode mode;  /**< Activation mode */
+    unsigned int numInput;          /**< Number of inputs */
+    unsigned int numOutput;         /**< Number of outputs */
+};
+
+/**
+ * Take a reference to the current image of a model
+ * @param model Model
+ * @return Image. Release with image_release()
+ */
+static struct fannc_image *image_acquire(struct fannc_model *model)
+{
+    pthread_mutex_lock(&model->lock);
+    struct fannc_image *image = model->image;
+    image->refs++;
+    pthread_mutex_unlock(&model->lock);
+    return image;
+}
+
+/**
+ * Drop a reference to an image, freeing it if it was the last one
+ * @param model Model
+ * @param image Image
+ */
+static void image_release(struct fannc_model *model, struct fannc_image *image)
+{
+    pthread_mutex_lock(&model->lock);
+    unsigned int refs = --image->refs;
+    pthread_mutex_unlock(&model->lock);
+    if (refs == 0) {
+        cache_release(&image->entry);
+        free(image);
+    }
+}
+
+/**
+ * Version of the API the library was built with
+ * @return FANNC_API_VERSION
+ */
+int fannc_api_version(void)
+{
+    return FANNC_API_VERSION;
+}
+
+/**
+ * Describe a status code
+ * @param status Status code
+ * @return Static message
+ */
+const char *fannc_strerror(int status)
+{
+    switch (status) {
+        case FANNC_OK: return "success";
+        case FANNC_ERROR_ARGUMENT: return "invalid argument";
+        case FANNC_ERROR_IO: return "could not read or write file";
+        case FANNC_ERROR_MEMORY: return "out of memory";
+        case FANNC_ERROR_UNSUPPORTED: return "operation not supported by the model";
+        default: return "unknown error";
+    }
+}
+
+/**
+ * Load a model from an ANN file or a network image
+ * @param path File path
+ * @param flags Bitwise or of enum fannc_load_flags
+ * @param model Output model. Release with fannc_free()
+ * @return Status code
+ */
+int fannc_load(const char *path, int flags, fannc_model **model)
+{
+    if (path == NULL || model == NULL) return FANNC_ERROR_ARGUMENT;
+    *model = NULL;
+
+    struct fannc_model *m = (struct fannc_model *) calloc(1, sizeof(struct fannc_model));
+    struct fannc_image *image = (struct fannc_image *) calloc(1, sizeof(struct fannc_image));
+    if (m == NULL || image == NULL) {
+        free(m);
+        free(image);
+        return FANNC_ERROR_MEMORY;
+    }
+    m->mode = (flags & FANNC_LOAD_FAST) ? NET_ACTIVATION_FAST : NET_ACTIVATION_EXACT;
+
+    int isImage = 0, status = FANNC_OK;
+    if (flags & FANNC_LOAD_CACHE) {
+        if (cache_load(path, &image->entry) != 0) status = FANNC_ERROR_IO;
+    } else if ((isImage = cache_map_image(path, &image->entry)) == 0) {
+        m->ann = compress_load_ann(path);
+        if (m->ann == NULL) {
+            status = FANNC_ERROR_IO;
+        } else if ((image->entry.owned = net_compile(m->ann)) == NULL) {
+            fann_destroy(m->ann);
+            status = FANNC_ERROR_MEMORY;
+        }
+        image->entry.image = image->entry.owned;
+    } else if (isImage < 0) {
+        status = FANNC_ERROR_IO;
+    }
+    if (status != FANNC_OK) {
+        free(image);
+        free(m);
+        return status;
+    }
+
+    image->refs = 1;
+    m->image = image;
+    m->numInput = image->entry.image->numInput;
+    m->numOutput = image->entry.image->numOutput;
+    pthread_mutex_init(&m->lock, NULL);
+    pthread_mutex_init(&m->trainLock, NULL);
+    *model = m;
+    return FANNC_OK;
+}
+
+/**
+ * Release a model. No other thread may be using it
+ * @param model Model or NULL
+ */
+void fannc_free(fannc_model *model)
+{
+    if (model == NULL) return;
+    if (model->ann != NULL) fann_destroy(model->ann);
+    image_release(model, model->image);
+    pthread_mutex_destroy(&model->lock);
+    pthread_mutex_destroy(&model->trainLock);
+    free(model);
+}
+
+/**
+ * Number of inputs of a model
+ * @param model Model
+ * @return Number of values of an input row
+ */
+unsigned int fannc_num_input(const fannc_model *model)
+{
+    return model->numInput;
+}
+
+/**
+ * Number of outputs of a model
+ * @param model Model
+ * @return Number of values of an output row
+ */
+unsigned int fannc_num_output(const fannc_model *model)
+{
+    return model->numOutput;
+}
+
+/**
+ * Run a batch of input rows. Inputs are scaled and outputs descaled with the
+ * model's scaling parameters, if it has any
+ * @param model Model
+ * @param inputs Input rows (rows x fannc_num_input())
+ * @param rows Number of rows
+ * @param outputs Output rows (rows x fannc_num_output()), written by the call
+ * @return Status code
+ */
+int fannc_run(fannc_model *model, const float *inputs, size_t rows, float *outputs)
+{
+    if (model == NULL || (rows > 0 && (inputs == NULL || outputs == NULL))) return FANNC_ERROR_ARGUMENT;
+
+    struct fannc_image *image = image_acquire(model);
+    const struct net_image *img = image->entry.image;
+    fann_type *values = (fann_type *) malloc(sizeof(fann_type) * (img->totalNeurons + img->numInput));
+    if (values == NULL) {
+        image_release(model, image);
+        return FANNC_ERROR_MEMORY;
+    }
+    fann_type *row = values + img->totalNeurons;
+    size_t r;
+    for (r = 0; r < rows; r++) {
+        float *out = outputs + r * img->numOutput;
+        memcpy(row, inputs + r * img->numInput, sizeof(fann_type) * img->numInput);
+        net_scale_input(img, row);
+        memcpy(out, net_run(img, row, values, model->mode), sizeof(fann_type) * img->numOutput);
+        net_descale_output(img, out);
+    }
+    image_release(model, image);
+    free(values);
+    return FANNC_OK;
+}
+
+/**
+ * Test a batch of samples, the way fann_test_data() does
+ * @param model Model
+ * @param inputs Input rows (rows x fannc_num_input())
+ * @param desired Desired output rows (rows x fannc_num_output())
+ * @param rows Number of rows
+ * @param mse Output mean square error, or NULL
+ * @param bitFail Output number of outputs above the bit fail limit, or NULL
+ * @return Status code
+ */
+int fannc_test(fannc_model *model, const float *inputs, const float *desired, size_t rows, float *mse, unsigned int *bitFail)
+{
+    if (model == NULL || (rows > 0 && (inputs == NULL || desired == NULL))) return FANNC_ERROR_ARGUMENT;
+
+    struct fannc_image *image = image_acquire(model);
+    const struct net_image *img = image->entry.image;
+    fann_type *values = (fann_type *) malloc(sizeof(fann_type) * (img->totalNeurons + img->numInput + img->numOutput));
+    if (values == NULL) {
+        image_release(model, image);
+        return FANNC_ERROR_MEMORY;
+    }
+    fann_type *row = values + img->totalNeurons, *want = row + img->numInput;
+    struct net_mse acc = {0};
+    size_t r;
+    for (r = 0; r < rows; r++) {
+        memcpy(row, inputs + r * img->numInput, sizeof(fann_type) * img->numInput);
+        memcpy(want, desired + r * img->numOutput, sizeof(fann_type) * img->numOutput);
+        net_scale_input(img, row);
+        net_scale_output(img, want);
+        net_test(img, row, want, values, model->mode, &acc);
+    }
+    image_release(model, image);
+    free(values);
+
+    if (mse != NULL) *mse = net_get_mse(&acc);
+    if (bitFail != NULL) *bitFail = acc.bitFail;
+    return FANNC_OK;
+}
+
+/**
+ * Train a model on a batch of samples with its training parameters, then
+ * publish the result to later runs and tests
+ * @param model Model loaded from an ANN file
+ * @param inputs Input rows (rows x fannc_num_input())
+ * @param desired Desired output rows (rows x fannc_num_output())
+ * @param rows Number of rows
+ * @param maxEpochs Maximum number of epochs
+ * @param desiredError Error to stop at
+ * @param mse Output mean square error of the last epoch, or NULL
+ * @return Status code
+ */
+int fannc_train(fannc_model *model, const float *inputs, const float *desired, size_t rows,
+        unsigned int maxEpochs, float desiredError, float *mse)
+{
+    if (model == NULL || rows == 0 || inputs == NULL || desired == NULL || rows > (unsigned int) -1) return FANNC_ERROR_ARGUMENT;
+    if (model->ann == NULL) return FANNC_ERROR_UNSUPPORTED;
+
+    struct arena_data *data = arena_create((unsigned int) rows, model->numInput, model->numOutput);
+    if (data == NULL) return FANNC_ERROR_MEMORY;
+    memcpy(data->inputs, inputs, sizeof(fann_type) * rows * model->numInput);
+    memcpy(data->outputs, desired, sizeof(fann_type) * rows * model->numOutput);
+
+    pthread_mutex_lock(&model->trainLock);
+    stats_scale_data(model->ann, &data->data);
+    fann_train_on_data(model->ann, &data->data, maxEpochs, 0, desiredError);
+    if (mse != NULL) *mse = fann_get_MSE(model->ann);
+    struct fannc_image *image = (struct fannc_image *) calloc(1, sizeof(struct fannc_image));
+    if (image != NULL) image->entry.owned = net_compile(model->ann);
+    if (image == NULL || image->entry.owned == NULL) {
+        pthread_mutex_unlock(&model->trainLock);
+        arena_destroy(data);
+        free(image);
+        return FANNC_ERROR_MEMORY;
+    }
+    image->entry.image = image->entry.owned;
+    image->refs = 1;
+
+    //Publish before letting another train run, so that images are published in training order
+    pthread_mutex_lock(&model->lock);
+    struct fannc_image *old = model->image;
+    model->image = image;
+    pthread_mutex_unlock(&model->lock);
+    pthread_mutex_unlock(&model->trainLock);
+    arena_destroy(data);
+    image_release(model, old);
+    return FANNC_OK;
+}
+
+/**
+ * Save a model in FANN format
+ * @param model Model loaded from an ANN file
+ * @param path File path
+ * @return Status code
+ */
+int fannc_save(fannc_model *model, const char *path)
+{
+    if (model == NULL || path == NULL) return FANNC_ERROR_ARGUMENT;
+    if (model->ann == NULL) return FANNC_ERROR_UNSUPPORTED;
+
+    pthread_mutex_lock(&model->trainLock);
+    int r = fann_save(model->ann, path);
+    pthread_mutex_unlock(&model->trainLock);
+    return (r == 0) ? FANNC_OK : FANNC_ERROR_IO;
+}
@@ -0,0 +1,83 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef FANNC_H
+#define	FANNC_H
+
+#include <stddef.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/**
+ * libfannc public API.
+ *
+ * Networks are loaded into opaque model handles which may be shared by any
+ * number of threads: running and testing only read a compiled image of the
+ * network, while training works on the network itself and publishes a new
+ * image when done, so concurrent runs never wait for a training pass. All
+ * values are single precision floats laid out row after row, and results
+ * are written into buffers provided by the caller.
+ */
+
+/** Marks the functions exported by the shared library, which hides everything else */
+#if defined(__GNUC__) && __GNUC__ >= 4
+#define FANNC_API __attribute__((visibility("default")))
+#else
+#define FANNC_API
+#endif
+
+/** Version of this API. Changes only when existing declarations change */
+#define FANNC_API_VERSION   1
+
+/** Status codes. Functions return FANNC_OK or one of the negative codes */
+enum fannc_status {
+    FANNC_OK = 0,
+    FANNC_ERROR_ARGUMENT = -1,      /**< Invalid argument or dimension mismatch */
+    FANNC_ERROR_IO = -2,            /**< A file could not be read or written, or it is invalid */
+    FANNC_ERROR_MEMORY = -3,        /**< Out of memory */
+    FANNC_ERROR_UNSUPPORTED = -4    /**< The model cannot do that, e.g. training a model loaded from an image */
+};
+
+/** Load flags */
+enum fannc_load_flags {
+    FANNC_LOAD_FAST = 1,        /**< Evaluate sigmoid and gaussian activations with a vectorized approximation of exp() */
+    FANNC_LOAD_CACHE = 2        /**< Load through the model cache. The model cannot be trained nor saved */
+};
+
+typedef struct fannc_model fannc_model;
+
+FANNC_API int fannc_api_version(void);
+FANNC_API const char *fannc_strerror(int status);
+
+FANNC_API int fannc_load(const char *path, int flags, fannc_model **model);
+FANNC_API void fannc_free(fannc_model *model);
+FANNC_API unsigned int fannc_num_input(const fannc_model *model);
+FANNC_API unsigned int fannc_num_output(const fannc_model *model);
+
+FANNC_API int fannc_run(fannc_model *model, const float *inputs, size_t rows, float *outputs);
+FANNC_API int fannc_test(fannc_model *model, const float *inputs, const float *desired, size_t rows, float *mse, unsigned int *bitFail);
+FANNC_API int fannc_train(fannc_model *model, const float *inputs, const float *desired, size_t rows,
+        unsigned int maxEpochs, float desiredError, float *mse);
+FANNC_API int fannc_save(fannc_model *model, const char *path);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* FANNC_H */
@@ -0,0 +1,376 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+/*
+ * Function preserving growth of layered networks.
+ *
+ * Hidden layers are widened by splitting neurons: every new neuron copies
+ * the incoming weights of a randomly chosen neuron of its layer, plus a
+ * little noise to break the symmetry, and the outgoing weights of the
+ * original are shared evenly among it and its copies. A hidden layer is
+ * inserted as a near identity: each new neuron reads one neuron of the
+ * previous layer through a small weight, which keeps it in the linear
+ * range of its activation function, and the following layer reads the new
+ * neurons through weights enlarged by the inverse of that gain.
+ *
+ * Weights are handled as one dense matrix per layer, rows being neurons
+ * and columns the neurons of the previous layer followed by its bias.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "grow.h"
+
+/** Dense incoming weights of a layer */
+struct grow_matrix {
+    unsigned int rows;      /**< Neurons of the layer */
+    unsigned int cols;      /**< Neurons of the previous layer plus its bias */
+    fann_type *w;           /**< rows x cols weights */
+};
+
+#define AT(m, r, c) ((m)->w[(size_t) (r) * (m)->cols + (c)])
+
+/** Uniform random value in [-1, 1] */
+static fann_type random_unit(void)
+{
+    return (fann_type) (2.0 * rand() / (double) RAND_MAX - 1.0);
+}
+
+/**
+ * Allocate the matrices of a network
+ * @param numLayers Number of layers
+ * @param sizes Neurons of each layer, excluding bias
+ * @return Matrices for layers 1 to numLayers-1 (index 0 unused), or NULL if out of memory
+ */
+static struct grow_matrix *alloc_matrices(unsigned int numLayers, const unsigned int *sizes)
+{
+    struct grow_matrix *m = (struct grow_matrix *) calloc(numLayers, sizeof(struct grow_matrix));
+    unsigned int l;
+    if (m == NULL) return NULL;
+    for (l = 1; l < numLayers; l++) {
+        m[l].rows = sizes[l];
+        m[l].cols = sizes[l - 1] + 1;
+        m[l].w = (fann_type *) calloc((size_t) m[l].rows * m[l].cols, sizeof(fann_type));
+        if (m[l].w == NULL) {
+            while (l-- > 1) free(m[l].w);
+            free(m);
+            return NULL;
+        }
+    }
+    return m;
+}
+
+/** Release matrices allocated by alloc_matrices() */
+static void free_matrices(struct grow_matrix *m, unsigned int numLayers)
+{
+    unsigned int l;
+    if (m == NULL) return;
+    for (l = 1; l < numLayers; l++) free(m[l].w);
+    free(m);
+}
+
+/**
+ * Locate the neurons of a layered network. FANN numbers neurons layer after
+ * layer, each layer followed by its bias neuron
+ * @param numLayers Number of layers
+ * @param sizes Neurons of each layer, excluding bias
+ * @param layerOf Output layer of each neuron
+ * @param posOf Output position of each neuron within its layer, the bias being at sizes[layer]
+ */
+static void locate_neurons(unsigned int numLayers, const unsigned int *sizes, unsigned int *layerOf, unsigned int *posOf)
+{
+    unsigned int l, i, n = 0;
+    for (l = 0; l < numLayers; l++) {
+        for (i = 0; i <= sizes[l]; i++, n++) {
+            layerOf[n] = l;
+            posOf[n] = i;
+        }
+    }
+}
+
+/** Number of neurons of a layered network, including bias neurons */
+static unsigned int count_neurons(unsigned int numLayers, const unsigned int *sizes)
+{
+    unsigned int l, n = 0;
+    for (l = 0; l < numLayers; l++) n += sizes[l] + 1;
+    return n;
+}
+
+/**
+ * Copy training parameters, cascade parameters and scaling from one network to another
+ * @param dst Destination
+ * @param src Source
+ * @return 0 on success, -1 if out of memory
+ */
+static int copy_params(struct fann *dst, struct fann *src)
+{
+    fann_set_training_algorithm(dst, fann_get_training_algorithm(src));
+    fann_set_learning_rate(dst, fann_get_learning_rate(src));
+    fann_set_learning_momentum(dst, fann_get_learning_momentum(src));
+    fann_set_train_error_function(dst, fann_get_train_error_function(src));
+    fann_set_train_stop_function(dst, fann_get_train_stop_function(src));
+    fann_set_bit_fail_limit(dst, fann_get_bit_fail_limit(src));
+    fann_set_quickprop_decay(dst, fann_get_quickprop_decay(src));
+    fann_set_quickprop_mu(dst, fann_get_quickprop_mu(src));
+    fann_set_rprop_increase_factor(dst, fann_get_rprop_increase_factor(src));
+    fann_set_rprop_decrease_factor(dst, fann_get_rprop_decrease_factor(src));
+    fann_set_rprop_delta_min(dst, fann_get_rprop_delta_min(src));
+    fann_set_rprop_delta_max(dst, fann_get_rprop_delta_max(src));
+    fann_set_rprop_delta_zero(dst, fann_get_rprop_delta_zero(src));
+    fann_set_sarprop_weight_decay_shift(dst, fann_get_sarprop_weight_decay_shift(src));
+    fann_set_sarprop_step_error_threshold_factor(dst, fann_get_sarprop_step_error_threshold_factor(src));
+    fann_set_sarprop_step_error_shift(dst, fann_get_sarprop_step_error_shift(src));
+    fann_set_sarprop_temperature(dst, fann_get_sarprop_temperature(src));
+    fann_set_cascade_output_change_fraction(dst, fann_get_cascade_output_change_fraction(src));
+    fann_set_cascade_output_stagnation_epochs(dst, fann_get_cascade_output_stagnation_epochs(src));
+    fann_set_cascade_candidate_change_fraction(dst, fann_get_cascade_candidate_change_fraction(src));
+    fann_set_cascade_candidate_stagnation_epochs(dst, fann_get_cascade_candidate_stagnation_epochs(src));
+    fann_set_cascade_weight_multiplier(dst, fann_get_cascade_weight_multiplier(src));
+    fann_set_cascade_candidate_limit(dst, fann_get_cascade_candidate_limit(src));
+    fann_set_cascade_max_out_epochs(dst, fann_get_cascade_max_out_epochs(src));
+    fann_set_cascade_min_out_epochs(dst, fann_get_cascade_min_out_epochs(src));
+    fann_set_cascade_max_cand_epochs(dst, fann_get_cascade_max_cand_epochs(src));
+    fann_set_cascade_min_cand_epochs(dst, fann_get_cascade_min_cand_epochs(src));
+    fann_set_cascade_num_candidate_groups(dst, fann_get_cascade_num_candidate_groups(src));
+    fann_set_cascade_activation_functions(dst, fann_get_cascade_activation_functions(src), fann_get_cascade_activation_functions_count(src));
+    fann_set_cascade_activation_steepnesses(dst, fann_get_cascade_activation_steepnesses(src), fann_get_cascade_activation_steepnesses_count(src));
+
+    //Inputs and outputs are unchanged, so scaling parameters carry over as they are
+    if (src->scale_mean_in != NULL) {
+        float **dstArrays[] = {&dst->scale_mean_in, &dst->scale_deviation_in, &dst->scale_new_min_in, &dst->scale_factor_in,
+                &dst->scale_mean_out, &dst->scale_deviation_out, &dst->scale_new_min_out, &dst->scale_factor_out};
+        const float *srcArrays[] = {src->scale_mean_in, src->scale_deviation_in, src->scale_new_min_in, src->scale_factor_in,
+                src->scale_mean_out, src->scale_deviation_out, src->scale_new_min_out, src->scale_factor_out};
+        unsigned int i;
+        for (i = 0; i < 8; i++) {
+            size_t n = (i < 4) ? src->num_input : src->num_output;
+            *dstArrays[i] = (float *) malloc(sizeof(float) * n);
+            if (*dstArrays[i] == NULL) return -1;
+            memcpy(*dstArrays[i], srcArrays[i], sizeof(float) * n);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Check that a change can be applied to a network
+ * @param ann Network
+ * @param spec Change
+ * @return 0 if it can, -1 otherwise (reported)
+ */
+int grow_check(struct fann *ann, const struct grow_spec *spec)
+{
+    unsigned int numLayers = fann_get_num_layers(ann), l;
+
+    if (fann_get_network_type(ann) != FANN_NETTYPE_LAYER) {
+        fprintf(stderr, "Only layered networks can grow\n");
+        return -1;
+    }
+    if (spec->add[0] > 0 || spec->add[numLayers - 1] > 0) {
+        fprintf(stderr, "Only hidden layers can grow: the input and output layers are layers 0 and %u\n", numLayers - 1);
+        return -1;
+    }
+    if (spec->insert >= numLayers) {
+        fprintf(stderr, "A layer can only be inserted before layers 1 to %u\n", numLayers - 1);
+        return -1;
+    }
+    if (spec->insert > 0) {
+        switch (spec->activation) {
+            case FANN_LINEAR:
+            case FANN_LINEAR_PIECE_SYMMETRIC:
+            case FANN_SIGMOID_SYMMETRIC:
+            case FANN_ELLIOT_SYMMETRIC:
+                break;
+            default:
+                fprintf(stderr, "The inserted layer needs an activation function which is zero at zero with slope steepness: "
+                        "FANN_LINEAR, FANN_LINEAR_PIECE_SYMMETRIC, FANN_SIGMOID_SYMMETRIC or FANN_ELLIOT_SYMMETRIC\n");
+                return -1;
+        }
+        if (spec->steepness <= 0 || spec->epsilon <= 0) {
+            fprintf(stderr, "The steepness and epsilon of the inserted layer must be positive\n");
+            return -1;
+        }
+    }
+    for (l = 0; l < numLayers; l++) {
+        if (spec->add[l] > 0 || spec->insert > 0) return 0;
+    }
+    fprintf(stderr, "Nothing to grow\n");
+    return -1;
+}
+
+/**
+ * Build a larger network computing nearly the same function as another one.
+ * Training parameters, activation functions and scaling parameters are kept
+ * @param ann Layered network
+ * @param spec Change, validated with grow_check()
+ * @return New network, or NULL if out of memory (reported)
+ */
+struct fann *grow_network(struct fann *ann, const struct grow_spec *spec)
+{
+    unsigned int numLayers = fann_get_num_layers(ann), newNumLayers = numLayers + (spec->insert > 0);
+    unsigned int numConnections = fann_get_total_connections(ann), newNumConnections = 0;
+    unsigned int *sizes = (unsigned int *) malloc(sizeof(unsigned int) * numLayers);
+    unsigned int *wide = (unsigned int *) malloc(sizeof(unsigned int) * numLayers);
+    unsigned int *newSizes = (unsigned int *) malloc(sizeof(unsigned int) * newNumLayers);
+    unsigned int **src = (unsigned int **) calloc(numLayers, sizeof(unsigned int *));
+    unsigned int **copies = (unsigned int **) calloc(numLayers, sizeof(unsigned int *));
+    struct fann_connection *cons = (struct fann_connection *) malloc(sizeof(struct fann_connection) * numConnections);
+    struct fann_connection *newCons = NULL;
+    unsigned int *layerOf = NULL, *posOf = NULL;
+    struct grow_matrix *old = NULL, *mid = NULL, *grown = NULL;
+    struct fann *result = NULL, *ret = NULL;
+    unsigned int numNeurons, l, i, j, k;
+
+    if (sizes == NULL || wide == NULL || newSizes == NULL || src == NULL || copies == NULL || cons == NULL) goto ERR;
+
+    fann_get_layer_array(ann, sizes);
+    for (l = 0; l < numLayers; l++) {
+        wide[l] = sizes[l] + spec->add[l];
+        src[l] = (unsigned int *) malloc(sizeof(unsigned int) * wide[l]);
+        copies[l] = (unsigned int *) malloc(sizeof(unsigned int) * sizes[l]);
+        if (src[l] == NULL || copies[l] == NULL) goto ERR;
+    }
+    for (l = 0, k = 0; l < numLayers; l++, k++) {
+        if (spec->insert > 0 && l == spec->insert) newSizes[k++] = wide[l - 1];
+        newSizes[k] = wide[l];
+    }
+
+    //FANN seeds its random generator when creating networks
+    result = fann_create_standard_array(newNumLayers, newSizes);
+    if (result == NULL) goto ERR;
+
+    //Dense weights of the original network
+    numNeurons = count_neurons(numLayers, sizes);
+    layerOf = (unsigned int *) malloc(sizeof(unsigned int) * numNeurons);
+    posOf = (unsigned int *) malloc(sizeof(unsigned int) * numNeurons);
+    old = alloc_matrices(numLayers, sizes);
+    if (layerOf == NULL || posOf == NULL || old == NULL) goto ERR;
+    locate_neurons(numLayers, sizes, layerOf, posOf);
+    fann_get_connection_array(ann, cons);
+    for (i = 0; i < numConnections; i++) {
+        unsigned int to = cons[i].to_neuron, from = cons[i].from_neuron;
+        AT(&old[layerOf[to]], posOf[to], posOf[from]) = cons[i].weight;
+    }
+
+    //Split neurons: choose the source of every neuron and count the copies of each one
+    for (l = 0; l < numLayers; l++) {
+        for (j = 0; j < sizes[l]; j++) {
+            src[l][j] = j;
+            copies[l][j] = 1;
+        }
+        for (j = sizes[l]; j < wide[l]; j++) {
+            src[l][j] = (unsigned int) (rand() % sizes[l]);
+            copies[l][src[l][j]]++;
+        }
+    }
+
+    //Widened network: columns share the outgoing weights of split neurons, new rows copy their source
+    mid = alloc_matrices(numLayers, wide);
+    if (mid == NULL) goto ERR;
+    for (l = 1; l < numLayers; l++) {
+        for (k = 0; k < sizes[l]; k++) {
+            for (j = 0; j < wide[l - 1]; j++) {
+                unsigned int s = src[l - 1][j];
+                AT(&mid[l], k, j) = AT(&old[l], k, s) / (fann_type) copies[l - 1][s];
+            }
+            AT(&mid[l], k, wide[l - 1]) = AT(&old[l], k, sizes[l - 1]);
+        }
+        for (k = sizes[l]; k < wide[l]; k++) {
+            for (j = 0; j <= wide[l - 1]; j++) {
+                AT(&mid[l], k, j) = AT(&mid[l], src[l][k], j) + spec->noise * random_unit();
+            }
+        }
+    }
+
+    //Deepened network: the inserted layer passes the previous one through
+    grown = alloc_matrices(newNumLayers, newSizes);
+    if (grown == NULL) goto ERR;
+    for (l = 1, k = 1; l < numLayers; l++, k++) {
+        if (spec->insert > 0 && l == spec->insert) {
+            fann_type gain = spec->steepness * spec->epsilon;
+            for (j = 0; j < newSizes[k]; j++) AT(&grown[k], j, j) = spec->epsilon;
+            k++;
+            for (i = 0; i < mid[l].rows; i++) {
+                for (j = 0; j < mid[l].cols - 1; j++) AT(&grown[k], i, j) = AT(&mid[l], i, j) / gain;
+                AT(&grown[k], i, j) = AT(&mid[l], i, j);
+            }
+        } else {
+            memcpy(grown[k].w, mid[l].w, sizeof(fann_type) * mid[l].rows * mid[l].cols);
+        }
+    }
+
+    //Activation functions
+    for (l = 1, k = 1; l < numLayers; l++, k++) {
+        if (spec->insert > 0 && l == spec->insert) {
+            for (j = 0; j < newSizes[k]; j++) {
+                fann_set_activation_function(result, spec->activation, (int) k, (int) j);
+                fann_set_activation_steepness(result, spec->steepness, (int) k, (int) j);
+            }
+            k++;
+        }
+        for (j = 0; j < wide[l]; j++) {
+            fann_set_activation_function(result, fann_get_activation_function(ann, (int) l, (int) src[l][j]), (int) k, (int) j);
+            fann_set_activation_steepness(result, fann_get_activation_steepness(ann, (int) l, (int) src[l][j]), (int) k, (int) j);
+        }
+    }
+
+    //Weights of the new network
+    free(layerOf);
+    free(posOf);
+    numNeurons = count_neurons(newNumLayers, newSizes);
+    newNumConnections = fann_get_total_connections(result);
+    layerOf = (unsigned int *) malloc(sizeof(unsigned int) * numNeurons);
+    posOf = (unsigned int *) malloc(sizeof(unsigned int) * numNeurons);
+    newCons = (struct fann_connection *) malloc(sizeof(struct fann_connection) * newNumConnections);
+    if (layerOf == NULL || posOf == NULL || newCons == NULL) goto ERR;
+    locate_neurons(newNumLayers, newSizes, layerOf, posOf);
+    fann_get_connection_array(result, newCons);
+    for (i = 0; i < newNumConnections; i++) {
+        unsigned int to = newCons[i].to_neuron, from = newCons[i].from_neuron;
+        newCons[i].weight = AT(&grown[layerOf[to]], posOf[to], posOf[from]);
+    }
+    fann_set_weight_array(result, newCons, newNumConnections);
+
+    if (copy_params(result, ann) != 0) goto ERR;
+
+    ret = result;
+    result = NULL;
+    goto EXIT;
+
+ERR:
+    fprintf(stderr, "Out of memory!\n");
+EXIT:
+    if (result != NULL) fann_destroy(result);
+    for (l = 0; l < numLayers; l++) {
+        if (src != NULL) free(src[l]);
+        if (copies != NULL) free(copies[l]);
+    }
+    free_matrices(old, numLayers);
+    free_matrices(mid, numLayers);
+    free_matrices(grown, newNumLayers);
+    free(sizes);
+    free(wide);
+    free(newSizes);
+    free(src);
+    free(copies);
+    free(cons);
+    free(newCons);
+    free(layerOf);
+    free(posOf);
+    return ret;
+}
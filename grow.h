@@ -0,0 +1,44 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef GROW_H
+#define	GROW_H
+
+#include <fann.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/** Topology change applied by grow_network() */
+struct grow_spec {
+    unsigned int *add;                          /**< Neurons added to each layer (numLayers entries). Only hidden layers may grow */
+    unsigned int insert;                        /**< Insert a hidden layer before this layer (1 to numLayers-1), or 0 for none */
+    enum fann_activationfunc_enum activation;   /**< Activation function of the inserted layer */
+    fann_type steepness;                        /**< Activation steepness of the inserted layer */
+    fann_type epsilon;                          /**< Weight connecting each inserted neuron to its counterpart in the previous layer */
+    fann_type noise;                            /**< Amplitude of the noise added to the incoming weights of split neurons */
+};
+
+int grow_check(struct fann *ann, const struct grow_spec *spec);
+struct fann *grow_network(struct fann *ann, const struct grow_spec *spec);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* GROW_H */
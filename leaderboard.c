@@ -0,0 +1,177 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+/*
+ * Ranking of many networks on one test set.
+ *
+ * The test data is loaded once by the caller and only read from then on.
+ * Networks are handed out one at a time to a pool of threads; each thread
+ * loads its network, compiles it into an image if needed, and tests it with
+ * scratch buffers of its own, scaling rows into them when the network has
+ * scaling parameters so that the shared data is never modified.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "leaderboard.h"
+#include "cache.h"
+#include "compress.h"
+#include "threads.h"
+
+/** Argument of score() */
+struct leaderboard_job {
+    const struct fann_train_data *data;
+    const char *const *paths;
+    int useCache;
+    enum net_activation_mode mode;
+    struct leaderboard_entry *entries;
+};
+
+/** Monotonic time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Get the image of a network file
+ * @param path ANN file or network image
+ * @param useCache Non-zero to go through the model cache
+ * @param entry Output entry. Release with cache_release()
+ * @return 0 on success, -1 on error (reported)
+ */
+static int load_image(const char *path, int useCache, struct cache_entry *entry)
+{
+    if (useCache) {
+        if (cache_load(path, entry) == 0) return 0;
+        fprintf(stderr, "Could not load ANN from %s\n", path);
+        return -1;
+    }
+
+    int isImage = cache_map_image(path, entry);
+    if (isImage != 0) return (isImage > 0) ? 0 : -1;
+
+    struct fann *ann = compress_load_ann(path);
+    if (ann == NULL) return -1;
+    entry->owned = net_compile(ann);
+    fann_destroy(ann);
+    if (entry->owned == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        return -1;
+    }
+    entry->image = entry->owned;
+    return 0;
+}
+
+/** Load and test a network */
+static void score(unsigned int index, void *arg)
+{
+    struct leaderboard_job *job = (struct leaderboard_job *) arg;
+    const struct fann_train_data *data = job->data;
+    struct leaderboard_entry *entry = &job->entries[index];
+    struct cache_entry cached = {NULL};
+
+    entry->path = job->paths[index];
+    if (load_image(entry->path, job->useCache, &cached) != 0) return;
+
+    const struct net_image *img = cached.image;
+    if (img->numInput != data->num_input || img->numOutput != data->num_output) {
+        fprintf(stderr, "%s: expected %u inputs and %u outputs, but test data has %u inputs and %u outputs\n",
+                entry->path, img->numInput, img->numOutput, data->num_input, data->num_output);
+        cache_release(&cached);
+        return;
+    }
+
+    fann_type *values = (fann_type *) malloc(sizeof(fann_type) * (img->totalNeurons + img->numInput + img->numOutput));
+    if (values == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        cache_release(&cached);
+        return;
+    }
+    fann_type *input = values + img->totalNeurons, *desired = input + img->numInput;
+    struct net_mse mse = {0};
+    unsigned int i;
+
+    double start = now();
+    for (i = 0; i < data->num_data; i++) {
+        const fann_type *in = data->input[i], *out = data->output[i];
+        if (img->offScale != 0) {
+            memcpy(input, in, sizeof(fann_type) * img->numInput);
+            memcpy(desired, out, sizeof(fann_type) * img->numOutput);
+            net_scale_input(img, input);
+            net_scale_output(img, desired);
+            in = input;
+            out = desired;
+        }
+        net_test(img, in, out, values, job->mode, &mse);
+    }
+    double elapsed = now() - start;
+
+    entry->ok = 1;
+    entry->mse = net_get_mse(&mse);
+    entry->bitFail = mse.bitFail;
+    entry->parameters = img->totalConnections;
+    entry->usPerSample = (data->num_data > 0) ? elapsed * 1e6 / data->num_data : 0;
+
+    free(values);
+    cache_release(&cached);
+}
+
+/**
+ * Test several networks on the same data, concurrently
+ * @param data Test data, only read
+ * @param count Number of networks
+ * @param paths ANN files or network images
+ * @param useCache Non-zero to load ANN files through the model cache
+ * @param mode Activation mode
+ * @param nThreads Maximum number of threads (0: one per processor)
+ * @param entries Output scores, in the order of paths. Networks that could not be tested are reported and left with ok set to 0
+ */
+void leaderboard_run(const struct fann_train_data *data, unsigned int count, const char *const *paths, int useCache,
+        enum net_activation_mode mode, unsigned int nThreads, struct leaderboard_entry *entries)
+{
+    struct leaderboard_job job = {data, paths, useCache, mode, entries};
+    memset(entries, 0, sizeof(struct leaderboard_entry) * count);
+    threads_run(nThreads, count, score, &job);
+}
+
+/** Order of entries: tested first, then by MSE, bit fail count, size and path */
+static int compare_entries(const void *a, const void *b)
+{
+    const struct leaderboard_entry *x = (const struct leaderboard_entry *) a, *y = (const struct leaderboard_entry *) b;
+    if (x->ok != y->ok) return x->ok ? -1 : 1;
+    if (x->ok) {
+        if (x->mse != y->mse) return (x->mse < y->mse) ? -1 : 1;
+        if (x->bitFail != y->bitFail) return (x->bitFail < y->bitFail) ? -1 : 1;
+        if (x->parameters != y->parameters) return (x->parameters < y->parameters) ? -1 : 1;
+    }
+    return strcmp(x->path, y->path);
+}
+
+/**
+ * Sort scores from best to worst. Networks that could not be tested go last
+ * @param entries Scores
+ * @param count Number of scores
+ */
+void leaderboard_sort(struct leaderboard_entry *entries, unsigned int count)
+{
+    qsort(entries, count, sizeof(struct leaderboard_entry), compare_entries);
+}
@@ -0,0 +1,46 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef LEADERBOARD_H
+#define	LEADERBOARD_H
+
+#include <fann.h>
+#include "net.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/** Score of a network on the shared test data */
+struct leaderboard_entry {
+    const char *path;           /**< ANN file or network image */
+    int ok;                     /**< Non-zero if the network could be loaded and tested */
+    float mse;                  /**< Mean square error */
+    unsigned int bitFail;       /**< Number of outputs above the bit fail limit */
+    unsigned int parameters;    /**< Number of weights, including bias weights */
+    double usPerSample;         /**< Inference time per sample, in microseconds */
+};
+
+void leaderboard_run(const struct fann_train_data *data, unsigned int count, const char *const *paths, int useCache,
+        enum net_activation_mode mode, unsigned int nThreads, struct leaderboard_entry *entries);
+void leaderboard_sort(struct leaderboard_entry *entries, unsigned int count);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* LEADERBOARD_H */
@@ -0,0 +1,397 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+/*
+ * Online learning.
+ *
+ * Labeled samples (input values followed by output values, as in the body of
+ * a data file) arrive on STDIN or on connections to a listening socket. Ingest
+ * threads parse them into a bounded queue which never blocks them: when it is
+ * full, the oldest queued samples are dropped. The update loop takes samples
+ * from the queue in batches and applies an incremental update for each one,
+ * publishing snapshots of the network and reports at regular intervals.
+ *
+ * Snapshots are written to a temporary file and renamed over the previous
+ * one, so readers always find a complete network.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "learn.h"
+#include "net.h"
+#include "parse.h"
+
+/** Samples taken from the queue at once */
+#define LEARN_BATCH 256
+
+/** Longest wait for samples before checking timers and signals, in seconds */
+#define LEARN_POLL  0.2
+
+/** Bounded sample queue */
+struct learn_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t nonEmpty;
+    fann_type *rows;            /**< Ring of rows (inputs followed by outputs) */
+    unsigned int rowSize;       /**< Values per row */
+    unsigned int cap;           /**< Ring capacity in rows */
+    unsigned int head;          /**< Oldest row */
+    unsigned int count;         /**< Queued rows */
+    unsigned long received;     /**< Rows received */
+    unsigned long dropped;      /**< Rows dropped because the queue was full */
+    unsigned long malformed;    /**< Rows skipped because they could not be parsed */
+    int closed;                 /**< Non-zero once no more rows will arrive */
+    volatile sig_atomic_t *stop;    /**< Set by the caller to stop learning, or NULL */
+};
+
+/** Source read by an ingest thread */
+struct learn_ingest {
+    struct learn_queue *queue;
+    FILE *fp;                   /**< Stream to read */
+    int listenFd;               /**< Listening socket to accept streams from, or -1 */
+};
+
+/** Monotonic time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Queue a row. Never blocks for long: if the queue is full, the oldest row is dropped
+ * @param q Queue
+ * @param row Row
+ */
+static void queue_push(struct learn_queue *q, const fann_type *row)
+{
+    pthread_mutex_lock(&q->lock);
+    if (q->count == q->cap) {
+        q->head = (q->head + 1) % q->cap;
+        q->count--;
+        q->dropped++;
+    }
+    unsigned int tail = (q->head + q->count) % q->cap;
+    memcpy(q->rows + (size_t) tail * q->rowSize, row, sizeof(fann_type) * q->rowSize);
+    q->count++;
+    q->received++;
+    pthread_cond_signal(&q->nonEmpty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/** Tell whether the caller asked to stop learning */
+static int stop_requested(const struct learn_queue *q)
+{
+    return q->stop != NULL && *q->stop;
+}
+
+/**
+ * Take up to max rows, waiting until some are available, the queue is closed or the deadline passes
+ * @param q Queue
+ * @param rows Output rows
+ * @param max Maximum number of rows
+ * @param deadline Monotonic time to give up waiting at
+ * @return Number of rows taken
+ */
+static unsigned int queue_pop(struct learn_queue *q, fann_type *rows, unsigned int max, double deadline)
+{
+    unsigned int n = 0;
+
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && !q->closed && !stop_requested(q)) {
+        struct timespec ts;
+        double wait = deadline - now();
+        if (wait <= 0) break;
+        //Condition variables wait on the realtime clock
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += (time_t) wait;
+        ts.tv_nsec += (long) ((wait - (double) (time_t) wait) * 1e9);
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        if (pthread_cond_timedwait(&q->nonEmpty, &q->lock, &ts) == ETIMEDOUT) break;
+    }
+    while (n < max && q->count > 0) {
+        memcpy(rows + (size_t) n * q->rowSize, q->rows + (size_t) q->head * q->rowSize, sizeof(fann_type) * q->rowSize);
+        q->head = (q->head + 1) % q->cap;
+        q->count--;
+        n++;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+/**
+ * Read rows from a stream into the queue until it ends
+ * @param q Queue
+ * @param fp Stream, closed at the end unless it is STDIN
+ * @param name Name used in error messages
+ */
+static void ingest_stream(struct learn_queue *q, FILE *fp, const char *name)
+{
+    fann_type *row = (fann_type *) malloc(sizeof(fann_type) * q->rowSize);
+    struct parse_src *src = (row != NULL) ? parse_open_live(fp, name) : NULL;
+
+    if (src == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        if (fp != stdin) fclose(fp);
+    } else {
+        int r;
+        while ((r = parse_row(src, row, q->rowSize)) != 0) {
+            if (r > 0) {
+                queue_push(q, row);
+                continue;
+            }
+            //Malformed row (reported): count it and resume on the next line
+            pthread_mutex_lock(&q->lock);
+            q->malformed++;
+            pthread_mutex_unlock(&q->lock);
+            if (parse_skip_line(src) <= 0) break;
+        }
+        parse_close(src);
+    }
+    free(row);
+}
+
+/** Ingest thread reading a single stream */
+static void *ingest_thread(void *p)
+{
+    struct learn_ingest *in = (struct learn_ingest *) p;
+    struct learn_queue *q = in->queue;
+
+    ingest_stream(q, in->fp, (in->fp == stdin) ? "STDIN" : "connection");
+    free(in);
+    return NULL;
+}
+
+/** Ingest thread accepting connections, each one read by its own thread */
+static void *accept_thread(void *p)
+{
+    struct learn_ingest *in = (struct learn_ingest *) p;
+
+    for (;;) {
+        int fd = accept(in->listenFd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("accept");
+            break;
+        }
+        struct learn_ingest *conn = (struct learn_ingest *) malloc(sizeof(struct learn_ingest));
+        FILE *fp = fdopen(fd, "r");
+        pthread_t tid;
+        if (conn == NULL || fp == NULL) {
+            free(conn);
+            if (fp != NULL) fclose(fp); else close(fd);
+            continue;
+        }
+        conn->queue = in->queue;
+        conn->fp = fp;
+        conn->listenFd = -1;
+        if (pthread_create(&tid, NULL, ingest_thread, conn) != 0) {
+            fclose(fp);
+            free(conn);
+            continue;
+        }
+        pthread_detach(tid);
+    }
+
+    pthread_mutex_lock(&in->queue->lock);
+    in->queue->closed = 1;
+    pthread_cond_signal(&in->queue->nonEmpty);
+    pthread_mutex_unlock(&in->queue->lock);
+    free(in);
+    return NULL;
+}
+
+/** Ingest thread reading STDIN, closing the queue at the end */
+static void *stdin_thread(void *p)
+{
+    struct learn_ingest *in = (struct learn_ingest *) p;
+    struct learn_queue *q = in->queue;
+
+    ingest_stream(q, stdin, "STDIN");
+
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_signal(&q->nonEmpty);
+    pthread_mutex_unlock(&q->lock);
+    free(in);
+    return NULL;
+}
+
+/**
+ * Publish a snapshot of a network atomically
+ * @param ann ANN
+ * @param path Snapshot path
+ * @param image Non-zero to write a network image instead of a FANN text file
+ * @return 0 on success, -1 on error (reported)
+ */
+static int publish(struct fann *ann, const char *path, int image)
+{
+    char tmpPath[PATH_MAX];
+    int ok;
+
+    if (snprintf(tmpPath, sizeof(tmpPath), "%s.%ld.tmp", path, (long) getpid()) >= (int) sizeof(tmpPath)) {
+        fprintf(stderr, "%s: path too long\n", path);
+        return -1;
+    }
+
+    if (image) {
+        struct net_image *img = net_compile(ann);
+        int fd = (img != NULL) ? open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+        ok = fd >= 0 && write(fd, img, (size_t) img->size) == (ssize_t) img->size;
+        if (fd >= 0 && close(fd) != 0) ok = 0;
+        free(img);
+    } else {
+        ok = fann_save(ann, tmpPath) == 0;
+    }
+
+    if (!ok || rename(tmpPath, path) != 0) {
+        fprintf(stderr, "%s: could not write snapshot\n", path);
+        unlink(tmpPath);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Train a network online until the input ends (STDIN) or the caller asks to stop
+ * @param ann ANN
+ * @param listenFd Listening socket to accept sample streams from, or -1 to read STDIN
+ * @param params Parameters
+ * @return 0 on success, -1 on error (reported)
+ */
+int learn_run(struct fann *ann, int listenFd, const struct learn_params *params)
+{
+    unsigned int numInput = fann_get_num_input(ann);
+    unsigned int rowSize = numInput + fann_get_num_output(ann);
+    unsigned int window = (params->window > 0) ? params->window : 1;
+    struct learn_queue *q = (struct learn_queue *) calloc(1, sizeof(struct learn_queue));
+    struct learn_ingest *in = (struct learn_ingest *) malloc(sizeof(struct learn_ingest));
+    fann_type *batch = (fann_type *) malloc(sizeof(fann_type) * rowSize * LEARN_BATCH);
+    double *errors = (double *) calloc(window, sizeof(double));
+    pthread_t tid;
+    int r = -1;
+
+    if (q != NULL) {
+        q->rowSize = rowSize;
+        q->stop = params->stop;
+        q->cap = (params->queueSize > 0) ? params->queueSize : 1;
+        q->rows = (fann_type *) malloc(sizeof(fann_type) * rowSize * q->cap);
+    }
+    if (q == NULL || q->rows == NULL || in == NULL || batch == NULL || errors == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        goto ERR;
+    }
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->nonEmpty, NULL);
+
+    in->queue = q;
+    in->fp = stdin;
+    in->listenFd = listenFd;
+    if (pthread_create(&tid, NULL, (listenFd >= 0) ? accept_thread : stdin_thread, in) != 0) {
+        fprintf(stderr, "Could not start the ingest thread\n");
+        goto ERR;
+    }
+    pthread_detach(tid);
+
+    double start = now(), lastReport = start;
+    double nextSnapshot = (params->snapshotPeriod > 0) ? start + params->snapshotPeriod : -1;
+    double nextReport = (params->reportPeriod > 0) ? start + params->reportPeriod : -1;
+    unsigned long updates = 0, reportedUpdates = 0;
+    unsigned int filled = 0, next = 0, i;
+    double errorSum = 0;
+    int closed = 0;
+
+    while (!stop_requested(q)) {
+        double deadline = now() + LEARN_POLL;
+        if (nextSnapshot > 0 && nextSnapshot < deadline) deadline = nextSnapshot;
+        if (nextReport > 0 && nextReport < deadline) deadline = nextReport;
+
+        unsigned int n = queue_pop(q, batch, LEARN_BATCH, deadline);
+        if (n == 0) {
+            pthread_mutex_lock(&q->lock);
+            closed = q->closed && q->count == 0;
+            pthread_mutex_unlock(&q->lock);
+        }
+
+        for (i = 0; i < n; i++) {
+            fann_type *row = batch + (size_t) i * rowSize;
+            if (ann->scale_mean_in != NULL) fann_scale_input(ann, row);
+            if (ann->scale_mean_out != NULL) fann_scale_output(ann, row + numInput);
+            fann_reset_MSE(ann);
+            fann_train(ann, row, row + numInput);
+
+            //Rolling window of per sample errors, recomputed on every wrap to avoid drift
+            double e = fann_get_MSE(ann);
+            errorSum += e - errors[next];
+            errors[next] = e;
+            if (++next == window) {
+                unsigned int j;
+                next = 0;
+                errorSum = 0;
+                for (j = 0; j < window; j++) errorSum += errors[j];
+            }
+            if (filled < window) filled++;
+        }
+        updates += n;
+
+        double t = now();
+        if (nextSnapshot > 0 && t >= nextSnapshot) {
+            publish(ann, params->snapshotPath, params->snapshotImage);
+            nextSnapshot = t + params->snapshotPeriod;
+        }
+        if (nextReport > 0 && (t >= nextReport || closed)) {
+            pthread_mutex_lock(&q->lock);
+            unsigned int queued = q->count;
+            unsigned long dropped = q->dropped, malformed = q->malformed;
+            pthread_mutex_unlock(&q->lock);
+            fprintf(params->report, "Samples %10lu. Updates/s: %10.1f. Rolling MSE: %.6f. Queued: %u. Dropped: %lu. Malformed: %lu\n",
+                    updates, (double) (updates - reportedUpdates) / (t - lastReport), (filled > 0) ? errorSum / filled : 0.0, queued, dropped, malformed);
+            fflush(params->report);
+            reportedUpdates = updates;
+            lastReport = t;
+            nextReport = t + params->reportPeriod;
+        }
+
+        if (closed) break;
+    }
+
+    r = publish(ann, params->snapshotPath, params->snapshotImage);
+
+    //Ingest threads may still be blocked reading, so the queue is left to the process exit
+    free(batch);
+    free(errors);
+    return r;
+
+ERR:
+    if (q != NULL) free(q->rows);
+    free(q);
+    free(in);
+    free(batch);
+    free(errors);
+    return r;
+}
@@ -0,0 +1,48 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef LEARN_H
+#define	LEARN_H
+
+#include <stdio.h>
+#include <signal.h>
+#include <fann.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/** Parameters of online learning */
+struct learn_params {
+    const char *snapshotPath;       /**< Where snapshots are published */
+    int snapshotImage;              /**< Non-zero to publish network images instead of FANN text files */
+    double snapshotPeriod;          /**< Seconds between snapshots, or 0 to publish only at the end */
+    double reportPeriod;            /**< Seconds between reports, or 0 for no reports */
+    unsigned int queueSize;         /**< Samples the ingest queue holds before dropping the oldest ones */
+    unsigned int window;            /**< Samples in the rolling MSE */
+    FILE *report;                   /**< Report stream */
+    volatile sig_atomic_t *stop;    /**< Flag the caller sets, e.g. from a signal handler, to stop learning, or NULL */
+};
+
+int learn_run(struct fann *ann, int listenFd, const struct learn_params *params);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* LEARN_H */
+
@@ -0,0 +1,151 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+/*
+ * Inference metrics.
+ *
+ * Commands keep a struct metrics when --stats is given and a NULL pointer
+ * otherwise; every instrumentation point is a NULL check away from being
+ * skipped, so clocks are only read when someone asked for the numbers.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include "metrics.h"
+
+#define SUB_COUNT   (1u << METRICS_SUB_BITS)
+
+/** Monotonic time in nanoseconds */
+uint64_t metrics_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * Initialize metrics and start their clock
+ * @param m Metrics
+ */
+void metrics_init(struct metrics *m)
+{
+    memset(m, 0, sizeof(*m));
+    m->latency.min = UINT64_MAX;
+    m->start = metrics_now();
+}
+
+/** Position of the most significant bit of a non-zero value */
+static unsigned int msb(uint64_t v)
+{
+    unsigned int n = 0;
+    if (v >> 32) { v >>= 32; n += 32; }
+    if (v >> 16) { v >>= 16; n += 16; }
+    if (v >> 8)  { v >>= 8;  n += 8; }
+    if (v >> 4)  { v >>= 4;  n += 4; }
+    if (v >> 2)  { v >>= 2;  n += 2; }
+    if (v >> 1)  n += 1;
+    return n;
+}
+
+/** Bucket of a value */
+static unsigned int bucket_index(uint64_t v)
+{
+    if (v < 2 * SUB_COUNT) return (unsigned int) v;
+    unsigned int shift = msb(v) - METRICS_SUB_BITS;
+    return shift * SUB_COUNT + (unsigned int) (v >> shift);
+}
+
+/** Largest value that falls in a bucket */
+static uint64_t bucket_highest(unsigned int index)
+{
+    if (index < 2 * SUB_COUNT) return index;
+    unsigned int shift = index / SUB_COUNT - 1;
+    uint64_t sub = index - shift * SUB_COUNT;
+    return ((sub + 1) << shift) - 1;
+}
+
+/**
+ * Record a value
+ * @param h Histogram
+ * @param value Value
+ */
+void metrics_record(struct metrics_histogram *h, uint64_t value)
+{
+    h->counts[bucket_index(value)]++;
+    h->count++;
+    h->sum += value;
+    if (value < h->min) h->min = value;
+    if (value > h->max) h->max = value;
+}
+
+/**
+ * Value below or at which a percentage of the recorded values fall, within the histogram precision
+ * @param h Histogram
+ * @param percentile Percentage, from 0 to 100
+ * @return Value, or 0 if the histogram is empty
+ */
+uint64_t metrics_percentile(const struct metrics_histogram *h, double percentile)
+{
+    if (h->count == 0) return 0;
+    uint64_t target = (uint64_t) ceil(percentile / 100.0 * (double) h->count);
+    if (target < 1) target = 1;
+    if (target > h->count) target = h->count;
+
+    uint64_t seen = 0;
+    unsigned int i;
+    for (i = 0; i < METRICS_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= target) {
+            uint64_t v = bucket_highest(i);
+            if (v > h->max) v = h->max;
+            if (v < h->min) v = h->min;
+            return v;
+        }
+    }
+    return h->max;
+}
+
+/**
+ * Print metrics as a line of JSON. Times are given in seconds and latencies in microseconds
+ * @param m Metrics
+ * @param command Name of the command
+ * @param fp Stream
+ */
+void metrics_print(const struct metrics *m, const char *command, FILE *fp)
+{
+    const struct metrics_histogram *h = &m->latency;
+    double seconds = (double) (metrics_now() - m->start) * 1e-9;
+    double rate = (seconds > 0) ? 1.0 / seconds : 0;
+    unsigned int i;
+
+    fprintf(fp, "{\"command\": \"%s\", \"rows\": %llu, \"bytes\": %llu, \"seconds\": %.6f, \"rows_per_second\": %.1f, \"bytes_per_second\": %.1f, \"time\": {",
+            command, (unsigned long long) m->rows, (unsigned long long) m->bytes, seconds,
+            (double) m->rows * rate, (double) m->bytes * rate);
+    for (i = 0; i < METRICS_PHASES; i++) {
+        fprintf(fp, "%s\"%s\": %.6f", (i > 0) ? ", " : "", METRICS_PHASE_NAMES[i], (double) m->phaseNs[i] * 1e-9);
+    }
+    fprintf(fp, "}, \"latency_us\": {\"count\": %llu, \"min\": %.3f, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f}}\n",
+            (unsigned long long) h->count,
+            (h->count > 0) ? (double) h->min * 1e-3 : 0.0,
+            (h->count > 0) ? (double) h->sum / (double) h->count * 1e-3 : 0.0,
+            (double) metrics_percentile(h, 50) * 1e-3,
+            (double) metrics_percentile(h, 90) * 1e-3,
+            (double) metrics_percentile(h, 99) * 1e-3,
+            (double) metrics_percentile(h, 99.9) * 1e-3,
+            (double) h->max * 1e-3);
+}
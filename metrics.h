@@ -0,0 +1,93 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef METRICS_H
+#define	METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/** Bits of precision of the histogram: values are recorded with a relative error below 2^-METRICS_SUB_BITS */
+#define METRICS_SUB_BITS    5
+/** Number of histogram buckets needed to cover every uint64_t value */
+#define METRICS_BUCKETS     ((65 - METRICS_SUB_BITS) << METRICS_SUB_BITS)
+
+/**
+ * Latency histogram.
+ * Values below 2^(METRICS_SUB_BITS+1) get a bucket each; above that, every
+ * power of two is split into 2^METRICS_SUB_BITS linear buckets, as HDR
+ * histograms do, so recording is a couple of shifts and an increment.
+ */
+struct metrics_histogram {
+    uint64_t count;                     /**< Recorded values */
+    uint64_t min;                       /**< Smallest recorded value */
+    uint64_t max;                       /**< Largest recorded value */
+    uint64_t sum;                       /**< Sum of the recorded values */
+    uint64_t counts[METRICS_BUCKETS];   /**< Values recorded in each bucket */
+};
+
+/** Phases of an inference command */
+enum metrics_phase {
+    METRICS_LOAD = 0,       /**< Loading the network */
+    METRICS_PARSE,          /**< Reading and converting input data */
+    METRICS_COMPUTE,        /**< Running the network */
+    METRICS_OUTPUT,         /**< Writing results */
+    METRICS_PHASES
+};
+
+static char const *const METRICS_PHASE_NAMES[] = {"load", "parse", "compute", "output"};
+
+/** Counters of an inference command */
+struct metrics {
+    uint64_t start;                         /**< Monotonic time the command started at, in nanoseconds */
+    uint64_t rows;                          /**< Rows scored */
+    uint64_t bytes;                         /**< Bytes of input data parsed */
+    uint64_t phaseNs[METRICS_PHASES];       /**< Time spent in each phase, in nanoseconds */
+    struct metrics_histogram latency;       /**< Latency of every request (row), in nanoseconds */
+};
+
+uint64_t metrics_now(void);
+void metrics_init(struct metrics *m);
+void metrics_record(struct metrics_histogram *h, uint64_t value);
+uint64_t metrics_percentile(const struct metrics_histogram *h, double percentile);
+void metrics_print(const struct metrics *m, const char *command, FILE *fp);
+
+/**
+ * Account the time elapsed since a previous lap to a phase. Does nothing
+ * when metrics are disabled, so that instrumented paths cost a branch
+ * @param m Metrics, or NULL if disabled
+ * @param phase Phase
+ * @param since Time returned by the previous lap or metrics_now()
+ * @return Current time, or 0 if disabled
+ */
+static inline uint64_t metrics_lap(struct metrics *m, enum metrics_phase phase, uint64_t since)
+{
+    if (m == NULL) return 0;
+    uint64_t t = metrics_now();
+    m->phaseNs[phase] += t - since;
+    return t;
+}
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* METRICS_H */
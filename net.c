@@ -0,0 +1,469 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "net.h"
+
+/** Round size up to a multiple of 64 bytes, so every array starts on a cache line */
+#define ALIGN64(x) (((x) + 63) & ~((uint64_t) 63))
+
+/**
+ * Compile a FANN network into a flat image.
+ * Only the public FANN API is used, so the image reflects exactly what
+ * fann_get_connection_array() and friends report. Scaling parameters, which
+ * have no getters, are read from struct fann.
+ * @param ann ANN
+ * @return Image (release with free()) or NULL if out of memory
+ */
+struct net_image *net_compile(struct fann *ann)
+{
+    unsigned int i, j;
+    unsigned int numLayers = fann_get_num_layers(ann);
+    unsigned int totalConnections = fann_get_total_connections(ann);
+    unsigned int *layers = (unsigned int *) malloc(sizeof(unsigned int) * numLayers);
+    unsigned int *biases = (unsigned int *) malloc(sizeof(unsigned int) * numLayers);
+    struct fann_connection *conns = (struct fann_connection *) malloc(sizeof(struct fann_connection) * (totalConnections + 1));
+    struct net_image *img = NULL;
+
+    if (layers == NULL || biases == NULL || conns == NULL) goto EXIT;
+
+    fann_get_layer_array(ann, layers);
+    fann_get_bias_array(ann, biases);
+    fann_get_connection_array(ann, conns);
+
+    unsigned int totalNeurons = 0;
+    for (i = 0; i < numLayers; i++) {
+        totalNeurons += layers[i] + biases[i];
+    }
+
+    uint64_t offLayers  = ALIGN64(sizeof(struct net_image));
+    uint64_t offNeurons = ALIGN64(offLayers + sizeof(uint32_t) * (numLayers + 1));
+    uint64_t offSources = ALIGN64(offNeurons + sizeof(struct net_neuron) * totalNeurons);
+    uint64_t offWeights = ALIGN64(offSources + sizeof(uint32_t) * totalConnections);
+    uint64_t offScale   = ALIGN64(offWeights + sizeof(fann_type) * totalConnections);
+    int scaled = (ann->scale_mean_in != NULL || ann->scale_mean_out != NULL);
+    uint64_t size       = scaled ? ALIGN64(offScale + sizeof(fann_type) * 2 * (fann_get_num_input(ann) + fann_get_num_output(ann))) : offScale;
+
+    img = (struct net_image *) calloc(1, size);
+    if (img == NULL) goto EXIT;
+
+    img->magic = NET_IMAGE_MAGIC;
+    img->version = NET_IMAGE_VERSION;
+    img->typeSize = sizeof(fann_type);
+    img->networkType = fann_get_network_type(ann);
+    img->numLayers = numLayers;
+    img->numInput = fann_get_num_input(ann);
+    img->numOutput = fann_get_num_output(ann);
+    img->totalNeurons = totalNeurons;
+    img->totalConnections = totalConnections;
+    img->bitFailLimit = fann_get_bit_fail_limit(ann);
+    img->size = size;
+    img->offLayers = offLayers;
+    img->offNeurons = offNeurons;
+    img->offSources = offSources;
+    img->offWeights = offWeights;
+    img->offScale = scaled ? offScale : 0;
+
+    uint32_t *layerStart = (uint32_t *) ((char *) img + offLayers);
+    struct net_neuron *neurons = (struct net_neuron *) ((char *) img + offNeurons);
+    uint32_t *sources = (uint32_t *) ((char *) img + offSources);
+    fann_type *weights = (fann_type *) ((char *) img + offWeights);
+
+    //Layer boundaries and per neuron activation parameters
+    layerStart[0] = 0;
+    for (i = 0; i < numLayers; i++) {
+        layerStart[i + 1] = layerStart[i] + layers[i] + biases[i];
+        if (i == 0) continue;
+        for (j = 0; j < layers[i]; j++) {
+            struct net_neuron *neuron = &neurons[layerStart[i] + j];
+            neuron->activationFunction = (uint32_t) fann_get_activation_function(ann, i, j);
+            neuron->steepness = fann_get_activation_steepness(ann, i, j);
+        }
+    }
+
+    //Connections are grouped by destination neuron: count, prefix sum and scatter
+    for (i = 0; i < totalConnections; i++) {
+        neurons[conns[i].to_neuron].lastCon++;
+    }
+    uint32_t next = 0;
+    for (i = 0; i < totalNeurons; i++) {
+        uint32_t count = neurons[i].lastCon;
+        neurons[i].firstCon = next;
+        neurons[i].lastCon = next;
+        next += count;
+    }
+    for (i = 0; i < totalConnections; i++) {
+        struct net_neuron *neuron = &neurons[conns[i].to_neuron];
+        sources[neuron->lastCon] = conns[i].from_neuron;
+        weights[neuron->lastCon] = conns[i].weight;
+        neuron->lastCon++;
+    }
+
+    //FANN scales as ((v - mean) / deviation + 1) * factor + newMin, which is folded into v * factor' + offset
+    if (scaled) {
+        fann_type *scale = (fann_type *) ((char *) img + offScale);
+        const float *mean[2] = {ann->scale_mean_in, ann->scale_mean_out};
+        const float *deviation[2] = {ann->scale_deviation_in, ann->scale_deviation_out};
+        const float *factor[2] = {ann->scale_factor_in, ann->scale_factor_out};
+        const float *newMin[2] = {ann->scale_new_min_in, ann->scale_new_min_out};
+        unsigned int count[2] = {img->numInput, img->numOutput};
+        for (i = 0; i < 2; i++) {
+            for (j = 0; j < count[i]; j++) {
+                if (mean[i] == NULL) {
+                    scale[j] = 1;
+                    scale[count[i] + j] = 0;
+                } else {
+                    double f = (double) factor[i][j] / deviation[i][j];
+                    scale[j] = (fann_type) f;
+                    scale[count[i] + j] = (fann_type) (factor[i][j] - mean[i][j] * f + newMin[i][j]);
+                }
+            }
+            scale += 2 * count[i];
+        }
+    }
+
+EXIT:
+    free(layers);
+    free(biases);
+    free(conns);
+    return img;
+}
+
+/**
+ * Check that a memory block holds a consistent image.
+ * Used before trusting an image read from disk.
+ * @param img Image
+ * @param size Size of the memory block
+ * @return 0 if valid, -1 otherwise
+ */
+int net_validate(const struct net_image *img, size_t size)
+{
+    uint32_t i;
+
+    if (size < sizeof(struct net_image)) return -1;
+    if (img->magic != NET_IMAGE_MAGIC || img->version != NET_IMAGE_VERSION || img->typeSize != sizeof(fann_type)) return -1;
+    if (img->size > size || img->numLayers < 2) return -1;
+    if (img->offLayers + sizeof(uint32_t) * ((uint64_t) img->numLayers + 1) > img->size) return -1;
+    if (img->offNeurons + sizeof(struct net_neuron) * (uint64_t) img->totalNeurons > img->size) return -1;
+    if (img->offSources + sizeof(uint32_t) * (uint64_t) img->totalConnections > img->size) return -1;
+    if (img->offWeights + sizeof(fann_type) * (uint64_t) img->totalConnections > img->size) return -1;
+    if (img->offScale != 0 && img->offScale + sizeof(fann_type) * 2 * ((uint64_t) img->numInput + img->numOutput) > img->size) return -1;
+
+    const uint32_t *layerStart = NET_LAYERS(img);
+    const struct net_neuron *neurons = NET_NEURONS(img);
+    const uint32_t *sources = NET_SOURCES(img);
+
+    if (layerStart[0] != 0 || layerStart[img->numLayers] != img->totalNeurons) return -1;
+    if (layerStart[1] < img->numInput || layerStart[img->numLayers] - layerStart[img->numLayers - 1] != img->numOutput) return -1;
+    for (i = 0; i < img->numLayers; i++) {
+        if (layerStart[i] > layerStart[i + 1]) return -1;
+    }
+    for (i = 0; i < img->totalNeurons; i++) {
+        if (neurons[i].firstCon > neurons[i].lastCon || neurons[i].lastCon > img->totalConnections) return -1;
+    }
+    for (i = 0; i < img->totalConnections; i++) {
+        if (sources[i] >= img->totalNeurons) return -1;
+    }
+    return 0;
+}
+
+/**
+ * Compute the weighted sums of a range of neurons, scaled by their steepness
+ * and clamped as fann_run() does. Sums are stored in the neurons' values,
+ * ready for net_activate(). Bias neurons get their constant value of 1.
+ * Mirrors fann_run(), including its summation order, so results match the ones
+ * computed by FANN.
+ * @param img Image
+ * @param first First neuron
+ * @param last One past the last neuron. The range must not span neurons depending on each other
+ * @param values Neuron values
+ */
+void net_sums(const struct net_image *img, uint32_t first, uint32_t last, fann_type *values)
+{
+    const struct net_neuron *neurons = NET_NEURONS(img);
+    const uint32_t *sources = NET_SOURCES(img);
+    const fann_type *weights = NET_WEIGHTS(img);
+    uint32_t i, n;
+
+    for (n = first; n < last; n++) {
+        const struct net_neuron *neuron = &neurons[n];
+        uint32_t numConnections = neuron->lastCon - neuron->firstCon;
+
+        if (numConnections == 0) {
+            values[n] = 1; //bias neuron
+            continue;
+        }
+
+        const uint32_t *src = sources + neuron->firstCon;
+        const fann_type *w = weights + neuron->firstCon;
+        fann_type sum = 0;
+
+        i = numConnections & 3;
+        switch (i) {
+            case 3: sum += w[2] * values[src[2]];
+            case 2: sum += w[1] * values[src[1]];
+            case 1: sum += w[0] * values[src[0]];
+            case 0: break;
+        }
+        for (; i != numConnections; i += 4) {
+            sum += w[i] * values[src[i]] + w[i + 1] * values[src[i + 1]] + w[i + 2] * values[src[i + 2]] + w[i + 3] * values[src[i + 3]];
+        }
+
+        fann_type steepness = neuron->steepness;
+        fann_type maxSum = 150 / steepness;
+        sum = steepness * sum;
+        if (sum > maxSum) sum = maxSum;
+        else if (sum < -maxSum) sum = -maxSum;
+
+        values[n] = sum;
+    }
+}
+
+/** Coefficients of the polynomial approximating 2^f for f in [-0.5, 0.5]. Relative error about 1e-7 */
+#define EXP2_C0 1.0f
+#define EXP2_C1 0.6931469492f
+#define EXP2_C2 0.2402212175f
+#define EXP2_C3 0.0555074262f
+#define EXP2_C4 0.0096754597f
+#define EXP2_C5 0.0013266970f
+
+#define LOG2E   1.4426950409f
+
+/** 1.5 * 2^23: adding it to a float of magnitude below 2^22 rounds it to an integer held in the low mantissa bits */
+#define ROUND_MAGIC         12582912.0f
+#define ROUND_MAGIC_BITS    0x4b400000
+/** Bit pattern of 126.0f */
+#define EXP2_LIMIT_BITS     0x42fc0000
+
+/**
+ * Fast exp(x), free of branches, calls and float comparisons or conversions
+ * (which may trap, keeping compilers from vectorizing) so that loops using it
+ * vectorize. x is split into k + f, with k integer and f in [-0.5, 0.5]: 2^k
+ * is built straight into the exponent bits and 2^f is approximated by a
+ * polynomial. Results are clamped to [2^-126, 2^126]
+ * @param x Exponent
+ * @return Approximation of exp(x)
+ */
+static inline float fast_exp(float x)
+{
+    union { float f; int32_t i; } y, rounded, scale;
+
+    //Clamp x*log2(e) to [-126, 126] by comparing its magnitude bits as an integer
+    y.f = x * LOG2E;
+    int32_t magnitude = y.i & INT32_MAX;
+    magnitude = (magnitude > EXP2_LIMIT_BITS) ? EXP2_LIMIT_BITS : magnitude;
+    y.i = (y.i & INT32_MIN) | magnitude;
+
+    rounded.f = y.f + ROUND_MAGIC;
+    float f = y.f - (rounded.f - ROUND_MAGIC);
+    float p = EXP2_C0 + f * (EXP2_C1 + f * (EXP2_C2 + f * (EXP2_C3 + f * (EXP2_C4 + f * EXP2_C5))));
+
+    scale.i = (rounded.i - ROUND_MAGIC_BITS + 127) << 23;
+    return p * scale.f;
+}
+
+/**
+ * Apply a fast approximation of an activation function to a run of neurons
+ * @param activationFunction Activation function
+ * @param values Sums of the neurons, replaced by their values
+ * @param count Number of neurons
+ * @return 1 if the function has a fast approximation, 0 otherwise (values are left untouched)
+ */
+static int fast_activate(uint32_t activationFunction, fann_type *values, uint32_t count)
+{
+    uint32_t i;
+
+    switch (activationFunction) {
+        case FANN_SIGMOID:
+            for (i = 0; i < count; i++) values[i] = 1.0f / (1.0f + fast_exp(-2.0f * values[i]));
+            return 1;
+        case FANN_SIGMOID_SYMMETRIC:
+            for (i = 0; i < count; i++) values[i] = 2.0f / (1.0f + fast_exp(-2.0f * values[i])) - 1.0f;
+            return 1;
+        case FANN_GAUSSIAN:
+            for (i = 0; i < count; i++) values[i] = fast_exp(-values[i] * values[i]);
+            return 1;
+        case FANN_GAUSSIAN_SYMMETRIC:
+            for (i = 0; i < count; i++) values[i] = 2.0f * fast_exp(-values[i] * values[i]) - 1.0f;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Apply the activation functions of a range of neurons to the sums computed by net_sums().
+ * In NET_ACTIVATION_FAST mode FANN_SIGMOID, FANN_SIGMOID_SYMMETRIC, FANN_GAUSSIAN and
+ * FANN_GAUSSIAN_SYMMETRIC are evaluated over runs of consecutive neurons with a polynomial
+ * approximation of exp(). Their absolute error with respect to the exact functions is below
+ * 1.1e-7 for FANN_SIGMOID, 2.1e-7 for FANN_SIGMOID_SYMMETRIC, 1.9e-7 for FANN_GAUSSIAN and
+ * 3.7e-7 for FANN_GAUSSIAN_SYMMETRIC, a few float ULPs; other functions are exact.
+ * @param img Image
+ * @param first First neuron
+ * @param last One past the last neuron
+ * @param values Neuron values
+ * @param mode Activation mode
+ */
+void net_activate(const struct net_image *img, uint32_t first, uint32_t last, fann_type *values, enum net_activation_mode mode)
+{
+    const struct net_neuron *neurons = NET_NEURONS(img);
+    uint32_t n = first;
+
+    while (n < last) {
+        const struct net_neuron *neuron = &neurons[n];
+        if (neuron->firstCon == neuron->lastCon) { //bias neuron
+            n++;
+            continue;
+        }
+
+        if (mode == NET_ACTIVATION_FAST) {
+            uint32_t end = n + 1;
+            while (end < last && neurons[end].firstCon != neurons[end].lastCon
+                    && neurons[end].activationFunction == neuron->activationFunction) end++;
+            if (fast_activate(neuron->activationFunction, values + n, end - n)) {
+                n = end;
+                continue;
+            }
+        }
+
+        fann_type sum = values[n];
+        fann_activation_switch(neuron->activationFunction, sum, values[n]);
+        n++;
+    }
+}
+
+/**
+ * Run an image
+ * @param img Image
+ * @param input Input values (numInput)
+ * @param values Scratch buffer for neuron values (totalNeurons)
+ * @param mode Activation mode
+ * @return Pointer to the output values inside the scratch buffer
+ */
+fann_type *net_run(const struct net_image *img, const fann_type *input, fann_type *values, enum net_activation_mode mode)
+{
+    const uint32_t *layerStart = NET_LAYERS(img);
+    uint32_t i, layer;
+
+    memcpy(values, input, sizeof(fann_type) * img->numInput);
+    for (i = img->numInput; i < layerStart[1]; i++) {
+        values[i] = 1; //input layer bias
+    }
+
+    for (layer = 1; layer < img->numLayers; layer++) {
+        net_sums(img, layerStart[layer], layerStart[layer + 1], values);
+        net_activate(img, layerStart[layer], layerStart[layer + 1], values, mode);
+    }
+
+    return values + layerStart[img->numLayers - 1];
+}
+
+/**
+ * Test an image with a single sample, accumulating the error the way fann_test() does
+ * @param img Image
+ * @param input Input values
+ * @param desired Desired output values
+ * @param values Scratch buffer for neuron values (totalNeurons)
+ * @param mode Activation mode
+ * @param mse Accumulator
+ */
+void net_test(const struct net_image *img, const fann_type *input, const fann_type *desired, fann_type *values, enum net_activation_mode mode, struct net_mse *mse)
+{
+    const struct net_neuron *outNeuron = NET_NEURONS(img) + NET_LAYERS(img)[img->numLayers - 1];
+    fann_type *output = net_run(img, input, values, mode);
+    uint32_t i;
+
+    for (i = 0; i < img->numOutput; i++, outNeuron++) {
+        fann_type diff = desired[i] - output[i];
+        switch (outNeuron->activationFunction) {
+            case FANN_LINEAR_PIECE_SYMMETRIC:
+            case FANN_THRESHOLD_SYMMETRIC:
+            case FANN_SIGMOID_SYMMETRIC:
+            case FANN_SIGMOID_SYMMETRIC_STEPWISE:
+            case FANN_ELLIOT_SYMMETRIC:
+            case FANN_GAUSSIAN_SYMMETRIC:
+            case FANN_SIN_SYMMETRIC:
+            case FANN_COS_SYMMETRIC:
+                diff /= (fann_type) 2.0;
+                break;
+            default:
+                break;
+        }
+        mse->value += (float) (diff * diff);
+        if (fabs(diff) >= img->bitFailLimit) mse->bitFail++;
+        mse->count++;
+    }
+}
+
+/**
+ * Get mean square error
+ * @param mse Accumulator
+ * @return MSE, or 0 if nothing was accumulated
+ */
+float net_get_mse(const struct net_mse *mse)
+{
+    return (mse->count > 0) ? mse->value / (float) mse->count : 0;
+}
+
+/**
+ * Scale input values in place as fann_scale_input() does. Images with no
+ * scaling parameters leave them unchanged
+ * @param img Image
+ * @param input Input values (numInput)
+ */
+void net_scale_input(const struct net_image *img, fann_type *input)
+{
+    if (img->offScale == 0) return;
+    const fann_type *factor = NET_SCALE(img), *offset = factor + img->numInput;
+    uint32_t i;
+    for (i = 0; i < img->numInput; i++) {
+        input[i] = input[i] * factor[i] + offset[i];
+    }
+}
+
+/**
+ * Scale desired output values in place as fann_scale_output() does, to test
+ * them against the outputs of net_run()
+ * @param img Image
+ * @param output Output values (numOutput)
+ */
+void net_scale_output(const struct net_image *img, fann_type *output)
+{
+    if (img->offScale == 0) return;
+    const fann_type *factor = NET_SCALE(img) + 2 * img->numInput, *offset = factor + img->numOutput;
+    uint32_t i;
+    for (i = 0; i < img->numOutput; i++) {
+        output[i] = output[i] * factor[i] + offset[i];
+    }
+}
+
+/**
+ * Descale output values in place as fann_descale_output() does
+ * @param img Image
+ * @param output Output values (numOutput)
+ */
+void net_descale_output(const struct net_image *img, fann_type *output)
+{
+    if (img->offScale == 0) return;
+    const fann_type *factor = NET_SCALE(img) + 2 * img->numInput, *offset = factor + img->numOutput;
+    uint32_t i;
+    for (i = 0; i < img->numOutput; i++) {
+        output[i] = (output[i] - offset[i]) / factor[i];
+    }
+}
@@ -0,0 +1,106 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef NET_H
+#define	NET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <fann.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define NET_IMAGE_MAGIC     0x474d494eu   /* "NIMG" */
+#define NET_IMAGE_VERSION   2u
+
+/**
+ * Flat network image.
+ * A network compiled into a single memory block which holds everything
+ * needed to run it. Arrays are addressed by offsets from the start of the
+ * block, so an image can be written to disk and mapped back as is.
+ */
+struct net_image {
+    uint32_t magic;             /**< NET_IMAGE_MAGIC */
+    uint32_t version;           /**< NET_IMAGE_VERSION */
+    uint32_t typeSize;          /**< sizeof(fann_type) of the writer */
+    uint32_t networkType;       /**< enum fann_nettype_enum */
+    uint32_t numLayers;         /**< Number of layers, including input and output */
+    uint32_t numInput;          /**< Number of input neurons */
+    uint32_t numOutput;         /**< Number of output neurons */
+    uint32_t totalNeurons;      /**< Total neurons, including bias neurons */
+    uint32_t totalConnections;  /**< Total connections */
+    fann_type bitFailLimit;     /**< Bit fail limit used when testing */
+    uint64_t size;              /**< Size of the whole image in bytes */
+    uint64_t offLayers;         /**< uint32_t[numLayers+1]: first neuron of each layer */
+    uint64_t offNeurons;        /**< struct net_neuron[totalNeurons] */
+    uint64_t offSources;        /**< uint32_t[totalConnections]: source neuron of each connection */
+    uint64_t offWeights;        /**< fann_type[totalConnections]: connection weights */
+    uint64_t offScale;          /**< fann_type[2*(numInput+numOutput)]: input factors, input offsets, output factors
+                                     and output offsets that scale values as v*factor+offset, or 0 if not scaled */
+};
+
+/** Neuron entry of a network image */
+struct net_neuron {
+    uint32_t firstCon;              /**< First connection */
+    uint32_t lastCon;               /**< One past the last connection. Bias neurons have no connections */
+    uint32_t activationFunction;    /**< enum fann_activationfunc_enum */
+    fann_type steepness;            /**< Activation steepness */
+};
+
+#define NET_LAYERS(img)  ((const uint32_t *) ((const char *) (img) + (img)->offLayers))
+#define NET_NEURONS(img) ((const struct net_neuron *) ((const char *) (img) + (img)->offNeurons))
+#define NET_SOURCES(img) ((const uint32_t *) ((const char *) (img) + (img)->offSources))
+#define NET_WEIGHTS(img) ((const fann_type *) ((const char *) (img) + (img)->offWeights))
+#define NET_SCALE(img)   ((const fann_type *) ((const char *) (img) + (img)->offScale))
+
+/** Number of activation functions known to FANN */
+#define NET_NUM_ACTIVATIONS (sizeof(FANN_ACTIVATIONFUNC_NAMES) / sizeof(FANN_ACTIVATIONFUNC_NAMES[0]))
+
+/** How activation functions are evaluated */
+enum net_activation_mode {
+    NET_ACTIVATION_EXACT = 0,   /**< As FANN does, with the C library's exp() */
+    NET_ACTIVATION_FAST         /**< With a polynomial approximation of exp(). See net_activate() for error bounds */
+};
+
+static char const *const NET_ACTIVATION_MODE_NAMES[] = {"exact", "fast"};
+
+/** MSE accumulator, mirroring the one kept by FANN inside struct fann */
+struct net_mse {
+    float value;            /**< Sum of squared errors */
+    unsigned int count;     /**< Number of accumulated errors */
+    unsigned int bitFail;   /**< Number of errors above the bit fail limit */
+};
+
+struct net_image *net_compile(struct fann *ann);
+int net_validate(const struct net_image *img, size_t size);
+void net_sums(const struct net_image *img, uint32_t first, uint32_t last, fann_type *values);
+void net_activate(const struct net_image *img, uint32_t first, uint32_t last, fann_type *values, enum net_activation_mode mode);
+fann_type *net_run(const struct net_image *img, const fann_type *input, fann_type *values, enum net_activation_mode mode);
+void net_test(const struct net_image *img, const fann_type *input, const fann_type *desired, fann_type *values, enum net_activation_mode mode, struct net_mse *mse);
+float net_get_mse(const struct net_mse *mse);
+void net_scale_input(const struct net_image *img, fann_type *input);
+void net_scale_output(const struct net_image *img, fann_type *output);
+void net_descale_output(const struct net_image *img, fann_type *output);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* NET_H */
+
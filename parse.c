@@ -0,0 +1,953 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+/*
+ * Numeric text parser.
+ *
+ * Values are whitespace separated tokens. Short decimal numbers (the vast
+ * majority in data files) are converted with an exact fast path: the digits
+ * are gathered into an integer and scaled by an exactly representable power
+ * of ten, which yields the same correctly rounded result as strtof(). Longer
+ * or unusual tokens (many digits, large exponents, inf, nan) go through
+ * strtof()/strtod().
+ *
+ * Data files that can be mapped are parsed by several threads: the body is
+ * split at whitespace, every thread first counts the tokens and lines of its
+ * chunk, and after a prefix sum each thread knows the index of its first
+ * value and parses it straight into place.
+ *
+ * Compressed files are streamed from a decompression thread (see compress.h).
+ * Before a whole data file is parsed, the rest of such a stream is read into
+ * memory, overlapping with decompression, so that it can be split among
+ * threads as if it had been mapped.
+ *
+ * Binary data files (see dataset.h) are recognized by their magic string and
+ * copied as they are. Data sets are loaded into an arena (see arena.h).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "parse.h"
+#include "dataset.h"
+#include "threads.h"
+
+/** Initial buffer size for streams */
+#define STREAM_BUFSIZE  (1 << 20)
+
+/** Minimum amount of data given to each parser thread */
+#define MIN_CHUNK       (1 << 20)
+
+/** Values handed to a parse_fold() visitor at once */
+#define FOLD_BATCH      1024
+
+/** Size of the slow path's token buffer; longer tokens are copied to the heap */
+#define MAX_TOKEN       128
+
+static const float POW10F[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+static const double POW10D[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+#define IS_SPACE(c) ((c) == ' ' || (c) == '\n' || (c) == '\t' || (c) == '\r' || (c) == '\v' || (c) == '\f')
+#define IS_DIGIT(c) ((unsigned char) ((c) - '0') < 10)
+
+/**
+ * Convert a token to a number
+ * @param p Token start
+ * @param e Token end
+ * @param out Output value
+ * @return 0 on success, -1 if the token is not a number
+ */
+static int convert(const char *p, const char *e, fann_type *out)
+{
+    const char *s = p;
+    uint64_t m = 0;
+    int neg = 0, sig = 0, exp10 = 0, truncated = 0, anyDigits = 0;
+
+    if (s < e && (*s == '-' || *s == '+')) {
+        neg = (*s == '-');
+        s++;
+    }
+    for (; s < e && IS_DIGIT(*s); s++) {
+        anyDigits = 1;
+        if (m == 0 && *s == '0') continue;
+        if (sig < 19) {
+            m = m * 10 + (uint64_t) (*s - '0');
+            sig++;
+        } else {
+            truncated = 1;
+            exp10++;
+        }
+    }
+    if (s < e && *s == '.') {
+        for (s++; s < e && IS_DIGIT(*s); s++) {
+            anyDigits = 1;
+            if (m == 0 && *s == '0') {
+                exp10--;
+                continue;
+            }
+            if (sig < 19) {
+                m = m * 10 + (uint64_t) (*s - '0');
+                sig++;
+                exp10--;
+            } else {
+                truncated = 1;
+            }
+        }
+    }
+    if (!anyDigits) goto SLOW;
+    if (s < e && (*s == 'e' || *s == 'E')) {
+        int eneg = 0, ev = 0;
+        s++;
+        if (s < e && (*s == '-' || *s == '+')) {
+            eneg = (*s == '-');
+            s++;
+        }
+        if (s == e || !IS_DIGIT(*s)) goto SLOW;
+        for (; s < e && IS_DIGIT(*s); s++) {
+            if (ev < 100000) ev = ev * 10 + (*s - '0');
+        }
+        exp10 += eneg ? -ev : ev;
+    }
+    if (s != e || truncated) goto SLOW;
+
+    if (sizeof(fann_type) == sizeof(float)) {
+        if (m <= (1u << 24) && exp10 >= -10 && exp10 <= 10) {
+            float f = (float) m;
+            f = (exp10 < 0) ? f / POW10F[-exp10] : f * POW10F[exp10];
+            *out = (fann_type) (neg ? -f : f);
+            return 0;
+        }
+    } else if (m <= (UINT64_C(1) << 53) && exp10 >= -22 && exp10 <= 22) {
+        double d = (double) m;
+        d = (exp10 < 0) ? d / POW10D[-exp10] : d * POW10D[exp10];
+        *out = (fann_type) (neg ? -d : d);
+        return 0;
+    }
+
+SLOW:
+    do {
+        //Mapped data is not NUL terminated: strtod() needs a copy
+        char buf[MAX_TOKEN];
+        char *endp;
+        size_t len = (size_t) (e - p);
+        if (len == 0) return -1;
+        char *tok = (len < sizeof(buf)) ? buf : (char *) malloc(len + 1);
+        if (tok == NULL) return -1;
+        memcpy(tok, p, len);
+        tok[len] = '\0';
+        if (sizeof(fann_type) == sizeof(float)) {
+            *out = (fann_type) strtof(tok, &endp);
+        } else {
+            *out = (fann_type) strtod(tok, &endp);
+        }
+        int ok = (endp == tok + len);
+        if (tok != buf) free(tok);
+        if (!ok) return -1;
+    } while (0);
+    return 0;
+}
+
+/**
+ * Open a file. Regular files are mapped, compressed files are decompressed on
+ * a background thread and anything else is streamed.
+ * @param path File path
+ * @return Source, or NULL if the file could not be opened (error reported)
+ */
+struct parse_src *parse_open(const char *path)
+{
+    struct stat st;
+    struct parse_src *src;
+    unsigned char head[COMPRESS_MAGIC_SIZE];
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        fprintf(stderr, "%s: could not open file\n", path);
+        return NULL;
+    }
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        ssize_t n = pread(fd, head, sizeof(head), 0);
+        enum compress_format format = compress_detect(head, (n > 0) ? (size_t) n : 0);
+        if (format != COMPRESS_NONE) {
+            struct compress_reader *reader = compress_open(fd, format, NULL, 0, path);
+            if (reader == NULL) return NULL;
+            src = parse_open_stream(compress_stream(reader), path);
+            if (src == NULL) {
+                compress_close(reader);
+                return NULL;
+            }
+            src->reader = reader;
+            return src;
+        }
+
+        void *map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            close(fd);
+            madvise(map, (size_t) st.st_size, MADV_SEQUENTIAL);
+            src = (struct parse_src *) calloc(1, sizeof(struct parse_src));
+            if (src == NULL) {
+                munmap(map, (size_t) st.st_size);
+                return NULL;
+            }
+            src->name = path;
+            src->buf = (char *) map;
+            src->end = (size_t) st.st_size;
+            src->eof = 1;
+            src->mapped = 1;
+            src->line = 1;
+            return src;
+        }
+    }
+
+    FILE *fp = fdopen(fd, "r");
+    if (fp == NULL) {
+        close(fd);
+        return NULL;
+    }
+    src = parse_open_stream(fp, path);
+    if (src == NULL) fclose(fp);
+    return src;
+}
+
+/**
+ * Read from a stream. Closing the source also closes the stream unless it is STDIN.
+ * @param fp Stream
+ * @param name Name used in error messages
+ * @return Source, or NULL if out of memory
+ */
+struct parse_src *parse_open_stream(FILE *fp, const char *name)
+{
+    struct parse_src *src = (struct parse_src *) calloc(1, sizeof(struct parse_src));
+    if (src == NULL) return NULL;
+    src->buf = (char *) malloc(STREAM_BUFSIZE);
+    if (src->buf == NULL) {
+        free(src);
+        return NULL;
+    }
+    src->name = name;
+    src->fp = fp;
+    src->cap = STREAM_BUFSIZE;
+    src->line = 1;
+    return src;
+}
+
+/**
+ * Read from a live stream, such as a pipe or socket fed by a producer, so that
+ * values are available as soon as they arrive. The stream must not have been read
+ * through its FILE buffer. Closing the source also closes the stream unless it is STDIN.
+ * @param fp Stream
+ * @param name Name used in error messages
+ * @return Source, or NULL if out of memory
+ */
+struct parse_src *parse_open_live(FILE *fp, const char *name)
+{
+    struct parse_src *src = parse_open_stream(fp, name);
+    if (src != NULL) src->live = 1;
+    return src;
+}
+
+/**
+ * Close a source
+ * @param src Source
+ */
+void parse_close(struct parse_src *src)
+{
+    if (src == NULL) return;
+    if (src->mapped) {
+        munmap(src->buf, src->end);
+    } else {
+        free(src->buf);
+        if (src->reader != NULL) {
+            compress_close(src->reader);
+        } else if (src->fp != stdin) {
+            fclose(src->fp);
+        }
+    }
+    free(src);
+}
+
+/**
+ * Read more data into a stream buffer, keeping the unconsumed bytes
+ * @param src Source
+ * @return Number of bytes read, 0 at end of file, -1 on error
+ */
+static int src_fill(struct parse_src *src)
+{
+    if (src->eof) return 0;
+
+    if (src->pos > 0) {
+        memmove(src->buf, src->buf + src->pos, src->end - src->pos);
+        src->end -= src->pos;
+        src->offset += src->pos;
+        src->pos = 0;
+    }
+    if (src->end == src->cap) {
+        char *buf = (char *) realloc(src->buf, src->cap * 2);
+        if (buf == NULL) {
+            fprintf(stderr, "%s: out of memory\n", src->name);
+            return -1;
+        }
+        src->buf = buf;
+        src->cap *= 2;
+    }
+
+    size_t n;
+    if (src->live) {
+        ssize_t r;
+        do {
+            r = read(fileno(src->fp), src->buf + src->end, src->cap - src->end);
+        } while (r < 0 && errno == EINTR);
+        if (r < 0) {
+            fprintf(stderr, "%s: read error\n", src->name);
+            return -1;
+        }
+        n = (size_t) r;
+        if (n == 0) src->eof = 1;
+    } else {
+        n = fread(src->buf + src->end, 1, src->cap - src->end, src->fp);
+        if (n == 0) {
+            if (ferror(src->fp)) {
+                fprintf(stderr, "%s: read error\n", src->name);
+                return -1;
+            }
+            //A decompression error (reported) also ends the stream
+            if (src->reader != NULL && compress_finish(src->reader) != 0) return -1;
+            src->eof = 1;
+        }
+    }
+    src->end += n;
+    return (int) (n > 0);
+}
+
+/**
+ * Read the rest of a stream into its buffer
+ * @param src Source
+ * @return 0 on success, -1 on error (reported)
+ */
+static int src_slurp(struct parse_src *src)
+{
+    int r;
+    while ((r = src_fill(src)) > 0);
+    return r;
+}
+
+/**
+ * Get the next token
+ * @param src Source
+ * @param tok Output token start
+ * @param len Output token length
+ * @return 1 if a token was found, 0 at end of file, -1 on error
+ */
+static int next_token(struct parse_src *src, const char **tok, size_t *len)
+{
+    for (;;) {
+        const char *p = src->buf + src->pos, *end = src->buf + src->end;
+        while (p < end && IS_SPACE(*p)) {
+            if (*p == '\n') src->line++;
+            p++;
+        }
+        src->pos = (size_t) (p - src->buf);
+
+        const char *t = p;
+        while (t < end && !IS_SPACE(*t)) t++;
+
+        if (t == end && !src->eof) {
+            //The token may continue past the buffered data
+            int r = src_fill(src);
+            if (r < 0) return -1;
+            continue;
+        }
+        if (t == p) return 0;
+
+        *tok = p;
+        *len = (size_t) (t - p);
+        src->pos = (size_t) (t - src->buf);
+        return 1;
+    }
+}
+
+/**
+ * Parse the next value
+ * @param src Source
+ * @param value Output value
+ * @return 1 if a value was read, 0 at end of file, -1 on error (reported)
+ */
+int parse_next(struct parse_src *src, fann_type *value)
+{
+    const char *tok;
+    size_t len;
+    int r = next_token(src, &tok, &len);
+    if (r <= 0) return r;
+    if (convert(tok, tok + len, value) != 0) {
+        fprintf(stderr, "%s:%lu: invalid number '%.*s'\n", src->name, src->line, (int) (len > 40 ? 40 : len), tok);
+        return -1;
+    }
+    return 1;
+}
+
+/**
+ * Skip the rest of the current line, e.g. to resume after a malformed row
+ * @param src Source
+ * @return 1 if a line was skipped, 0 at end of file, -1 on error (reported)
+ */
+int parse_skip_line(struct parse_src *src)
+{
+    for (;;) {
+        const char *p = src->buf + src->pos, *end = src->buf + src->end;
+        const char *nl = (const char *) memchr(p, '\n', (size_t) (end - p));
+        if (nl != NULL) {
+            src->pos = (size_t) (nl + 1 - src->buf);
+            src->line++;
+            return 1;
+        }
+        src->pos = src->end;
+        if (src->eof) return 0;
+        int r = src_fill(src);
+        if (r < 0) return -1;
+        if (r == 0 && src->eof) return 0;
+    }
+}
+
+/**
+ * Parse a row of values
+ * @param src Source
+ * @param values Output values
+ * @param count Number of values in a row
+ * @return 1 if a row was read, 0 at end of file, -1 on error or incomplete row (reported)
+ */
+int parse_row(struct parse_src *src, fann_type *values, unsigned int count)
+{
+    unsigned int i;
+    for (i = 0; i < count; i++) {
+        int r = parse_next(src, &values[i]);
+        if (r < 0) return -1;
+        if (r == 0) {
+            if (i == 0) return 0;
+            fprintf(stderr, "%s:%lu: incomplete row: expected %u values but found %u\n", src->name, src->line, count, i);
+            return -1;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Parse an unsigned header field
+ * @param src Source
+ * @param what Field description for error messages
+ * @param value Output value
+ * @return 0 on success, -1 on error (reported)
+ */
+static int parse_header_field(struct parse_src *src, const char *what, unsigned int *value)
+{
+    const char *tok;
+    size_t len, i;
+    unsigned long v = 0;
+    int r = next_token(src, &tok, &len);
+
+    if (r < 0) return -1;
+    if (r == 0) {
+        fprintf(stderr, "%s:%lu: missing %s in header\n", src->name, src->line, what);
+        return -1;
+    }
+    for (i = 0; i < len && IS_DIGIT(tok[i]) && v <= 0xffffffffUL; i++) {
+        v = v * 10 + (unsigned long) (tok[i] - '0');
+    }
+    if (i != len || v == 0 || v > 0xffffffffUL) {
+        fprintf(stderr, "%s:%lu: invalid %s '%.*s' in header\n", src->name, src->line, what, (int) (len > 40 ? 40 : len), tok);
+        return -1;
+    }
+    *value = (unsigned int) v;
+    return 0;
+}
+
+/**
+ * Parse the header of a data file in FANN format
+ * @param src Source
+ * @param numData Output number of samples
+ * @param numInput Output number of inputs
+ * @param numOutput Output number of outputs
+ * @return 0 on success, -1 on error (reported)
+ */
+int parse_header(struct parse_src *src, unsigned int *numData, unsigned int *numInput, unsigned int *numOutput)
+{
+    if (parse_header_field(src, "number of samples", numData) != 0) return -1;
+    if (parse_header_field(src, "number of inputs", numInput) != 0) return -1;
+    if (parse_header_field(src, "number of outputs", numOutput) != 0) return -1;
+    return 0;
+}
+
+/** Chunk of a mapped data file handled by one thread */
+struct chunk {
+    const char *begin;          /**< Chunk start (always at whitespace) */
+    const char *end;            /**< Chunk end */
+    size_t tokens;              /**< Tokens in chunk */
+    unsigned long lines;        /**< Newlines in chunk */
+    size_t firstToken;          /**< Global index of the first token */
+    unsigned long firstLine;    /**< Line at chunk start */
+    int error;                  /**< Non-zero if parsing failed */
+    size_t errToken;            /**< Global index of the offending token */
+    unsigned long errLine;      /**< Line of the offending token */
+    const char *errTok;         /**< Offending token */
+    size_t errLen;
+};
+
+/** Shared state of a parallel parse */
+struct parallel_parse {
+    struct chunk *chunks;
+    struct fann_train_data *data;
+    size_t expected;            /**< Number of values expected */
+};
+
+/** First pass: count tokens and lines of a chunk */
+static void count_task(unsigned int index, void *arg)
+{
+    struct chunk *c = &((struct parallel_parse *) arg)->chunks[index];
+    const char *p;
+    int inToken = 0;
+
+    for (p = c->begin; p < c->end; p++) {
+        if (IS_SPACE(*p)) {
+            if (*p == '\n') c->lines++;
+            inToken = 0;
+        } else if (!inToken) {
+            c->tokens++;
+            inToken = 1;
+        }
+    }
+}
+
+/** Second pass: convert the tokens of a chunk and store them in place */
+static void convert_task(unsigned int index, void *arg)
+{
+    struct parallel_parse *pp = (struct parallel_parse *) arg;
+    struct chunk *c = &pp->chunks[index];
+    struct fann_train_data *data = pp->data;
+    unsigned int rowSize = data->num_input + data->num_output;
+    size_t t = c->firstToken;
+    unsigned long line = c->firstLine;
+    const char *p = c->begin;
+
+    unsigned int sample = (unsigned int) (t / rowSize);
+    unsigned int col = (unsigned int) (t % rowSize);
+
+    while (p < c->end) {
+        if (IS_SPACE(*p)) {
+            if (*p == '\n') line++;
+            p++;
+            continue;
+        }
+        const char *tok = p;
+        while (p < c->end && !IS_SPACE(*p)) p++;
+
+        fann_type *dst = (t >= pp->expected) ? NULL
+                       : (col < data->num_input) ? &data->input[sample][col] : &data->output[sample][col - data->num_input];
+        if (dst == NULL || convert(tok, p, dst) != 0) {
+            c->error = 1;
+            c->errToken = t;
+            c->errLine = line;
+            c->errTok = tok;
+            c->errLen = (size_t) (p - tok);
+            return;
+        }
+        t++;
+        if (++col == rowSize) {
+            col = 0;
+            sample++;
+        }
+    }
+}
+
+/**
+ * Split the body of a mapped data file into chunks, at whitespace so that no
+ * token straddles two chunks
+ * @param src Source, positioned right after the header
+ * @param nThreads Maximum number of chunks
+ * @param nChunks Output number of chunks
+ * @return Chunks (release with free()), or NULL if out of memory (reported)
+ */
+static struct chunk *split_body(struct parse_src *src, unsigned int nThreads, unsigned int *nChunks)
+{
+    const char *body = src->buf + src->pos, *end = src->buf + src->end;
+    size_t bodySize = (size_t) (end - body);
+    unsigned int i, n = (unsigned int) (bodySize / MIN_CHUNK) + 1;
+
+    if (n > nThreads) n = nThreads;
+    struct chunk *chunks = (struct chunk *) calloc(n, sizeof(struct chunk));
+    if (chunks == NULL) {
+        fprintf(stderr, "%s: out of memory\n", src->name);
+        return NULL;
+    }
+
+    const char *p = body;
+    for (i = 0; i < n; i++) {
+        const char *q = (i == n - 1) ? end : body + bodySize / n * (i + 1);
+        if (q < p) q = p;
+        while (q < end && !IS_SPACE(*q)) q++;
+        chunks[i].begin = p;
+        chunks[i].end = q;
+        p = q;
+    }
+    *nChunks = n;
+    return chunks;
+}
+
+/**
+ * Parse the body of a mapped data file with several threads
+ * @param src Source, positioned right after the header
+ * @param data Destination
+ * @param nThreads Maximum number of threads
+ * @return 0 on success, -1 on error (reported)
+ */
+static int parse_body_parallel(struct parse_src *src, struct fann_train_data *data, unsigned int nThreads)
+{
+    struct parallel_parse pp;
+    unsigned int i, nChunks;
+    unsigned int rowSize = data->num_input + data->num_output;
+    int ret = 0;
+
+    pp.chunks = split_body(src, nThreads, &nChunks);
+    if (pp.chunks == NULL) return -1;
+    pp.data = data;
+    pp.expected = (size_t) data->num_data * rowSize;
+
+    threads_run(nChunks, nChunks, count_task, &pp);
+
+    size_t tokens = 0;
+    unsigned long line = src->line;
+    for (i = 0; i < nChunks; i++) {
+        pp.chunks[i].firstToken = tokens;
+        pp.chunks[i].firstLine = line;
+        tokens += pp.chunks[i].tokens;
+        line += pp.chunks[i].lines;
+    }
+
+    if (tokens < pp.expected) {
+        fprintf(stderr, "%s:%lu: unexpected end of file: expected %u samples of %u values but found %zu values\n",
+                src->name, line, data->num_data, rowSize, tokens);
+        ret = -1;
+        goto EXIT;
+    }
+
+    threads_run(nChunks, nChunks, convert_task, &pp);
+
+    for (i = 0; i < nChunks; i++) {
+        struct chunk *c = &pp.chunks[i];
+        if (!c->error) continue;
+        if (c->errToken >= pp.expected) {
+            fprintf(stderr, "%s:%lu: unexpected data after the last of %u samples: '%.*s'\n",
+                    src->name, c->errLine, data->num_data, (int) (c->errLen > 40 ? 40 : c->errLen), c->errTok);
+        } else {
+            fprintf(stderr, "%s:%lu: sample %zu: invalid number '%.*s'\n",
+                    src->name, c->errLine, c->errToken / rowSize + 1, (int) (c->errLen > 40 ? 40 : c->errLen), c->errTok);
+        }
+        ret = -1;
+        break;
+    }
+
+    src->pos = src->end;
+    src->line = line;
+
+EXIT:
+    free(pp.chunks);
+    return ret;
+}
+
+/** Shared state of a parallel fold */
+struct parallel_fold {
+    struct chunk *chunks;
+    parse_visitor visit;
+    void *arg;
+};
+
+/** Parse the tokens of a chunk, counting them and its lines, and hand them to the visitor */
+static void fold_task(unsigned int index, void *arg)
+{
+    struct parallel_fold *pf = (struct parallel_fold *) arg;
+    struct chunk *c = &pf->chunks[index];
+    fann_type batch[FOLD_BATCH];
+    size_t n = 0;
+    const char *p = c->begin;
+
+    while (p < c->end) {
+        if (IS_SPACE(*p)) {
+            if (*p == '\n') c->lines++;
+            p++;
+            continue;
+        }
+        const char *tok = p;
+        while (p < c->end && !IS_SPACE(*p)) p++;
+
+        if (convert(tok, p, &batch[n]) != 0) {
+            c->error = 1;
+            c->errToken = c->tokens;
+            c->errLine = c->lines;
+            c->errTok = tok;
+            c->errLen = (size_t) (p - tok);
+            break;
+        }
+        c->tokens++;
+        if (++n == FOLD_BATCH) {
+            pf->visit(index, c->tokens - n, batch, n, pf->arg);
+            n = 0;
+        }
+    }
+    if (n > 0) pf->visit(index, c->tokens - n, batch, n, pf->arg);
+}
+
+/**
+ * Parse the body of a data file, handing the values to a visitor instead of
+ * storing them.
+ * Mapped files are split into chunks parsed by several threads in a single
+ * pass. Each thread hands the values of its chunk to the visitor along with
+ * their position in the chunk; the position of the first value of each chunk
+ * in the file is only known at the end, so visitors must keep their results
+ * per chunk. Other sources are parsed as a single chunk.
+ * @param src Source, positioned right after the header
+ * @param numData Number of samples
+ * @param width Values per sample
+ * @param nThreads Maximum number of threads (0: one per processor)
+ * @param visit Visitor, called concurrently for different chunks
+ * @param arg Visitor argument
+ * @param firstValues Output index in the file of the first value of each chunk.
+ *                    Must have room for as many chunks as threads
+ * @return Number of chunks, or -1 on error (reported)
+ */
+int parse_fold(struct parse_src *src, unsigned int numData, unsigned int width, unsigned int nThreads,
+        parse_visitor visit, void *arg, size_t *firstValues)
+{
+    size_t expected = (size_t) numData * width;
+    unsigned int i, nChunks;
+
+    if (nThreads == 0) nThreads = threads_available();
+    if (!src->mapped || nThreads <= 1 || src->end - src->pos <= MIN_CHUNK) {
+        fann_type batch[FOLD_BATCH];
+        size_t done = 0;
+        while (done < expected) {
+            size_t n = expected - done;
+            if (n > FOLD_BATCH) n = FOLD_BATCH;
+            for (i = 0; i < n; i++) {
+                int r = parse_next(src, &batch[i]);
+                if (r < 0) return -1;
+                if (r == 0) {
+                    fprintf(stderr, "%s:%lu: unexpected end of file: expected %u samples of %u values but found %zu values\n",
+                            src->name, src->line, numData, width, done + i);
+                    return -1;
+                }
+            }
+            visit(0, done, batch, n, arg);
+            done += n;
+        }
+        int r = parse_next(src, &batch[0]);
+        if (r > 0) fprintf(stderr, "%s:%lu: unexpected data after the last of %u samples\n", src->name, src->line, numData);
+        if (r != 0) return -1;
+        firstValues[0] = 0;
+        return 1;
+    }
+
+    struct parallel_fold pf;
+    pf.chunks = split_body(src, nThreads, &nChunks);
+    if (pf.chunks == NULL) return -1;
+    pf.visit = visit;
+    pf.arg = arg;
+
+    threads_run(nChunks, nChunks, fold_task, &pf);
+
+    size_t tokens = 0;
+    unsigned long line = src->line;
+    int ret = (int) nChunks;
+    for (i = 0; i < nChunks; i++) {
+        struct chunk *c = &pf.chunks[i];
+        firstValues[i] = tokens;
+        if (c->error && ret > 0) {
+            size_t t = tokens + c->errToken;
+            if (t >= expected) {
+                fprintf(stderr, "%s:%lu: unexpected data after the last of %u samples: '%.*s'\n",
+                        src->name, line + c->errLine, numData, (int) (c->errLen > 40 ? 40 : c->errLen), c->errTok);
+            } else {
+                fprintf(stderr, "%s:%lu: sample %zu: invalid number '%.*s'\n",
+                        src->name, line + c->errLine, t / width + 1, (int) (c->errLen > 40 ? 40 : c->errLen), c->errTok);
+            }
+            ret = -1;
+        }
+        tokens += c->tokens;
+        line += c->lines;
+    }
+    if (ret > 0 && tokens < expected) {
+        fprintf(stderr, "%s:%lu: unexpected end of file: expected %u samples of %u values but found %zu values\n",
+                src->name, line, numData, width, tokens);
+        ret = -1;
+    } else if (ret > 0 && tokens > expected) {
+        fprintf(stderr, "%s: unexpected data after the last of %u samples\n", src->name, numData);
+        ret = -1;
+    }
+
+    src->pos = src->end;
+    src->line = line;
+    free(pf.chunks);
+    return ret;
+}
+
+/**
+ * Check whether a source is a binary data file (see dataset.h) and read its header.
+ * The source must be mapped, or a stream read to the end with nothing consumed yet
+ * @param src Source
+ * @param numData Output number of samples
+ * @param numInput Output number of inputs
+ * @param numOutput Output number of outputs
+ * @return 1 if it is, in which case values start right after the header,
+ *         0 if it is not, -1 if it is but the header is invalid (reported)
+ */
+int parse_binary_header(struct parse_src *src, unsigned int *numData, unsigned int *numInput, unsigned int *numOutput)
+{
+    struct dataset_binary_header header;
+    if (!src->eof || src->offset != 0 || src->pos != 0 || src->end < sizeof(header)) return 0;
+    memcpy(&header, src->buf, sizeof(header));
+    if (memcmp(header.magic, DATASET_BINARY_MAGIC, sizeof(header.magic)) != 0) return 0;
+
+    if (header.typeSize != sizeof(fann_type) || header.numInput == 0 || header.numOutput == 0) {
+        fprintf(stderr, "%s: invalid header or %u-byte values, this build uses %u-byte values\n", src->name, header.typeSize, (unsigned int) sizeof(fann_type));
+        return -1;
+    }
+    if (src->end != sizeof(header) + sizeof(fann_type) * ((size_t) header.numInput + header.numOutput) * header.numData) {
+        fprintf(stderr, "%s: size does not match the %u samples of the header\n", src->name, header.numData);
+        return -1;
+    }
+    *numData = header.numData;
+    *numInput = header.numInput;
+    *numOutput = header.numOutput;
+    return 1;
+}
+
+/**
+ * Load a binary data file
+ * @param src Source, checked with parse_binary_header()
+ * @param numData Number of samples
+ * @param numInput Number of inputs
+ * @param numOutput Number of outputs
+ * @return Data (release with arena_destroy()), or NULL on error (reported)
+ */
+static struct arena_data *parse_train_binary(struct parse_src *src, unsigned int numData, unsigned int numInput, unsigned int numOutput)
+{
+    struct arena_data *arena = arena_create(numData, numInput, numOutput);
+    if (arena == NULL) {
+        fprintf(stderr, "%s: could not allocate %u samples\n", src->name, numData);
+        return NULL;
+    }
+    const fann_type *values = (const fann_type *) (src->buf + sizeof(struct dataset_binary_header));
+    for (unsigned int i = 0; i < numData; i++, values += numInput + numOutput) {
+        memcpy(arena->inputs + (size_t) i * numInput, values, sizeof(fann_type) * numInput);
+        memcpy(arena->outputs + (size_t) i * numOutput, values + numInput, sizeof(fann_type) * numOutput);
+    }
+    return arena;
+}
+
+/**
+ * Parse a data file in FANN format: a header with the number of samples,
+ * inputs and outputs, followed by the input and output values of each sample.
+ * @param src Source
+ * @param nThreads Maximum number of threads (0: one per processor). Only mapped and compressed files are parsed in parallel
+ * @return Data (release with arena_destroy()), or NULL on error (reported)
+ */
+struct arena_data *parse_train(struct parse_src *src, unsigned int nThreads)
+{
+    unsigned int numData, numInput, numOutput, i, j;
+    struct arena_data *arena;
+
+    if (parse_header(src, &numData, &numInput, &numOutput) != 0) return NULL;
+
+    arena = arena_create(numData, numInput, numOutput);
+    if (arena == NULL) {
+        fprintf(stderr, "%s: could not allocate %u samples\n", src->name, numData);
+        return NULL;
+    }
+
+    if (nThreads == 0) nThreads = threads_available();
+    if (src->reader != NULL && nThreads > 1 && src_slurp(src) != 0) goto ERR;
+    if (src->eof && nThreads > 1 && src->end - src->pos > MIN_CHUNK) {
+        if (parse_body_parallel(src, &arena->data, nThreads) != 0) goto ERR;
+        return arena;
+    }
+
+    for (i = 0; i < numData; i++) {
+        for (j = 0; j < numInput + numOutput; j++) {
+            fann_type *dst = (j < numInput) ? &arena->inputs[(size_t) i * numInput + j] : &arena->outputs[(size_t) i * numOutput + j - numInput];
+            const char *tok;
+            size_t len;
+            int r = next_token(src, &tok, &len);
+            if (r < 0) goto ERR;
+            if (r == 0) {
+                fprintf(stderr, "%s:%lu: unexpected end of file: sample %u of %u has %u of %u values\n",
+                        src->name, src->line, i + 1, numData, j, numInput + numOutput);
+                goto ERR;
+            }
+            if (convert(tok, tok + len, dst) != 0) {
+                fprintf(stderr, "%s:%lu: sample %u: invalid number '%.*s'\n", src->name, src->line, i + 1, (int) (len > 40 ? 40 : len), tok);
+                goto ERR;
+            }
+        }
+    }
+
+    do {
+        const char *tok;
+        size_t len;
+        int r = next_token(src, &tok, &len);
+        if (r < 0) goto ERR;
+        if (r > 0) {
+            fprintf(stderr, "%s:%lu: unexpected data after the last of %u samples: '%.*s'\n",
+                    src->name, src->line, numData, (int) (len > 40 ? 40 : len), tok);
+            goto ERR;
+        }
+    } while (0);
+
+    return arena;
+
+ERR:
+    arena_destroy(arena);
+    return NULL;
+}
+
+/**
+ * Parse a data file in FANN format, or load a binary data file
+ * @param path File path
+ * @param nThreads Maximum number of threads (0: one per processor)
+ * @return Data (release with arena_destroy()), or NULL on error (reported)
+ */
+struct arena_data *parse_train_file(const char *path, unsigned int nThreads)
+{
+    struct parse_src *src = parse_open(path);
+    if (src == NULL) return NULL;
+    unsigned int numData, numInput, numOutput;
+    struct arena_data *data = NULL;
+    if (src->reader != NULL && src_slurp(src) != 0) {
+        parse_close(src);
+        return NULL;
+    }
+    int binary = parse_binary_header(src, &numData, &numInput, &numOutput);
+    if (binary > 0) {
+        data = parse_train_binary(src, numData, numInput, numOutput);
+    } else if (binary == 0) {
+        data = parse_train(src, nThreads);
+    }
+    parse_close(src);
+    return data;
+}
@@ -0,0 +1,79 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef PARSE_H
+#define	PARSE_H
+
+#include <stdio.h>
+#include <fann.h>
+#include "arena.h"
+#include "compress.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/**
+ * Numeric text source.
+ * Regular files are mapped as a whole; compressed files (see compress.h) and
+ * other streams are read through a growing buffer. Errors are reported to STDERR as NAME:LINE: MESSAGE.
+ */
+struct parse_src {
+    const char *name;       /**< Name used in error messages */
+    FILE *fp;               /**< Stream, or NULL for mapped files */
+    char *buf;              /**< Data */
+    size_t cap;             /**< Buffer capacity (streams only) */
+    size_t pos;             /**< Current position in buf */
+    size_t offset;          /**< Bytes of the source consumed before buf (streams only), so that offset+pos is the position in the source */
+    size_t end;             /**< End of valid data in buf */
+    int eof;                /**< Non-zero once all data is in buf */
+    int mapped;             /**< Non-zero if buf is a file mapping */
+    int live;               /**< Non-zero to hand out data as soon as it arrives instead of filling the buffer */
+    struct compress_reader *reader; /**< Decompression thread feeding fp, or NULL */
+    unsigned long line;     /**< Current line (1-based) */
+};
+
+/**
+ * Visitor of parse_fold(): receives consecutive values of a chunk
+ * @param chunk Chunk index
+ * @param offset Position of the first value in the chunk
+ * @param values Values
+ * @param count Number of values
+ * @param arg Visitor argument
+ */
+typedef void (*parse_visitor)(unsigned int chunk, size_t offset, const fann_type *values, size_t count, void *arg);
+
+struct parse_src *parse_open(const char *path);
+struct parse_src *parse_open_stream(FILE *fp, const char *name);
+struct parse_src *parse_open_live(FILE *fp, const char *name);
+void parse_close(struct parse_src *src);
+int parse_next(struct parse_src *src, fann_type *value);
+int parse_row(struct parse_src *src, fann_type *values, unsigned int count);
+int parse_skip_line(struct parse_src *src);
+int parse_header(struct parse_src *src, unsigned int *numData, unsigned int *numInput, unsigned int *numOutput);
+int parse_binary_header(struct parse_src *src, unsigned int *numData, unsigned int *numInput, unsigned int *numOutput);
+int parse_fold(struct parse_src *src, unsigned int numData, unsigned int width, unsigned int nThreads,
+        parse_visitor visit, void *arg, size_t *firstValues);
+struct arena_data *parse_train(struct parse_src *src, unsigned int nThreads);
+struct arena_data *parse_train_file(const char *path, unsigned int nThreads);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* PARSE_H */
+
@@ -0,0 +1,379 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+/*
+ * Pipelined inference over a stream of rows.
+ *
+ * Three stages run at once: a thread parses input rows into batches, the
+ * calling thread runs the network over them (sharing each batch among the
+ * runner's threads) and a thread formats and writes their outputs. A fixed
+ * set of batches circulates through three single-producer single-consumer
+ * rings: free batches go to the parser, parsed ones to the compute stage,
+ * computed ones to the writer, which gives them back to the parser. The
+ * throughput is thus bounded by the slowest stage instead of the sum of all.
+ *
+ * Every ring has room for all the batches and the end mark, so pushing never
+ * waits and needs no lock: the producer fills a slot and then publishes it by
+ * moving the tail. A consumer finding its ring empty spins for a while and
+ * then sleeps on a condition variable; producers only take the lock when they
+ * see it sleeping, so the lock stays off the path of a busy pipeline.
+ *
+ * Outputs are formatted as printf("%f") does, which is where most of the
+ * output time used to go. A float scaled by 10^6 is exact in a double, so for
+ * values of moderate size rounding it to an integer gives the same digits
+ * as printf, in the same rounding mode. Other values go through snprintf().
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pipeline.h"
+
+/** Slots of a ring: a power of two above PIPELINE_BATCHES, leaving room for the end mark */
+#define RING_SLOTS  16
+
+/** Times a consumer checks an empty ring before going to sleep */
+#define RING_SPINS  1000
+
+/** Bytes of output handed to stdio at once */
+#define WRITE_CHUNK (64 * 1024)
+
+/** Values up to this magnitude are formatted without snprintf(): scaled by 10^6 they fit in a uint64_t */
+#define FAST_LIMIT  1e12
+
+#if defined(__i386__) || defined(__x86_64__)
+#define RING_PAUSE() __builtin_ia32_pause()
+#else
+#define RING_PAUSE() do { } while (0)
+#endif
+
+/** Rows handed between stages */
+struct pipeline_batch {
+    unsigned int rows;          /**< Number of rows */
+    fann_type *inputs;          /**< Input values, rows x numInput */
+    fann_type *outputs;         /**< Output values, rows x numOutput */
+    uint64_t *requested;        /**< Time each row started being parsed (with metrics only) */
+};
+
+/** Single-producer single-consumer ring of batches. A NULL batch marks the end of the stream */
+struct ring {
+    struct pipeline_batch *slots[RING_SLOTS];
+    unsigned int tail __attribute__((aligned(64)));     /**< Slots pushed so far, written by the producer */
+    unsigned int head __attribute__((aligned(64)));     /**< Slots popped so far, owned by the consumer */
+    int sleeping;                                       /**< Non-zero while the consumer sleeps */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+};
+
+/** Shared state of a pipeline */
+struct pipeline {
+    const struct pipeline_config *config;
+    struct parse_src *src;
+    FILE *out;
+    struct metrics *m;
+    unsigned int capacity;      /**< Rows per batch */
+    struct ring free;           /**< Writer to parser */
+    struct ring parsed;         /**< Parser to compute stage */
+    struct ring computed;       /**< Compute stage to writer */
+    char *text;                 /**< Writer's formatting buffer */
+    size_t textSize;            /**< Size of text */
+    int parseError;             /**< Non-zero if the input could not be parsed */
+    int writeError;             /**< Non-zero once the output could not be written. Stops the parser */
+    unsigned long rows;         /**< Rows written */
+};
+
+static void ring_init(struct ring *r)
+{
+    memset(r, 0, sizeof(*r));
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->wake, NULL);
+}
+
+static void ring_destroy(struct ring *r)
+{
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->wake);
+}
+
+/**
+ * Publish a batch. Never waits: the ring has room for every batch
+ * @param r Ring
+ * @param batch Batch, or NULL to mark the end of the stream
+ */
+static void ring_push(struct ring *r, struct pipeline_batch *batch)
+{
+    unsigned int tail = r->tail;
+    r->slots[tail % RING_SLOTS] = batch;
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_SEQ_CST);
+    //Pairs with the consumer setting sleeping before checking the tail once more
+    if (__atomic_load_n(&r->sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&r->lock);
+        pthread_cond_signal(&r->wake);
+        pthread_mutex_unlock(&r->lock);
+    }
+}
+
+/**
+ * Take the next batch, waiting for it
+ * @param r Ring
+ * @return Batch, or NULL at the end of the stream
+ */
+static struct pipeline_batch *ring_pop(struct ring *r)
+{
+    unsigned int head = r->head, i;
+
+    for (i = 0; __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == head; i++) {
+        if (i < RING_SPINS) {
+            RING_PAUSE();
+            continue;
+        }
+        pthread_mutex_lock(&r->lock);
+        __atomic_store_n(&r->sleeping, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&r->tail, __ATOMIC_SEQ_CST) == head) pthread_cond_wait(&r->wake, &r->lock);
+        __atomic_store_n(&r->sleeping, 0, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&r->lock);
+        break;
+    }
+    r->head = head + 1;
+    return r->slots[head % RING_SLOTS];
+}
+
+/**
+ * Format a value as printf("%f") does
+ * @param buf Destination, with room for PIPELINE_VALUE_CHARS characters
+ * @param value Value
+ * @return Number of characters written
+ */
+static size_t format_value(char *buf, fann_type value)
+{
+    double d = (double) value;
+    char digits[20];
+    char *p = buf;
+    int n = 0, i;
+
+    //The product below is only exact for floats. NaN fails the comparison too
+    if (sizeof(fann_type) != sizeof(float) || !(fabs(d) < FAST_LIMIT)) {
+        return (size_t) snprintf(buf, PIPELINE_VALUE_CHARS, "%f", d);
+    }
+
+    uint64_t q = (uint64_t) fabs(nearbyint(d * 1e6));
+    uint64_t integer = q / 1000000;
+    unsigned int fraction = (unsigned int) (q % 1000000);
+
+    if (signbit(d)) *p++ = '-';
+    do {
+        digits[n++] = (char) ('0' + integer % 10);
+        integer /= 10;
+    } while (integer > 0);
+    while (n > 0) *p++ = digits[--n];
+    *p++ = '.';
+    for (i = 5; i >= 0; i--) {
+        p[i] = (char) ('0' + fraction % 10);
+        fraction /= 10;
+    }
+    return (size_t) (p + 6 - buf);
+}
+
+/**
+ * Format a row of values as printf("%f") does, separated by spaces and
+ * followed by a newline. The text is not NUL terminated
+ * @param buf Destination, with room for PIPELINE_VALUE_CHARS characters per value
+ * @param values Values
+ * @param count Number of values
+ * @return Number of characters written
+ */
+size_t pipeline_format(char *buf, const fann_type *values, unsigned int count)
+{
+    size_t len = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        if (i > 0) buf[len++] = ' ';
+        len += format_value(buf + len, values[i]);
+    }
+    buf[len++] = '\n';
+    return len;
+}
+
+/** Parser stage: fill free batches with input rows until the input ends, fails or the writer fails */
+static void *parse_stage(void *arg)
+{
+    struct pipeline *p = (struct pipeline *) arg;
+    unsigned int numInput = p->config->numInput;
+    int r = 1;
+
+    while (r > 0 && !__atomic_load_n(&p->writeError, __ATOMIC_RELAXED)) {
+        struct pipeline_batch *batch = ring_pop(&p->free);
+        uint64_t t = (p->m != NULL) ? metrics_now() : 0;
+        unsigned int n;
+        for (n = 0; n < p->capacity; n++) {
+            if (p->m != NULL) batch->requested[n] = t;
+            r = parse_row(p->src, batch->inputs + (size_t) numInput * n, numInput);
+            t = metrics_lap(p->m, METRICS_PARSE, t);
+            if (r <= 0) break;
+        }
+        batch->rows = n;
+        if (n > 0) ring_push(&p->parsed, batch);
+    }
+    if (r < 0) p->parseError = 1;
+    ring_push(&p->parsed, NULL);
+    return NULL;
+}
+
+/** Compute stage: run the network over parsed batches */
+static void compute_stage(struct pipeline *p)
+{
+    const struct pipeline_config *c = p->config;
+    struct pipeline_batch *batch;
+    unsigned int k, n;
+
+    while ((batch = ring_pop(&p->parsed)) != NULL) {
+        uint64_t t = (p->m != NULL) ? metrics_now() : 0;
+        if (c->ann != NULL) {
+            for (k = 0; k < batch->rows; k++) {
+                fann_type *input = batch->inputs + (size_t) c->numInput * k;
+                if (c->ann->scale_mean_in != NULL) fann_scale_input(c->ann, input);
+                fann_type *output = fann_run(c->ann, input);
+                if (c->ann->scale_mean_out != NULL) fann_descale_output(c->ann, output);
+                memcpy(batch->outputs + (size_t) c->numOutput * k, output, sizeof(fann_type) * c->numOutput);
+            }
+        } else {
+            for (k = 0; k < batch->rows; k += n) {
+                n = (batch->rows - k < c->batchSize) ? batch->rows - k : c->batchSize;
+                batch_run(c->runner, batch->inputs + (size_t) c->numInput * k, n, batch->outputs + (size_t) c->numOutput * k);
+            }
+        }
+        metrics_lap(p->m, METRICS_COMPUTE, t);
+        ring_push(&p->computed, batch);
+    }
+    ring_push(&p->computed, NULL);
+}
+
+/** Hand formatted text to the output stream, reporting the first failure */
+static void write_text(struct pipeline *p, size_t len)
+{
+    if (p->writeError || fwrite(p->text, 1, len, p->out) == len) return;
+    fprintf(stderr, "Could not write output: %s\n", strerror(errno));
+    __atomic_store_n(&p->writeError, 1, __ATOMIC_RELAXED);
+}
+
+/** Writer stage: format and write the outputs of computed batches, then recycle them */
+static void *write_stage(void *arg)
+{
+    struct pipeline *p = (struct pipeline *) arg;
+    unsigned int numOutput = p->config->numOutput;
+    size_t rowChars = (size_t) PIPELINE_VALUE_CHARS * numOutput;
+    struct pipeline_batch *batch;
+    unsigned int k;
+
+    while ((batch = ring_pop(&p->computed)) != NULL) {
+        uint64_t t = (p->m != NULL) ? metrics_now() : 0;
+        size_t len = 0;
+        for (k = 0; k < batch->rows && !p->writeError; k++) {
+            if (len + rowChars > p->textSize) {
+                write_text(p, len);
+                len = 0;
+            }
+            len += pipeline_format(p->text + len, batch->outputs + (size_t) numOutput * k, numOutput);
+        }
+        if (len > 0) write_text(p, len);
+        t = metrics_lap(p->m, METRICS_OUTPUT, t);
+        if (!p->writeError) {
+            //The latency of a row runs from its parsing to its output
+            for (k = 0; p->m != NULL && k < batch->rows; k++) {
+                metrics_record(&p->m->latency, t - batch->requested[k]);
+            }
+            p->rows += batch->rows;
+        }
+        ring_push(&p->free, batch);
+    }
+    return NULL;
+}
+
+/**
+ * Run a network over every row of a source and write a line of outputs for
+ * each, parsing, computing and writing at once. Outputs are written in the
+ * order of the rows. With metrics, the time of each phase is accounted by the
+ * thread running it, so phases overlap
+ * @param config Network and batch size
+ * @param src Input rows
+ * @param out Output stream
+ * @param m Metrics, or NULL
+ * @param rows Output number of rows written
+ * @return 0 on success, -1 on error (reported)
+ */
+int pipeline_run(const struct pipeline_config *config, struct parse_src *src, FILE *out, struct metrics *m, unsigned long *rows)
+{
+    struct pipeline p;
+    struct pipeline_batch batches[PIPELINE_BATCHES];
+    pthread_t parser, writer;
+    unsigned int i, width = config->numInput + config->numOutput;
+    int ret = -1;
+
+    memset(&p, 0, sizeof(p));
+    p.config = config;
+    p.src = src;
+    p.out = out;
+    p.m = m;
+    //Batches of the runner must not straddle two batches of the pipeline
+    p.capacity = (config->ann != NULL) ? PIPELINE_ROWS
+               : (config->batchSize >= PIPELINE_ROWS) ? config->batchSize : PIPELINE_ROWS / config->batchSize * config->batchSize;
+    p.textSize = (size_t) PIPELINE_VALUE_CHARS * config->numOutput + WRITE_CHUNK;
+    p.text = (char *) malloc(p.textSize);
+    fann_type *values = (fann_type *) malloc(sizeof(fann_type) * width * p.capacity * PIPELINE_BATCHES);
+    uint64_t *requested = (uint64_t *) malloc(sizeof(uint64_t) * p.capacity * PIPELINE_BATCHES);
+    *rows = 0;
+    if (p.text == NULL || values == NULL || requested == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        goto EXIT;
+    }
+
+    ring_init(&p.free);
+    ring_init(&p.parsed);
+    ring_init(&p.computed);
+    for (i = 0; i < PIPELINE_BATCHES; i++) {
+        batches[i].inputs = values + (size_t) width * p.capacity * i;
+        batches[i].outputs = batches[i].inputs + (size_t) config->numInput * p.capacity;
+        batches[i].requested = requested + (size_t) p.capacity * i;
+        ring_push(&p.free, &batches[i]);
+    }
+
+    if (pthread_create(&writer, NULL, write_stage, &p) != 0) {
+        fprintf(stderr, "Could not start the writer thread\n");
+    } else if (pthread_create(&parser, NULL, parse_stage, &p) != 0) {
+        fprintf(stderr, "Could not start the parser thread\n");
+        ring_push(&p.computed, NULL);
+        pthread_join(writer, NULL);
+    } else {
+        compute_stage(&p);
+        pthread_join(parser, NULL);
+        pthread_join(writer, NULL);
+        *rows = p.rows;
+        ret = (p.parseError || p.writeError) ? -1 : 0;
+    }
+
+    ring_destroy(&p.free);
+    ring_destroy(&p.parsed);
+    ring_destroy(&p.computed);
+
+EXIT:
+    free(p.text);
+    free(values);
+    free(requested);
+    return ret;
+}
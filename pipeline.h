@@ -0,0 +1,56 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef PIPELINE_H
+#define	PIPELINE_H
+
+#include <stdio.h>
+#include <fann.h>
+#include "batch.h"
+#include "metrics.h"
+#include "parse.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/** Minimum number of rows handed from one stage to the next at once */
+#define PIPELINE_ROWS       256
+
+/** Number of batches of rows in flight between the stages */
+#define PIPELINE_BATCHES    8
+
+/** Longest text written by pipeline_format() for a value, separator included */
+#define PIPELINE_VALUE_CHARS 320
+
+/** How a pipeline runs its network */
+struct pipeline_config {
+    struct fann *ann;               /**< Network run by FANN, one row at a time, or NULL */
+    struct batch_runner *runner;    /**< Runner of a network image, used if ann is NULL */
+    unsigned int numInput;          /**< Number of inputs */
+    unsigned int numOutput;         /**< Number of outputs */
+    unsigned int batchSize;         /**< Rows run at once by the runner */
+};
+
+int pipeline_run(const struct pipeline_config *config, struct parse_src *src, FILE *out, struct metrics *m, unsigned long *rows);
+size_t pipeline_format(char *buf, const fann_type *values, unsigned int count);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* PIPELINE_H */
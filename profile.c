@@ -0,0 +1,153 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+/*
+ * Per layer profiler.
+ *
+ * Samples are pushed through the network a block at a time, one layer after
+ * another, so that clocks are read once per layer and block rather than once
+ * per neuron. Within a layer the weighted sums of the whole block are computed
+ * first, then every run of consecutive neurons sharing an activation function
+ * is activated for the whole block and timed on its own.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "profile.h"
+
+/** Samples pushed through the network at once */
+#define PROFILE_BLOCK 256
+
+#define IS_BIAS(neuron) ((neuron).firstCon == (neuron).lastCon)
+
+/** Monotonic time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Profile an image
+ * @param img Image
+ * @param inputs Input rows (rows x numInput)
+ * @param rows Number of rows
+ * @param repeat Number of times the rows are run
+ * @param mode Activation mode
+ * @param prof Output measurements. Release with profile_free()
+ * @return 0 on success, -1 if out of memory
+ */
+int profile_run(const struct net_image *img, const fann_type *inputs, unsigned int rows, unsigned int repeat, enum net_activation_mode mode, struct profile *prof)
+{
+    const uint32_t *layerStart = NET_LAYERS(img);
+    const struct net_neuron *neurons = NET_NEURONS(img);
+    uint32_t layer, n;
+    unsigned int r, row, b;
+
+    memset(prof, 0, sizeof(*prof));
+    prof->numLayers = img->numLayers;
+    prof->layers = (struct profile_layer *) calloc(img->numLayers, sizeof(struct profile_layer));
+    fann_type *values = (fann_type *) malloc(sizeof(fann_type) * img->totalNeurons * PROFILE_BLOCK);
+    if (prof->layers == NULL || values == NULL) {
+        free(values);
+        profile_free(prof);
+        return -1;
+    }
+
+    //Static description of every layer
+    for (layer = 0; layer < img->numLayers; layer++) {
+        struct profile_layer *pl = &prof->layers[layer];
+        for (n = layerStart[layer]; n < layerStart[layer + 1]; n++) {
+            if (layer > 0 && IS_BIAS(neurons[n])) {
+                pl->bias++;
+            } else {
+                pl->neurons++;
+                pl->connections += neurons[n].lastCon - neurons[n].firstCon;
+                if (layer > 0 && neurons[n].activationFunction < NET_NUM_ACTIVATIONS) {
+                    prof->activationCount[neurons[n].activationFunction]++;
+                }
+            }
+        }
+        if (layer == 0) {
+            pl->neurons = img->numInput;
+            pl->bias = layerStart[1] - img->numInput;
+        }
+    }
+
+    for (r = 0; r < repeat; r++) {
+        for (row = 0; row < rows; row += PROFILE_BLOCK) {
+            unsigned int blockRows = (rows - row < PROFILE_BLOCK) ? rows - row : PROFILE_BLOCK;
+            double t0 = now(), t1;
+
+            for (b = 0; b < blockRows; b++) {
+                fann_type *v = values + (size_t) b * img->totalNeurons;
+                memcpy(v, inputs + (size_t) (row + b) * img->numInput, sizeof(fann_type) * img->numInput);
+                for (n = img->numInput; n < layerStart[1]; n++) v[n] = 1;
+            }
+            t1 = now();
+            prof->layers[0].seconds += t1 - t0;
+
+            for (layer = 1; layer < img->numLayers; layer++) {
+                uint32_t first = layerStart[layer], last = layerStart[layer + 1];
+
+                t0 = now();
+                for (b = 0; b < blockRows; b++) {
+                    net_sums(img, first, last, values + (size_t) b * img->totalNeurons);
+                }
+
+                //Activate runs of neurons sharing the same function. Bias neurons join any run
+                for (n = first; n < last; ) {
+                    while (n < last && IS_BIAS(neurons[n])) n++;
+                    if (n == last) break;
+                    uint32_t end = n + 1;
+                    uint32_t af = neurons[n].activationFunction;
+                    while (end < last && (neurons[end].activationFunction == af || IS_BIAS(neurons[end]))) end++;
+
+                    double ta = now();
+                    for (b = 0; b < blockRows; b++) {
+                        net_activate(img, n, end, values + (size_t) b * img->totalNeurons, mode);
+                    }
+                    if (af < NET_NUM_ACTIVATIONS) prof->activationSeconds[af] += now() - ta;
+                    n = end;
+                }
+
+                t1 = now();
+                prof->layers[layer].seconds += t1 - t0;
+            }
+        }
+    }
+
+    prof->samples = (unsigned long) rows * repeat;
+    for (layer = 0; layer < img->numLayers; layer++) {
+        prof->totalSeconds += prof->layers[layer].seconds;
+    }
+
+    free(values);
+    return 0;
+}
+
+/**
+ * Release profiler measurements
+ * @param prof Measurements
+ */
+void profile_free(struct profile *prof)
+{
+    free(prof->layers);
+    prof->layers = NULL;
+}
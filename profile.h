@@ -0,0 +1,54 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef PROFILE_H
+#define	PROFILE_H
+
+#include <stdint.h>
+#include "net.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/** Measurements of a profiled layer */
+struct profile_layer {
+    uint32_t neurons;           /**< Neurons, excluding bias */
+    uint32_t bias;              /**< Bias neurons */
+    uint64_t connections;       /**< Incoming connections */
+    double seconds;             /**< Wall time spent computing the layer */
+};
+
+/** Measurements of a profiling run */
+struct profile {
+    unsigned long samples;                              /**< Forward passes measured (rows x repetitions) */
+    unsigned int numLayers;                             /**< Number of layers */
+    struct profile_layer *layers;                       /**< Per layer measurements */
+    double totalSeconds;                                /**< Sum of the layer times */
+    double activationSeconds[NET_NUM_ACTIVATIONS];      /**< Time spent in each activation function */
+    uint64_t activationCount[NET_NUM_ACTIVATIONS];      /**< Neurons using each activation function */
+};
+
+int profile_run(const struct net_image *img, const fann_type *inputs, unsigned int rows, unsigned int repeat, enum net_activation_mode mode, struct profile *prof);
+void profile_free(struct profile *prof);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* PROFILE_H */
+
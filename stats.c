@@ -0,0 +1,289 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+/*
+ * Column statistics of data files.
+ *
+ * Every column gets a Welford accumulator (count, mean, sum of squared
+ * differences from the mean, min and max), so files are read once and never
+ * held in memory. Threads accumulate separate parts of a file and their
+ * accumulators are merged with Chan's formula, which is exact up to rounding.
+ *
+ * Text files are parsed with parse_fold(): a thread does not know which
+ * column the first value of its chunk belongs to until all of them are done,
+ * so it accumulates by position in the chunk and the accumulators are rotated
+ * into place when merged.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "stats.h"
+#include "dataset.h"
+#include "threads.h"
+
+/** State shared by the threads computing statistics */
+struct stats_job {
+    struct stats_column *acc;   /**< width accumulators per thread or chunk */
+    unsigned int width;         /**< Values per sample */
+    unsigned int numData;       /**< Number of samples */
+    unsigned int nParts;        /**< Number of parts (binary files) */
+    const fann_type *values;    /**< Values of mapped binary files */
+};
+
+/**
+ * Add a value to a column
+ * @param column Column
+ * @param value Value
+ */
+void stats_add(struct stats_column *column, double value)
+{
+    if (column->count == 0 || value < column->min) column->min = value;
+    if (column->count == 0 || value > column->max) column->max = value;
+    column->count++;
+    double delta = value - column->mean;
+    column->mean += delta / (double) column->count;
+    column->m2 += delta * (value - column->mean);
+}
+
+/**
+ * Merge the statistics of another part of a column
+ * @param column Column
+ * @param other Statistics to merge into column
+ */
+void stats_merge(struct stats_column *column, const struct stats_column *other)
+{
+    if (other->count == 0) return;
+    if (column->count == 0) {
+        *column = *other;
+        return;
+    }
+    double n = (double) column->count + (double) other->count;
+    double delta = other->mean - column->mean;
+    column->mean += delta * (double) other->count / n;
+    column->m2 += other->m2 + delta * delta * (double) column->count * (double) other->count / n;
+    if (other->min < column->min) column->min = other->min;
+    if (other->max > column->max) column->max = other->max;
+    column->count += other->count;
+}
+
+/**
+ * Standard deviation of a column, over the whole population as FANN computes it for scaling
+ * @param column Column
+ * @return Standard deviation
+ */
+double stats_deviation(const struct stats_column *column)
+{
+    return (column->count == 0) ? 0 : sqrt(column->m2 / (double) column->count);
+}
+
+/** Accumulate the values handed by parse_fold(), by position in their chunk */
+static void visit_text(unsigned int chunk, size_t offset, const fann_type *values, size_t count, void *arg)
+{
+    struct stats_job *job = (struct stats_job *) arg;
+    struct stats_column *acc = job->acc + (size_t) chunk * job->width;
+    unsigned int col = (unsigned int) (offset % job->width);
+    for (size_t i = 0; i < count; i++) {
+        stats_add(&acc[col], values[i]);
+        if (++col == job->width) col = 0;
+    }
+}
+
+/** Accumulate a part of the samples of a mapped binary file */
+static void binary_task(unsigned int index, void *arg)
+{
+    struct stats_job *job = (struct stats_job *) arg;
+    struct stats_column *acc = job->acc + (size_t) index * job->width;
+    unsigned int first = (unsigned int) ((uint64_t) job->numData * index / job->nParts);
+    unsigned int last = (unsigned int) ((uint64_t) job->numData * (index + 1) / job->nParts);
+    for (unsigned int i = first; i < last; i++) {
+        const fann_type *sample = job->values + (size_t) i * job->width;
+        for (unsigned int j = 0; j < job->width; j++) {
+            stats_add(&acc[j], sample[j]);
+        }
+    }
+}
+
+/**
+ * Compute the statistics of every column of a data file, in text or binary format
+ * @param src Source, at the start of the file
+ * @param nThreads Maximum number of threads (0: one per processor). Only mapped files are read in parallel
+ * @param stats Output statistics. Release with stats_free()
+ * @return 0 on success, -1 on error (reported)
+ */
+int stats_compute(struct parse_src *src, unsigned int nThreads, struct stats *stats)
+{
+    struct stats_job job;
+    size_t *firstValues = NULL;
+    int binary = parse_binary_header(src, &stats->numData, &stats->numInput, &stats->numOutput);
+
+    stats->columns = NULL;
+    if (binary < 0 || (binary == 0 && parse_header(src, &stats->numData, &stats->numInput, &stats->numOutput) != 0)) return -1;
+    if (nThreads == 0) nThreads = threads_available();
+
+    memset(&job, 0, sizeof(job));
+    job.width = stats->numInput + stats->numOutput;
+    job.numData = stats->numData;
+    job.acc = (struct stats_column *) calloc((size_t) nThreads * job.width, sizeof(struct stats_column));
+    stats->columns = (struct stats_column *) calloc(job.width, sizeof(struct stats_column));
+    firstValues = (size_t *) malloc(sizeof(size_t) * nThreads);
+    if (job.acc == NULL || stats->columns == NULL || firstValues == NULL) {
+        fprintf(stderr, "%s: out of memory\n", src->name);
+        goto ERR;
+    }
+
+    if (binary) {
+        job.values = (const fann_type *) (src->buf + sizeof(struct dataset_binary_header));
+        job.nParts = (stats->numData < nThreads) ? 1 : nThreads;
+        threads_run(job.nParts, job.nParts, binary_task, &job);
+        for (unsigned int i = 0; i < job.nParts; i++) {
+            for (unsigned int j = 0; j < job.width; j++) {
+                stats_merge(&stats->columns[j], &job.acc[(size_t) i * job.width + j]);
+            }
+        }
+    } else {
+        int nChunks = parse_fold(src, stats->numData, job.width, nThreads, visit_text, &job, firstValues);
+        if (nChunks < 0) goto ERR;
+        for (int i = 0; i < nChunks; i++) {
+            unsigned int rotation = (unsigned int) (firstValues[i] % job.width);
+            for (unsigned int j = 0; j < job.width; j++) {
+                stats_merge(&stats->columns[(j + rotation) % job.width], &job.acc[(size_t) i * job.width + j]);
+            }
+        }
+    }
+
+    free(job.acc);
+    free(firstValues);
+    return 0;
+
+ERR:
+    free(job.acc);
+    free(firstValues);
+    stats_free(stats);
+    return -1;
+}
+
+/**
+ * Compute the statistics of every column of a data file, in text or binary format
+ * @param path File path
+ * @param nThreads Maximum number of threads (0: one per processor)
+ * @param stats Output statistics. Release with stats_free()
+ * @return 0 on success, -1 on error (reported)
+ */
+int stats_file(const char *path, unsigned int nThreads, struct stats *stats)
+{
+    struct parse_src *src = parse_open(path);
+    if (src == NULL) return -1;
+    int r = stats_compute(src, nThreads, stats);
+    parse_close(src);
+    return r;
+}
+
+/**
+ * Release statistics
+ * @param stats Statistics
+ */
+void stats_free(struct stats *stats)
+{
+    free(stats->columns);
+    stats->columns = NULL;
+}
+
+/**
+ * Set the scaling parameters of an ANN from the statistics of its training data.
+ * FANN scales every input and output so that the mean minus one standard
+ * deviation maps to the new minimum and the mean plus one standard deviation
+ * maps to the new maximum. FANN computes them from a data set in memory; here
+ * they are given as a two sample data set with the same mean and deviation.
+ * Columns with no deviation get a deviation of 1, so that they are shifted
+ * instead of divided by zero.
+ * @param ann ANN
+ * @param stats Statistics of the training data
+ * @param inputMin New minimum of the inputs
+ * @param inputMax New maximum of the inputs
+ * @param outputMin New minimum of the outputs
+ * @param outputMax New maximum of the outputs
+ * @return 0 on success, -1 on error (reported)
+ */
+int stats_set_scaling(struct fann *ann, const struct stats *stats, float inputMin, float inputMax, float outputMin, float outputMax)
+{
+    if (stats->numInput != fann_get_num_input(ann) || stats->numOutput != fann_get_num_output(ann)) {
+        fprintf(stderr, "Data has %u inputs and %u outputs but the ANN has %u and %u\n",
+                stats->numInput, stats->numOutput, fann_get_num_input(ann), fann_get_num_output(ann));
+        return -1;
+    }
+    struct fann_train_data *data = fann_create_train(2, stats->numInput, stats->numOutput);
+    if (data == NULL) return -1;
+    for (unsigned int j = 0; j < stats->numInput + stats->numOutput; j++) {
+        const struct stats_column *column = &stats->columns[j];
+        double deviation = stats_deviation(column);
+        if (deviation == 0) deviation = 1;
+        fann_type *row0 = (j < stats->numInput) ? &data->input[0][j] : &data->output[0][j - stats->numInput];
+        fann_type *row1 = (j < stats->numInput) ? &data->input[1][j] : &data->output[1][j - stats->numInput];
+        *row0 = (fann_type) (column->mean - deviation);
+        *row1 = (fann_type) (column->mean + deviation);
+    }
+    int r = fann_set_scaling_params(ann, data, inputMin, inputMax, outputMin, outputMax);
+    fann_destroy_train(data);
+    return (r == 0) ? 0 : -1;
+}
+
+/**
+ * Initialize the weights of an ANN with Widrow and Nguyen's algorithm.
+ * fann_init_weights() only uses the smallest and largest input of the whole
+ * training data, so it is given a two sample data set holding them.
+ * @param ann ANN
+ * @param stats Statistics of the training data
+ * @return 0 on success, -1 on error (reported)
+ */
+int stats_init_weights(struct fann *ann, const struct stats *stats)
+{
+    if (stats->numInput != fann_get_num_input(ann) || stats->numData == 0) {
+        fprintf(stderr, "Data has %u samples of %u inputs but the ANN has %u inputs\n",
+                stats->numData, stats->numInput, fann_get_num_input(ann));
+        return -1;
+    }
+    struct fann_train_data *data = fann_create_train(2, stats->numInput, stats->numOutput);
+    if (data == NULL) return -1;
+    double min = stats->columns[0].min, max = stats->columns[0].max;
+    for (unsigned int j = 1; j < stats->numInput; j++) {
+        if (stats->columns[j].min < min) min = stats->columns[j].min;
+        if (stats->columns[j].max > max) max = stats->columns[j].max;
+    }
+    for (unsigned int j = 0; j < stats->numInput; j++) {
+        data->input[0][j] = (fann_type) min;
+        data->input[1][j] = (fann_type) max;
+    }
+    fann_init_weights(ann, data);
+    fann_destroy_train(data);
+    return 0;
+}
+
+/**
+ * Scale a data set in place with the scaling parameters of an ANN, if it has any,
+ * so that it can be used to train or test the ANN
+ * @param ann ANN
+ * @param data Data
+ */
+void stats_scale_data(struct fann *ann, struct fann_train_data *data)
+{
+    if (ann->scale_mean_in == NULL && ann->scale_mean_out == NULL) return;
+    for (unsigned int i = 0; i < data->num_data; i++) {
+        if (ann->scale_mean_in != NULL) fann_scale_input(ann, data->input[i]);
+        if (ann->scale_mean_out != NULL) fann_scale_output(ann, data->output[i]);
+    }
+}
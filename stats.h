@@ -0,0 +1,60 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef STATS_H
+#define	STATS_H
+
+#include <stdint.h>
+#include <fann.h>
+#include "parse.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/** Statistics of a column of a data file */
+struct stats_column {
+    uint64_t count;             /**< Number of values */
+    double min;                 /**< Smallest value */
+    double max;                 /**< Largest value */
+    double mean;                /**< Mean */
+    double m2;                  /**< Sum of squared differences from the mean */
+};
+
+/** Statistics of a data file */
+struct stats {
+    unsigned int numData;       /**< Number of samples */
+    unsigned int numInput;      /**< Number of inputs */
+    unsigned int numOutput;     /**< Number of outputs */
+    struct stats_column *columns;   /**< Inputs followed by outputs */
+};
+
+void stats_add(struct stats_column *column, double value);
+void stats_merge(struct stats_column *column, const struct stats_column *other);
+double stats_deviation(const struct stats_column *column);
+int stats_compute(struct parse_src *src, unsigned int nThreads, struct stats *stats);
+int stats_file(const char *path, unsigned int nThreads, struct stats *stats);
+void stats_free(struct stats *stats);
+int stats_set_scaling(struct fann *ann, const struct stats *stats, float inputMin, float inputMax, float outputMin, float outputMax);
+int stats_init_weights(struct fann *ann, const struct stats *stats);
+void stats_scale_data(struct fann *ann, struct fann_train_data *data);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* STATS_H */
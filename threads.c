@@ -0,0 +1,83 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "threads.h"
+
+/** Shared state of a threads_run() call */
+struct threads_ctx {
+    unsigned int count;         /**< Number of tasks */
+    unsigned int next;          /**< Next task to hand out */
+    threads_task task;          /**< Task function */
+    void *arg;                  /**< Task argument */
+};
+
+/** Worker loop: take tasks until there are no more */
+static void *threads_worker(void *p)
+{
+    struct threads_ctx *ctx = (struct threads_ctx *) p;
+    unsigned int i;
+    while ((i = __sync_fetch_and_add(&ctx->next, 1)) < ctx->count) {
+        ctx->task(i, ctx->arg);
+    }
+    return NULL;
+}
+
+/**
+ * Get the number of online processors
+ * @return Number of processors (at least 1)
+ */
+unsigned int threads_available(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (unsigned int) n : 1;
+}
+
+/**
+ * Run tasks 0..count-1 on a set of threads and wait for all of them.
+ * Tasks are handed out one at a time, so uneven tasks balance themselves.
+ * The calling thread takes part in the work; if threads cannot be created,
+ * the remaining ones (at least the caller) still run every task.
+ * @param nThreads Maximum number of threads, or 0 for one per processor
+ * @param count Number of tasks
+ * @param task Task function
+ * @param arg Task argument
+ */
+void threads_run(unsigned int nThreads, unsigned int count, threads_task task, void *arg)
+{
+    struct threads_ctx ctx = {count, 0, task, arg};
+    unsigned int i, started = 0;
+
+    if (nThreads == 0) nThreads = threads_available();
+    if (nThreads > count) nThreads = count;
+
+    pthread_t *tids = (nThreads > 1) ? (pthread_t *) malloc(sizeof(pthread_t) * (nThreads - 1)) : NULL;
+    if (tids != NULL) {
+        for (i = 0; i < nThreads - 1; i++) {
+            if (pthread_create(&tids[started], NULL, threads_worker, &ctx) == 0) started++;
+        }
+    }
+
+    threads_worker(&ctx);
+
+    for (i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    free(tids);
+}
@@ -0,0 +1,36 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef THREADS_H
+#define	THREADS_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/** Task run by threads_run(). Receives the task index and the user argument */
+typedef void (*threads_task)(unsigned int index, void *arg);
+
+unsigned int threads_available(void);
+void threads_run(unsigned int nThreads, unsigned int count, threads_task task, void *arg);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* THREADS_H */
+
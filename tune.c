@@ -0,0 +1,399 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+/*
+ * Execution autotuner.
+ *
+ * A network is run over a set of input rows with every combination of engine,
+ * thread count and batch size worth trying on this host, each one repeated
+ * until it has run for a minimum time. Configurations are listed from the
+ * cheapest to the most demanding (FANN, then images with more threads and
+ * larger batches), and the first one within TUNE_TOLERANCE of the fastest is
+ * picked, so that measurement noise does not buy threads or latency that
+ * hardly pay off.
+ *
+ * The chosen configuration is saved as a small text file in the cache
+ * directory (see cache.h), named after the network's canonical path. It
+ * records the size and modification time of the network file, the model and
+ * number of processors of the host and the activation mode it was measured
+ * with, and it is ignored once any of them changes or the network is run in
+ * another mode.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "tune.h"
+#include "batch.h"
+#include "cache.h"
+#include "metrics.h"
+#include "threads.h"
+
+/** Relative slowdown accepted in exchange for a cheaper configuration */
+#define TUNE_TOLERANCE  0.03
+
+/** Batch sizes tried for images */
+static const unsigned int BATCH_SIZES[] = {1, 16, 128, 1024, 8192};
+
+#define NUM_BATCH_SIZES (sizeof(BATCH_SIZES) / sizeof(BATCH_SIZES[0]))
+
+/** Profile fields, in file order */
+enum {
+    FIELD_ANN = 0,
+    FIELD_SIZE,
+    FIELD_MTIME,
+    FIELD_HOST,
+    FIELD_ACTIVATION,
+    FIELD_ENGINE,
+    FIELD_THREADS,
+    FIELD_BATCH_SIZE,
+    FIELD_US_PER_SAMPLE,
+    NUM_FIELDS
+};
+
+static char const *const FIELD_NAMES[] = {"ann", "size", "mtime", "host", "activation", "engine", "threads", "batch_size", "us_per_sample"};
+
+/**
+ * Time FANN running the rows
+ * @return Elapsed nanoseconds, or 0 if out of memory
+ */
+static uint64_t time_fann(struct fann *ann, const fann_type *inputs, unsigned int rows, uint64_t minNs, unsigned long long *samples)
+{
+    unsigned int numInput = fann_get_num_input(ann), i;
+    fann_type *row = (fann_type *) malloc(sizeof(fann_type) * numInput);
+    uint64_t start = metrics_now(), elapsed;
+
+    if (row == NULL) return 0;
+    do {
+        for (i = 0; i < rows; i++) {
+            memcpy(row, inputs + (size_t) numInput * i, sizeof(fann_type) * numInput);
+            if (ann->scale_mean_in != NULL) fann_scale_input(ann, row);
+            fann_type *output = fann_run(ann, row);
+            if (ann->scale_mean_out != NULL) fann_descale_output(ann, output);
+        }
+        *samples += rows;
+        elapsed = metrics_now() - start;
+    } while (elapsed < minNs);
+    free(row);
+    return elapsed;
+}
+
+/**
+ * Time an image running the rows in batches
+ * @return Elapsed nanoseconds, or 0 if out of memory
+ */
+static uint64_t time_image(const struct net_image *img, const fann_type *inputs, unsigned int rows, enum net_activation_mode mode,
+        const struct tune_config *config, uint64_t minNs, unsigned long long *samples)
+{
+    struct batch_runner runner;
+    unsigned int batchSize = (config->batchSize < rows) ? config->batchSize : rows, i;
+    fann_type *batch = (fann_type *) malloc(sizeof(fann_type) * img->numInput * batchSize);
+    fann_type *outputs = (fann_type *) malloc(sizeof(fann_type) * img->numOutput * batchSize);
+    uint64_t start, elapsed = 0;
+
+    if (batch == NULL || outputs == NULL || batch_init(&runner, img, mode, config->threads) != 0) {
+        free(batch);
+        free(outputs);
+        return 0;
+    }
+    start = metrics_now();
+    do {
+        for (i = 0; i < rows; i += batchSize) {
+            unsigned int n = (rows - i < batchSize) ? rows - i : batchSize;
+            //Inputs are scaled in place, so every run starts from a fresh copy
+            memcpy(batch, inputs + (size_t) img->numInput * i, sizeof(fann_type) * img->numInput * n);
+            batch_run(&runner, batch, n, outputs);
+        }
+        *samples += rows;
+        elapsed = metrics_now() - start;
+    } while (elapsed < minNs);
+    batch_free(&runner);
+    free(batch);
+    free(outputs);
+    return elapsed;
+}
+
+/**
+ * Benchmark the ways of running a network on this host
+ * @param ann ANN, or NULL to only try its image
+ * @param img Image of the ANN
+ * @param inputs Input rows (rows x numInput)
+ * @param rows Number of rows
+ * @param mode Activation mode. FANN is only tried in exact mode
+ * @param maxThreads Maximum number of threads (0: one per processor)
+ * @param minSeconds Minimum time each configuration is run for
+ * @param configs Output configurations with their measured time, cheapest first. Release with free()
+ * @param count Output number of configurations
+ * @return 0 on success, -1 if out of memory (reported)
+ */
+int tune_benchmark(struct fann *ann, const struct net_image *img, const fann_type *inputs, unsigned int rows,
+        enum net_activation_mode mode, unsigned int maxThreads, double minSeconds, struct tune_config **configs, unsigned int *count)
+{
+    unsigned int n = 0, threads, b, i;
+    uint64_t minNs = (uint64_t) (minSeconds * 1e9);
+
+    if (maxThreads == 0) maxThreads = threads_available();
+    //Thread counts double up to maxThreads: at most 33 of them
+    struct tune_config *list = (struct tune_config *) calloc(1 + 33 * NUM_BATCH_SIZES, sizeof(struct tune_config));
+    if (list == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        return -1;
+    }
+
+    if (ann != NULL && mode == NET_ACTIVATION_EXACT) {
+        list[n].engine = TUNE_ENGINE_FANN;
+        list[n].threads = 1;
+        list[n].batchSize = 1;
+        n++;
+    }
+    for (threads = 1; ; threads = (threads * 2 < maxThreads) ? threads * 2 : maxThreads) {
+        for (b = 0; b < NUM_BATCH_SIZES; b++) {
+            //Larger batches than rows, or than needed to keep the threads busy, are not worth trying
+            if (b > 0 && BATCH_SIZES[b - 1] >= rows) break;
+            if (BATCH_SIZES[b] < threads) continue;
+            list[n].engine = TUNE_ENGINE_IMAGE;
+            list[n].threads = threads;
+            list[n].batchSize = BATCH_SIZES[b];
+            n++;
+        }
+        if (threads == maxThreads) break;
+    }
+
+    for (i = 0; i < n; i++) {
+        unsigned long long samples = 0;
+        uint64_t elapsed = (list[i].engine == TUNE_ENGINE_FANN)
+                ? time_fann(ann, inputs, rows, minNs, &samples)
+                : time_image(img, inputs, rows, mode, &list[i], minNs, &samples);
+        if (elapsed == 0 && samples == 0) {
+            fprintf(stderr, "Out of memory!\n");
+            free(list);
+            return -1;
+        }
+        list[i].usPerSample = (double) elapsed * 1e-3 / (double) samples;
+    }
+
+    *configs = list;
+    *count = n;
+    return 0;
+}
+
+/**
+ * Pick the cheapest configuration within TUNE_TOLERANCE of the fastest one
+ * @param configs Configurations, cheapest first, as given by tune_benchmark()
+ * @param count Number of configurations (at least 1)
+ * @return Index of the chosen configuration
+ */
+unsigned int tune_pick(const struct tune_config *configs, unsigned int count)
+{
+    unsigned int i, best = 0;
+
+    for (i = 1; i < count; i++) {
+        if (configs[i].usPerSample < configs[best].usPerSample) best = i;
+    }
+    for (i = 0; i < best; i++) {
+        if (configs[i].usPerSample <= configs[best].usPerSample * (1 + TUNE_TOLERANCE)) return i;
+    }
+    return best;
+}
+
+/**
+ * Describe the host: processor model and number of processors
+ * @param out Output buffer
+ * @param size Buffer size
+ */
+void tune_host(char *out, size_t size)
+{
+    char line[256], model[256] = "unknown";
+    FILE *fp = fopen("/proc/cpuinfo", "r");
+
+    if (fp != NULL) {
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            char *colon = strchr(line, ':');
+            if (strncmp(line, "model name", 10) != 0 || colon == NULL) continue;
+            colon++;
+            while (*colon == ' ' || *colon == '\t') colon++;
+            colon[strcspn(colon, "\n")] = '\0';
+            snprintf(model, sizeof(model), "%s", colon);
+            break;
+        }
+        fclose(fp);
+    }
+    snprintf(out, size, "%s x %u", model, threads_available());
+}
+
+/**
+ * Save the tuning profile of a network to the cache directory
+ * @param annPath Path to the network file
+ * @param mode Activation mode the configuration was measured with
+ * @param config Configuration
+ * @return 0 on success, -1 on error (reported)
+ */
+int tune_save(const char *annPath, enum net_activation_mode mode, const struct tune_config *config)
+{
+    char path[PATH_MAX], canonPath[PATH_MAX], tmpPath[PATH_MAX], host[512];
+    struct stat st;
+
+    if (cache_file_path(annPath, TUNE_SUFFIX, path, canonPath) != 0 || stat(canonPath, &st) != 0) {
+        fprintf(stderr, "%s: could not open file\n", annPath);
+        return -1;
+    }
+    if (cache_make_dir() != 0) {
+        fprintf(stderr, "Could not create cache directory %s\n", cache_dir());
+        return -1;
+    }
+    tune_host(host, sizeof(host));
+
+    int fd = cache_temp_file(path, tmpPath);
+    FILE *fp = (fd >= 0) ? fdopen(fd, "w") : NULL;
+    if (fp == NULL) {
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmpPath);
+        }
+        fprintf(stderr, "Could not write tuning profile %s\n", path);
+        return -1;
+    }
+    fprintf(fp, "%s %s\n", FIELD_NAMES[FIELD_ANN], canonPath);
+    fprintf(fp, "%s %lld\n", FIELD_NAMES[FIELD_SIZE], (long long) st.st_size);
+    fprintf(fp, "%s %lld.%09ld\n", FIELD_NAMES[FIELD_MTIME], (long long) st.st_mtim.tv_sec, (long) st.st_mtim.tv_nsec);
+    fprintf(fp, "%s %s\n", FIELD_NAMES[FIELD_HOST], host);
+    fprintf(fp, "%s %s\n", FIELD_NAMES[FIELD_ACTIVATION], NET_ACTIVATION_MODE_NAMES[mode]);
+    fprintf(fp, "%s %s\n", FIELD_NAMES[FIELD_ENGINE], TUNE_ENGINE_NAMES[config->engine]);
+    fprintf(fp, "%s %u\n", FIELD_NAMES[FIELD_THREADS], config->threads);
+    fprintf(fp, "%s %u\n", FIELD_NAMES[FIELD_BATCH_SIZE], config->batchSize);
+    fprintf(fp, "%s %.6f\n", FIELD_NAMES[FIELD_US_PER_SAMPLE], config->usPerSample);
+
+    int ok = !ferror(fp);
+    if (fclose(fp) != 0) ok = 0;
+    if (!ok || rename(tmpPath, path) != 0) {
+        unlink(tmpPath);
+        fprintf(stderr, "Could not write tuning profile %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Load the tuning profile of a network from the cache directory
+ * @param annPath Path to the network file
+ * @param mode Activation mode the network will be run with
+ * @param config Output configuration, only modified if a profile is found
+ * @return 1 if a profile matching the network file, the host and the activation mode was found, 0 otherwise
+ */
+int tune_load(const char *annPath, enum net_activation_mode mode, struct tune_config *config)
+{
+    char path[PATH_MAX], canonPath[PATH_MAX], line[PATH_MAX + 64], host[512], mtime[64];
+    struct stat st;
+    struct tune_config c = {TUNE_ENGINE_FANN, 1, 1, 0};
+    unsigned int valid = 0, f;
+
+    if (cache_file_path(annPath, TUNE_SUFFIX, path, canonPath) != 0 || stat(canonPath, &st) != 0) return 0;
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) return 0;
+
+    tune_host(host, sizeof(host));
+    snprintf(mtime, sizeof(mtime), "%lld.%09ld", (long long) st.st_mtim.tv_sec, (long) st.st_mtim.tv_nsec);
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char *value = strchr(line, ' ');
+        if (value == NULL) continue;
+        *value++ = '\0';
+        value[strcspn(value, "\n")] = '\0';
+        for (f = 0; f < NUM_FIELDS && strcmp(line, FIELD_NAMES[f]) != 0; f++);
+
+        int ok = 0;
+        switch (f) {
+            case FIELD_ANN:
+                ok = strcmp(value, canonPath) == 0;
+                break;
+            case FIELD_SIZE:
+                ok = strtoll(value, NULL, 10) == (long long) st.st_size;
+                break;
+            case FIELD_MTIME:
+                ok = strcmp(value, mtime) == 0;
+                break;
+            case FIELD_HOST:
+                ok = strcmp(value, host) == 0;
+                break;
+            case FIELD_ACTIVATION:
+                ok = strcmp(value, NET_ACTIVATION_MODE_NAMES[mode]) == 0;
+                break;
+            case FIELD_ENGINE:
+                for (c.engine = 0; c.engine < sizeof(TUNE_ENGINE_NAMES) / sizeof(TUNE_ENGINE_NAMES[0]); c.engine++) {
+                    if (strcmp(value, TUNE_ENGINE_NAMES[c.engine]) == 0) break;
+                }
+                ok = c.engine < sizeof(TUNE_ENGINE_NAMES) / sizeof(TUNE_ENGINE_NAMES[0]);
+                break;
+            case FIELD_THREADS:
+                c.threads = (unsigned int) strtoul(value, NULL, 10);
+                ok = c.threads > 0;
+                break;
+            case FIELD_BATCH_SIZE:
+                c.batchSize = (unsigned int) strtoul(value, NULL, 10);
+                ok = c.batchSize > 0;
+                break;
+            case FIELD_US_PER_SAMPLE:
+                c.usPerSample = strtod(value, NULL);
+                ok = 1;
+                break;
+        }
+        if (ok) valid |= 1u << f;
+    }
+    fclose(fp);
+
+    if (valid != (1u << NUM_FIELDS) - 1) return 0;
+    *config = c;
+    return 1;
+}
+
+/**
+ * Tell whether a tuning profile still matches its network file, as for the
+ * image entries of the cache (see cache_list())
+ * @param path Profile path
+ * @param annPath Output network path (PATH_MAX), empty if unknown
+ * @return "valid", "stale", "missing" or "invalid"
+ */
+const char *tune_profile_status(const char *path, char *annPath)
+{
+    char line[PATH_MAX + 64], mtime[64] = "";
+    long long size = -1;
+    struct stat st;
+    FILE *fp = fopen(path, "r");
+
+    annPath[0] = '\0';
+    if (fp == NULL) return "invalid";
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char *value = strchr(line, ' ');
+        if (value == NULL) continue;
+        *value++ = '\0';
+        value[strcspn(value, "\n")] = '\0';
+        if (strcmp(line, FIELD_NAMES[FIELD_ANN]) == 0) {
+            snprintf(annPath, PATH_MAX, "%s", value);
+        } else if (strcmp(line, FIELD_NAMES[FIELD_SIZE]) == 0) {
+            size = strtoll(value, NULL, 10);
+        } else if (strcmp(line, FIELD_NAMES[FIELD_MTIME]) == 0) {
+            snprintf(mtime, sizeof(mtime), "%s", value);
+        }
+    }
+    fclose(fp);
+
+    if (annPath[0] == '\0' || size < 0 || mtime[0] == '\0') return "invalid";
+    if (stat(annPath, &st) != 0) return "missing";
+    snprintf(line, sizeof(line), "%lld.%09ld", (long long) st.st_mtim.tv_sec, (long) st.st_mtim.tv_nsec);
+    return (size == (long long) st.st_size && strcmp(mtime, line) == 0) ? "valid" : "stale";
+}
@@ -0,0 +1,61 @@
+/**
+ * fannc
+ * Copyright (c) 2014, Claudi Martínez <claudix.kernel@gmail.com>, All rights reserved.
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3.0 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.
+ *
+ */
+
+#ifndef TUNE_H
+#define	TUNE_H
+
+#include <stddef.h>
+#include <fann.h>
+#include "net.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/** Suffix of tuning profiles in the cache directory */
+#define TUNE_SUFFIX ".tune"
+
+/** Engines able to run a network */
+enum tune_engine {
+    TUNE_ENGINE_FANN = 0,   /**< FANN's fann_run(), one row at a time */
+    TUNE_ENGINE_IMAGE       /**< Network image (see net.h), in batches shared by threads */
+};
+
+static char const *const TUNE_ENGINE_NAMES[] = {"fann", "image"};
+
+/** How a network is run */
+struct tune_config {
+    enum tune_engine engine;    /**< Engine */
+    unsigned int threads;       /**< Threads sharing each batch */
+    unsigned int batchSize;     /**< Rows run at once */
+    double usPerSample;         /**< Measured time per sample in microseconds, or 0 if not measured */
+};
+
+int tune_benchmark(struct fann *ann, const struct net_image *img, const fann_type *inputs, unsigned int rows,
+        enum net_activation_mode mode, unsigned int maxThreads, double minSeconds, struct tune_config **configs, unsigned int *count);
+unsigned int tune_pick(const struct tune_config *configs, unsigned int count);
+void tune_host(char *out, size_t size);
+int tune_save(const char *annPath, enum net_activation_mode mode, const struct tune_config *config);
+int tune_load(const char *annPath, enum net_activation_mode mode, struct tune_config *config);
+const char *tune_profile_status(const char *path, char *annPath);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* TUNE_H */
+